@@ -0,0 +1,51 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+// Vertex shader for the compact ocean vertex (see wave_vertex.h).
+// Unpacks fixed point position and an octahedral normal; the colour comes from a uniform.
+//
+
+// matrices
+uniform mat4 modelToProjection;
+uniform mat4 modelToCamera;
+
+// x = x origin, y = xy scale, z = height scale, w = y origin
+uniform vec4 ocean_unpack;
+uniform vec4 ocean_colour;
+
+// attributes from vertex buffer
+attribute vec3 pos;     // unsigned short x, y, biased height
+attribute vec2 normal;  // signed byte octahedral normal, normalized to -1..1
+
+// outputs
+varying vec3 normal_;
+varying vec2 uv_;
+varying vec4 color_;
+varying vec3 model_pos_;
+varying vec3 camera_pos_;
+
+vec3 decode_octahedral(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0) {
+    vec2 s = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    n.xy = (1.0 - abs(n.yx)) * s;
+  }
+  return normalize(n);
+}
+
+void main() {
+  vec4 mpos = vec4(
+    pos.x * ocean_unpack.y + ocean_unpack.x,
+    pos.y * ocean_unpack.y + ocean_unpack.w,
+    (pos.z - 32768.0) * ocean_unpack.z,
+    1.0
+  );
+  // the grid runs down the screen, as in the full vertex format
+  mpos.y = -mpos.y;
+
+  gl_Position = modelToProjection * mpos;
+  normal_ = (modelToCamera * vec4(decode_octahedral(max(normal, -1.0)), 0.0)).xyz;
+  uv_ = vec2(0.0, 0.0);
+  color_ = ocean_colour;
+  camera_pos_ = (modelToCamera * mpos).xyz;
+  model_pos_ = mpos.xyz;
+}
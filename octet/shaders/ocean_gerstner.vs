@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////////////////////////
+//
+// Vertex shader for Gerstner waves on the GPU (see wave_gpu.h).
+// The vertex buffer holds the flat grid; the waves come in as uniforms each frame.
+//
+
+// matrices
+uniform mat4 modelToProjection;
+uniform mat4 modelToCamera;
+
+// two vec4s a wave: (kx, ky, phase, amplitude), (qa_x, qa_y, 0, 0)
+#define MAX_WAVES 16
+uniform vec4 ocean_waves[MAX_WAVES * 2];
+uniform float ocean_wave_count;
+uniform vec4 ocean_colour;
+
+// attributes from vertex buffer
+attribute vec3 pos;     // grid x, grid row, stitch
+
+// outputs
+varying vec3 normal_;
+varying vec2 uv_;
+varying vec4 color_;
+varying vec3 model_pos_;
+varying vec3 camera_pos_;
+
+void gerstner(vec2 p, out vec3 disp, out vec3 normal) {
+  vec3 binormal = vec3(1.0, 0.0, 0.0);
+  vec3 tangent = vec3(0.0, 1.0, 0.0);
+  disp = vec3(0.0, 0.0, 0.0);
+  for (int i = 0; i < MAX_WAVES; ++i) {
+    if (float(i) >= ocean_wave_count) break;
+    vec4 a = ocean_waves[i * 2];
+    vec4 b = ocean_waves[i * 2 + 1];
+    float angle = a.x * p.x + a.y * p.y + a.z;
+    float c = cos(angle), s = sin(angle);
+    disp += vec3(b.x * c, b.y * c, a.w * s);
+    binormal += vec3(-b.x * a.x * s, -b.y * a.x * s, a.w * a.x * c);
+    tangent += vec3(b.x * a.y * s, b.y * a.y * s, -a.w * a.y * c);
+  }
+  normal = normalize(cross(binormal, tangent));
+}
+
+void main() {
+  vec3 disp, n;
+  if (pos.z == 0.0) {
+    gerstner(pos.xy, disp, n);
+  } else {
+    // an odd vertex on the edge of a level sits halfway between its neighbours
+    vec2 offset = pos.z > 0.0 ? vec2(pos.z, 0.0) : vec2(0.0, -pos.z);
+    vec3 d0, d1, n0, n1;
+    gerstner(pos.xy - offset, d0, n0);
+    gerstner(pos.xy + offset, d1, n1);
+    disp = (d0 + d1) * 0.5;
+    n = (n0 + n1) * 0.5;
+  }
+
+  // the grid runs down the screen, as in the full vertex format
+  vec4 mpos = vec4(pos.x + disp.x, -pos.y + disp.y, disp.z, 1.0);
+
+  gl_Position = modelToProjection * mpos;
+  normal_ = (modelToCamera * vec4(n, 0.0)).xyz;
+  uv_ = vec2(0.0, 0.0);
+  color_ = ocean_colour;
+  camera_pos_ = (modelToCamera * mpos).xyz;
+  model_pos_ = mpos.xyz;
+}
@@ -6,14 +6,18 @@
 //
 // game-style memory allocator
 //
-// this is a placeholder for a game-style memory allocator
-// using malloc and free is frowned upon in grown-up circles.
+// Blocks of up to max_small bytes come from size classes: 16 bytes apart up to 128, then four
+// classes to each doubling. Each class carves its blocks from 64k spans it gets from the system
+// and keeps the freed ones on a list to hand out again. Every thread keeps a few blocks of each
+// class of its own, so most calls take no locks at all, and trades them with the shared lists
+// a batch at a time. Bigger blocks go straight to the system.
 //
-// these functions are poor for the following reasons:
+// The callers always know how big a block is (dynarray has its capacity, resources their
+// sizeof), so free() and realloc() are told the size and blocks need no headers. The size
+// passed to free() must be the size given to malloc() or realloc().
+//
+// Build with OCTET_SYSTEM_MALLOC to send everything to the system, for tools like valgrind.
 //
-// 1) free() has to compute the size of the block to free
-// 2) these functions use heavy weight locks to guard the heap.
-// 3) implementations are quite variable
 
 // this is a dummy class used to customise the placement new and delete
 struct dynarray_dummy_t {};
@@ -49,24 +53,187 @@ void operator delete(void *ptr, void *place, dynarray_dummy_t x) {}
 
 
 namespace octet { namespace containers {
+  /// Memory for the containers and resources. See the top of this file.
   class allocator {
+  public:
+    enum {
+      max_small = 16384,      // bigger blocks come from the system
+      num_classes = 36,
+      span_bytes = 65536,     // each size class gets memory from the system this much at a time
+    };
+
+  private:
+    struct free_block {
+      free_block *next;
+    };
+
+    // one size class, shared by all threads
+    struct size_class {
+      std::mutex lock;
+      free_block *free_list;
+      char *span;                           // unused part of the newest span
+      char *span_end;
+      unsigned size;
+      unsigned batch;                       // blocks moved to or from a thread at a time
+
+      // statistics. thread counts are added in when the thread trades blocks, so they lag a little
+      std::atomic<size_t> num_mallocs;
+      std::atomic<size_t> num_frees;
+      std::atomic<size_t> peak_blocks;
+      std::atomic<size_t> num_spans;
+
+      size_class() : num_mallocs(0), num_frees(0), peak_blocks(0), num_spans(0) {
+        free_list = 0;
+        span = span_end = 0;
+        size = batch = 0;
+      }
+    };
+
     // singleton state, a bit like an old-world global variable
     struct state_t {
-      size_t num_bytes;
+      size_class classes[num_classes];
+      uint8_t class_of[max_small / 16 + 1]; // size class for (size + 15) / 16
+
+      // blocks bigger than max_small
+      std::atomic<size_t> num_large_mallocs;
+      std::atomic<size_t> num_large_frees;
+      std::atomic<size_t> large_bytes;
+      std::atomic<size_t> peak_large_bytes;
+
+      state_t() : num_large_mallocs(0), num_large_frees(0), large_bytes(0), peak_large_bytes(0) {
+        for (unsigned c = 0; c != num_classes; ++c) {
+          unsigned size = c < 8 ? (c + 1) * 16 : (1u << (7 + (c - 8) / 4)) * (4 + (c - 8) % 4 + 1) / 4;
+          classes[c].size = size;
+          classes[c].batch = std::max(1u, std::min(32u, 4096 / size));
+        }
+        unsigned c = 0;
+        for (unsigned i = 0; i <= max_small / 16; ++i) {
+          while (classes[c].size < i * 16) ++c;
+          class_of[i] = (uint8_t)c;
+        }
+        #ifndef NDEBUG
+          atexit(report_at_exit);
+        #endif
+      }
     };
 
     static state_t &state() {
-      static state_t instance;
+      // never destroyed: containers in other static objects may be freed after it would have been
+      static state_t *instance = new state_t();
+      return *instance;
+    }
+
+    // the blocks this thread keeps for itself
+    struct thread_cache {
+      free_block *free_list[num_classes];
+      unsigned num_free[num_classes];
+      size_t num_mallocs[num_classes];      // since the last trade with the shared class
+      size_t num_frees[num_classes];
+      int status;                           // 0 before the first call, 1 in use, 2 after the thread has ended
+    };
+
+    static thread_cache &cache() {
+      static thread_local thread_cache instance;
       return instance;
     }
 
-  public:
-    // todo: implement this from scratch using a pool allocator
-    static void *malloc(size_t size) {
-      state().num_bytes += size;
-      #if OCTET_MAC
+    // gives the thread's blocks back when the thread ends
+    struct cache_guard {
+      ~cache_guard() {
+        thread_cache &tc = cache();
+        state_t &s = state();
+        for (unsigned c = 0; c != num_classes; ++c) {
+          give_back(s, tc, c, tc.num_free[c]);
+        }
+        tc.status = 2;
+      }
+    };
+
+    static void start_cache(thread_cache &tc) {
+      static thread_local cache_guard guard;
+      (void)guard;
+      tc.status = 1;
+    }
+
+    // add the thread's counts to the class. call with the lock held
+    static void add_counts(size_class &sc, thread_cache &tc, unsigned c) {
+      size_t mallocs = sc.num_mallocs += tc.num_mallocs[c];
+      size_t frees = sc.num_frees += tc.num_frees[c];
+      tc.num_mallocs[c] = tc.num_frees[c] = 0;
+      // another thread may have counted frees of blocks this one allocated first
+      if (mallocs > frees && mallocs - frees > sc.peak_blocks) sc.peak_blocks = mallocs - frees;
+    }
+
+    // a block from the shared list or the span. call with the lock held
+    static free_block *take(size_class &sc) {
+      free_block *b = sc.free_list;
+      if (b) {
+        sc.free_list = b->next;
+        return b;
+      }
+      if (sc.span_end - sc.span < (ptrdiff_t)sc.size) {
+        sc.span = (char*)system_malloc(span_bytes);
+        if (!sc.span) {
+          sc.span_end = 0;
+          return 0;
+        }
+        sc.span_end = sc.span + span_bytes;
+        sc.num_spans++;
+      }
+      b = (free_block*)sc.span;
+      sc.span += sc.size;
+      return b;
+    }
+
+    // move a batch of blocks from the shared class to the thread. returns the first
+    static free_block *refill(state_t &s, thread_cache &tc, unsigned c) {
+      size_class &sc = s.classes[c];
+      std::lock_guard<std::mutex> guard(sc.lock);
+      add_counts(sc, tc, c);
+      for (unsigned i = 0; i != sc.batch; ++i) {
+        free_block *b = take(sc);
+        if (!b) break;
+        b->next = tc.free_list[c];
+        tc.free_list[c] = b;
+        tc.num_free[c]++;
+      }
+      return tc.free_list[c];
+    }
+
+    // move num blocks from the thread to the shared class
+    static void give_back(state_t &s, thread_cache &tc, unsigned c, unsigned num) {
+      size_class &sc = s.classes[c];
+      std::lock_guard<std::mutex> guard(sc.lock);
+      add_counts(sc, tc, c);
+      for (unsigned i = 0; i != num; ++i) {
+        free_block *b = tc.free_list[c];
+        tc.free_list[c] = b->next;
+        b->next = sc.free_list;
+        sc.free_list = b;
+      }
+      tc.num_free[c] -= num;
+    }
+
+    static void *large_malloc(state_t &s, size_t size) {
+      void *res = system_malloc(size);
+      if (res) {
+        s.num_large_mallocs++;
+        size_t bytes = s.large_bytes += size;
+        if (bytes > s.peak_large_bytes) s.peak_large_bytes = bytes;
+      }
+      return res;
+    }
+
+    static void large_free(state_t &s, void *ptr, size_t size) {
+      s.num_large_frees++;
+      s.large_bytes -= size;
+      system_free(ptr);
+    }
+
+    static void *system_malloc(size_t size) {
+      #if OCTET_MAC || (OCTET_SSE && !defined(WIN32))
         void *res = 0;
-        posix_memalign(&res, 16, size);
+        if (posix_memalign(&res, 16, size)) res = 0;
       #elif OCTET_SSE
         void *res = ::_aligned_malloc(size, 16);
       #elif OCTET_VITA
@@ -74,35 +241,167 @@ namespace octet { namespace containers {
       #else
         void *res = ::malloc(size);
       #endif
-      //printf("malloc %p[%d] -> %d\n", res, size, state().num_bytes);
       return res;
     }
 
-    static void free(void *ptr, size_t size) {
-      state().num_bytes -= size;
-      //printf("free %p[%d] -> %d\n", ptr, size, state().num_bytes);
-      #if OCTET_MAC
-        return ::free(ptr);
+    static void system_free(void *ptr) {
+      #if OCTET_MAC || (OCTET_SSE && !defined(WIN32))
+        ::free(ptr);
       #elif OCTET_SSE
-        return ::_aligned_free(ptr);
+        ::_aligned_free(ptr);
       #else
-        return ::free(ptr);
+        ::free(ptr);
       #endif
     }
 
-    static void *realloc(void *ptr, size_t old_size, size_t size) {
-      state().num_bytes += size - old_size;
-      #if OCTET_MAC
-        void *res = ::realloc(ptr, size);
+    static void *system_realloc(void *ptr, size_t size) {
+      #if OCTET_MAC || (OCTET_SSE && !defined(WIN32))
+        // realloc keeps 16 byte alignment on mac and x86-64 linux
+        return ::realloc(ptr, size);
       #elif OCTET_SSE
-        void *res = ::_aligned_realloc(ptr, size, 16);
+        return ::_aligned_realloc(ptr, size, 16);
       #else
-        void *res = ::realloc(ptr, size);
+        return ::realloc(ptr, size);
+      #endif
+    }
+
+    static void report_at_exit() {
+      if (get_bytes_in_use()) {
+        printf("allocator: memory still in use at exit, including static objects\n");
+        dump_stats(stdout);
+      }
+    }
+
+  public:
+    static void *malloc(size_t size) {
+      state_t &s = state();
+      #ifndef OCTET_SYSTEM_MALLOC
+        if (size <= max_small) {
+          unsigned c = s.class_of[(size + 15) >> 4];
+          thread_cache &tc = cache();
+          if (tc.status != 1) {
+            if (tc.status == 0) {
+              start_cache(tc);
+            } else {
+              // this thread has ended and is freeing its thread_local objects
+              size_class &sc = s.classes[c];
+              std::lock_guard<std::mutex> guard(sc.lock);
+              sc.num_mallocs++;
+              return take(sc);
+            }
+          }
+          free_block *b = tc.free_list[c];
+          if (!b) {
+            b = refill(s, tc, c);
+            if (!b) return 0;
+          }
+          tc.free_list[c] = b->next;
+          tc.num_free[c]--;
+          tc.num_mallocs[c]++;
+          return b;
+        }
+      #endif
+      return large_malloc(s, size);
+    }
+
+    static void free(void *ptr, size_t size) {
+      if (!ptr) return;
+      state_t &s = state();
+      #ifndef OCTET_SYSTEM_MALLOC
+        if (size <= max_small) {
+          unsigned c = s.class_of[(size + 15) >> 4];
+          free_block *b = (free_block*)ptr;
+          thread_cache &tc = cache();
+          if (tc.status != 1) {
+            size_class &sc = s.classes[c];
+            std::lock_guard<std::mutex> guard(sc.lock);
+            sc.num_frees++;
+            b->next = sc.free_list;
+            sc.free_list = b;
+            return;
+          }
+          b->next = tc.free_list[c];
+          tc.free_list[c] = b;
+          tc.num_frees[c]++;
+          if (++tc.num_free[c] > s.classes[c].batch * 2) {
+            give_back(s, tc, c, s.classes[c].batch);
+          }
+          return;
+        }
+      #endif
+      large_free(s, ptr, size);
+    }
+
+    static void *realloc(void *ptr, size_t old_size, size_t size) {
+      if (!ptr) return malloc(size);
+      state_t &s = state();
+      #ifndef OCTET_SYSTEM_MALLOC
+        if (old_size <= max_small || size <= max_small) {
+          if (old_size <= max_small && size <= max_small && s.class_of[(old_size + 15) >> 4] == s.class_of[(size + 15) >> 4]) {
+            return ptr;
+          }
+          void *res = malloc(size);
+          if (res) {
+            memcpy(res, ptr, std::min(old_size, size));
+            free(ptr, old_size);
+          }
+          return res;
+        }
       #endif
-      //printf("realloc %p[%d] -> %p[%d] %d\n", ptr, old_size, res, size, state().num_bytes);
+      void *res = system_realloc(ptr, size);
+      if (res) {
+        size_t bytes = s.large_bytes += size - old_size;
+        if (bytes > s.peak_large_bytes) s.peak_large_bytes = bytes;
+      }
       return res;
     }
 
+    /// bytes in blocks that have been allocated and not freed, rounded up to the size classes.
+    /// other threads' recent calls may not be counted yet.
+    static size_t get_bytes_in_use() {
+      state_t &s = state();
+      size_t bytes = s.large_bytes;
+      for (unsigned c = 0; c != num_classes; ++c) {
+        size_class &sc = s.classes[c];
+        bytes += (sc.num_mallocs - sc.num_frees) * sc.size;
+      }
+      if (cache().status == 1) {
+        thread_cache &tc = cache();
+        for (unsigned c = 0; c != num_classes; ++c) {
+          bytes += (tc.num_mallocs[c] - tc.num_frees[c]) * s.classes[c].size;
+        }
+      }
+      return bytes;
+    }
+
+    /// write a table of the size classes in use.
+    static void dump_stats(FILE *file) {
+      state_t &s = state();
+      thread_cache &tc = cache();
+      fprintf(file, "%8s %10s %10s %10s %10s %8s\n", "size", "mallocs", "frees", "in use", "peak", "spans");
+      for (unsigned c = 0; c != num_classes; ++c) {
+        size_class &sc = s.classes[c];
+        size_t mallocs = sc.num_mallocs, frees = sc.num_frees;
+        if (tc.status == 1) {
+          mallocs += tc.num_mallocs[c];
+          frees += tc.num_frees[c];
+        }
+        if (mallocs) {
+          size_t in_use = mallocs > frees ? mallocs - frees : 0;
+          fprintf(
+            file, "%8u %10u %10u %10u %10u %8u\n", sc.size, (unsigned)mallocs, (unsigned)frees,
+            (unsigned)in_use, (unsigned)std::max((size_t)sc.peak_blocks, in_use), (unsigned)sc.num_spans
+          );
+        }
+      }
+      if (s.num_large_mallocs) {
+        fprintf(
+          file, "%8s %10u %10u %9uk %9uk\n", "large", (unsigned)s.num_large_mallocs, (unsigned)s.num_large_frees,
+          (unsigned)(s.large_bytes / 1024), (unsigned)(s.peak_large_bytes / 1024)
+        );
+      }
+    }
+
     // crude check of stack integrity
     static void test(const char *label) {
       printf("test %s\n", label);
@@ -111,4 +410,3 @@ namespace octet { namespace containers {
     }
   };
 } }
-
@@ -26,6 +26,7 @@
 #define OCTET_CONTAINERS_INCLUDED
 
 #include "../containers/allocator.h"
+#include "../containers/frame_allocator.h"
 #include "../containers/dictionary.h"
 #include "../containers/hash_map.h"
 #include "../containers/double_list.h"
@@ -26,18 +26,19 @@ namespace octet { namespace containers {
   /// 
   template <class item, class allocator_t=allocator> class double_list {
     struct double_list_head {
-      // this makes new and delete use the allocator
-      void *operator new(size_t size) {
-        return allocator_t::malloc(size);
-      }
-      void operator delete(void *ptr, size_t size) {
-        return allocator_t::free(ptr, size);
-      }
       double_list_head *next;
       double_list_head *prev;
     };
 
     struct double_list_node : double_list_head {
+      // this makes new and delete use the allocator.
+      // only nodes are allocated, so the size freed is always the size allocated.
+      void *operator new(size_t size) {
+        return allocator_t::malloc(size);
+      }
+      void operator delete(void *ptr) {
+        return allocator_t::free(ptr, sizeof(double_list_node));
+      }
       item item_;
       double_list_node(const item &new_item) { item_ = new_item; }
     };
@@ -7,6 +7,27 @@
 
 
 namespace octet { namespace containers {
+  /// Types that can be moved to a new address with memcpy, leaving nothing behind to destroy.
+  /// dynarray uses this to grow, insert and erase without calling constructors.
+  /// Classes that are just a pointer, like ref and string, specialise it.
+  template <class item_t> struct is_trivially_relocatable :
+    std::integral_constant<bool, std::is_trivially_copyable<item_t>::value>
+  {
+  };
+
+  /// storage for the first few elements of a small_dynarray
+  template <class item_t, unsigned inline_capacity> class dynarray_inline_buffer {
+    typename std::aligned_storage<sizeof(item_t) * inline_capacity, std::alignment_of<item_t>::value>::type bytes;
+  protected:
+    item_t *inline_data() const { return (item_t*)&bytes; }
+  };
+
+  /// ordinary dynarrays have no inline buffer and take no extra space
+  template <class item_t> class dynarray_inline_buffer<item_t, 0> {
+  protected:
+    item_t *inline_data() const { return 0; }
+  };
+
   /// Dynamic array class similar to std::vector.
   ///
   /// Example
@@ -24,7 +45,15 @@ namespace octet { namespace containers {
   ///     dynarray<int> ints;          // ok. int is well-behaved.
   ///     dynarray<mesh> meshes;       // bad! mesh contains other arrays.
   ///     dynarray<ref<mesh> > meshes; // ok. managed pointers to meshes.
-  template <class item_t, class allocator_t=allocator, bool use_new_delete=true> class dynarray {
+  ///
+  /// Elements are moved, not copied, when the array grows. Types that are
+  /// is_trivially_relocatable (including ref and string) are moved with memcpy.
+  ///
+  /// The first inline_capacity elements are kept inside the array itself,
+  /// see small_dynarray.
+  template <class item_t, class allocator_t=allocator, bool use_new_delete=true, unsigned inline_capacity=0> class dynarray :
+    dynarray_inline_buffer<item_t, inline_capacity>
+  {
     item_t *data_;
     typedef unsigned int_size_t;
 
@@ -33,18 +62,69 @@ namespace octet { namespace containers {
     int_size_t capacity_;
     enum { min_capacity = 8 };
 
+    enum { relocate_with_memcpy = !use_new_delete || is_trivially_relocatable<item_t>::value };
+
+    bool is_inline() const {
+      return inline_capacity && data_ == this->inline_data();
+    }
+
+    // memory for new_capacity items, the inline buffer if they fit
+    item_t *allocate(int_size_t new_capacity) {
+      if (new_capacity <= inline_capacity) return this->inline_data();
+      return (item_t*)allocator_t::malloc(sizeof(item_t) * new_capacity);
+    }
+
+    void deallocate(item_t *ptr, int_size_t capacity) {
+      if (ptr && ptr != this->inline_data()) {
+        allocator_t::free(ptr, capacity * sizeof(item_t));
+      }
+    }
+
+    // move num items to uninitialized memory, leaving nothing to destroy at src
+    static void relocate(item_t *dest, item_t *src, int_size_t num) {
+      if (relocate_with_memcpy) {
+        if (num) memcpy((void*)dest, (const void*)src, num * sizeof(item_t));
+      } else {
+        dynarray_dummy_t x;
+        for (int_size_t i = 0; i != num; ++i) {
+          new (dest + i, x) item_t(std::move(src[i]));
+          src[i].~item_t();
+        }
+      }
+    }
+
+    // capacity for one more item: round up to a power of two
+    int_size_t next_capacity() const {
+      return capacity_ < (int_size_t)min_capacity ? (int_size_t)min_capacity : capacity_ * 2;
+    }
+
+    // take the contents of rhs, which is left empty. this array must be empty and unallocated.
+    void take(dynarray &rhs) {
+      if (rhs.is_inline()) {
+        relocate(data_, rhs.data_, rhs.size_);
+      } else {
+        data_ = rhs.data_;
+        capacity_ = rhs.capacity_;
+      }
+      size_ = rhs.size_;
+      rhs.data_ = rhs.inline_data();
+      rhs.size_ = 0;
+      rhs.capacity_ = inline_capacity;
+    }
+
   public:
     /// Create a new, empty, dynamic array
     dynarray() {
-      data_ = 0;
+      data_ = this->inline_data();
       size_ = 0;
-      capacity_ = 0;
+      capacity_ = inline_capacity;
     }
 
     /// Create a new dynamic array of a certain size.
     dynarray(int_size_t size) {
-      data_ = (item_t*)allocator::malloc(size * sizeof(item_t));
-      size_ = capacity_ = size;
+      data_ = allocate(size);
+      size_ = size;
+      capacity_ = size < inline_capacity ? inline_capacity : size;
       if (use_new_delete) {
         dynarray_dummy_t x;
         for (int_size_t i = 0; i != size; ++i) {
@@ -57,18 +137,47 @@ namespace octet { namespace containers {
     ///
     /// Note: this is very slow and will happen frequently in naive code.
     dynarray(const dynarray &rhs) {
-      data_ = (item_t*)allocator::malloc(rhs.size_ * sizeof(item_t));
-      size_ = capacity_ = rhs.size_;
+      data_ = allocate(rhs.size_);
+      size_ = rhs.size_;
+      capacity_ = size_ < inline_capacity ? inline_capacity : size_;
       if (use_new_delete) {
         dynarray_dummy_t x;
         for (int_size_t i = 0; i != size_; ++i) {
           new (data_ + i, x)item_t(rhs.data_[i]);
         }
       } else {
-        memcpy(data_, rhs.data_, rhs.size_ * sizeof(item_t));
+        memcpy((void*)data_, (const void*)rhs.data_, rhs.size_ * sizeof(item_t));
       }
     }
 
+    /// Take the contents of a temporary array without copying them.
+    dynarray(dynarray &&rhs) {
+      data_ = this->inline_data();
+      capacity_ = inline_capacity;
+      take(rhs);
+    }
+
+    /// Replace the contents with a copy of another array.
+    dynarray &operator=(const dynarray &rhs) {
+      if (this != &rhs) {
+        resize(0);
+        if (capacity_ < rhs.size_) reserve(rhs.size_);
+        for (int_size_t i = 0; i != rhs.size_; ++i) {
+          emplace_back(rhs.data_[i]);
+        }
+      }
+      return *this;
+    }
+
+    /// Replace the contents with those of a temporary array.
+    dynarray &operator=(dynarray &&rhs) {
+      if (this != &rhs) {
+        reset();
+        take(rhs);
+      }
+      return *this;
+    }
+
     /// Destroy the array and its contents.
     ~dynarray() {
       reset();
@@ -108,37 +217,66 @@ namespace octet { namespace containers {
   
     /// iterator insert for STL compatibility
     iterator insert(iterator it, const item_t &new_item) {
-      int_size_t old_length = size_;
-      resize(size_+1);
-      for (int_size_t i = old_length; i != it.elem; --i) {
-        data_[i] = data_[i-1];
+      emplace_back(new_item);
+      if (relocate_with_memcpy) {
+        // move the new item's bytes aside and slide the others up
+        typename std::aligned_storage<sizeof(item_t), std::alignment_of<item_t>::value>::type tmp;
+        memcpy((void*)&tmp, (const void*)(data_ + size_ - 1), sizeof(item_t));
+        memmove((void*)(data_ + it.elem + 1), (const void*)(data_ + it.elem), (size_ - 1 - it.elem) * sizeof(item_t));
+        memcpy((void*)(data_ + it.elem), (const void*)&tmp, sizeof(item_t));
+      } else {
+        std::rotate(data_ + it.elem, data_ + size_ - 1, data_ + size_);
       }
-      data_[it.elem] = new_item;
       return it;
     }
 
     /// iterator erase for STL compatibility
     iterator erase(iterator it) {
-      for (int_size_t i = it.elem; i < size_-1; ++i) {
-        data_[i] = data_[i+1];
-      }
-      resize(size_-1);
+      erase(it.elem);
       return it;
     }
   
     /// Erase an item; move subsequent items down to fill the gap.
     void erase(unsigned elem) {
-      for (int_size_t i = elem; i < size_-1; ++i) {
-        data_[i] = data_[i+1];
+      if (relocate_with_memcpy) {
+        if (use_new_delete) data_[elem].~item_t();
+        memmove((void*)(data_ + elem), (const void*)(data_ + elem + 1), (size_ - 1 - elem) * sizeof(item_t));
+        size_--;
+      } else {
+        std::move(data_ + elem + 1, data_ + size_, data_ + elem);
+        resize(size_-1);
       }
-      resize(size_-1);
     }
 
     /// Add an item at the back of the array.
     void push_back(const item_t &new_item) {
-      int_size_t old_length = size_;
-      resize(size_+1);
-      data_[old_length] = new_item;
+      emplace_back(new_item);
+    }
+
+    /// Move an item to the back of the array.
+    void push_back(item_t &&new_item) {
+      emplace_back(std::move(new_item));
+    }
+
+    /// Construct an item at the back of the array from the constructor arguments.
+    ///
+    ///     dynarray<string> names;
+    ///     names.emplace_back("fred");
+    template <class... args_t> item_t &emplace_back(args_t&&... args) {
+      dynarray_dummy_t x;
+      if (size_ == capacity_) {
+        // build the new item before moving the others, the arguments may refer to them.
+        int_size_t new_capacity = next_capacity();
+        item_t *new_data = allocate(new_capacity);
+        new (new_data + size_, x) item_t(std::forward<args_t>(args)...);
+        relocate(new_data, data_, size_);
+        deallocate(data_, capacity_);
+        data_ = new_data;
+        capacity_ = new_capacity;
+      } else {
+        new (data_ + size_, x) item_t(std::forward<args_t>(args)...);
+      }
+      return data_[size_++];
     }
 
     /// Get the last element in the array.
@@ -190,7 +328,7 @@ namespace octet { namespace containers {
 
         if (new_length == size_ + 1) {
           // growing array by 1: round up to power of two.
-          new_capacity = capacity_ == 0 ? min_capacity : capacity_ * 2;
+          new_capacity = next_capacity();
           while (new_capacity < new_length) new_capacity *= 2;
         }
 
@@ -223,24 +361,15 @@ namespace octet { namespace containers {
     /// Use this before you start a loop with push_back calls, for example.
     void reserve(int_size_t new_capacity) {
       if (new_capacity >= size_) {
-        dynarray_dummy_t x;
-        item_t *new_data = (item_t *)allocator_t::malloc(sizeof(item_t) * new_capacity);
-      
-        if (use_new_delete) {
-          // initialize new data_ elements from old ones
-          for (int_size_t i = 0; i != size_; ++i) {
-            new (new_data + i, x) item_t(data_[i]);
-            data_[i].~item_t();
-          }
-        }
+        item_t *new_data = allocate(new_capacity);
+        if (new_data == data_) return; // still fits in the inline buffer
 
-        // free up data_
-        if (data_) {
-          allocator_t::free(data_, capacity_ * sizeof(item_t));
-        }
+        // move the elements to the new memory and free up data_
+        relocate(new_data, data_, size_);
+        deallocate(data_, capacity_);
 
         data_ = new_data;
-        capacity_ = new_capacity;
+        capacity_ = new_capacity < inline_capacity ? inline_capacity : new_capacity;
       }
     }
 
@@ -248,6 +377,9 @@ namespace octet { namespace containers {
     void pop_back() {
       assert(size_ != 0);
       size_--;
+      if (use_new_delete) {
+        data_[size_].~item_t();
+      }
     }
 
     /// Reset the array to zero size, freeing up the data.
@@ -258,15 +390,26 @@ namespace octet { namespace containers {
           data_[i].~item_t();
         }
       }
-      if (data_) {
-        allocator_t::free(data_, capacity_ * sizeof(item_t));
-      }
-      data_ = 0;
+      deallocate(data_, capacity_);
+      data_ = this->inline_data();
       size_ = 0;
-      capacity_ = 0;
+      capacity_ = inline_capacity;
     }
   };
 
+  /// A dynarray that keeps up to inline_capacity elements inside itself and only
+  /// allocates memory when it grows beyond them. Use it for arrays that usually
+  /// hold a handful of items.
+  ///
+  ///     small_dynarray<ref<scene_node>, 2> children;  // no allocation for up to two children
+  template <class item_t, unsigned inline_capacity, class allocator_t=allocator>
+  using small_dynarray = dynarray<item_t, allocator_t, true, inline_capacity>;
+
+  /// a dynarray is just a pointer and two sizes, unless it has an inline buffer.
+  template <class item_t, class allocator_t, bool use_new_delete>
+  struct is_trivially_relocatable<dynarray<item_t, allocator_t, use_new_delete, 0> > : std::true_type {
+  };
+
   inline void vformat(dynarray <char> &ary, const char *fmt, va_list v) {
     unsigned old_size = ary.size();
     #ifdef WIN32
@@ -0,0 +1,229 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// per-frame arena allocators
+//
+// Temporary arrays built while drawing a frame can take their memory from an arena instead
+// of the heap. Each allocation just moves a pointer along one big block, free() does nothing
+// and the whole arena is emptied in one go at the end of the frame.
+//
+//     dynarray<vec3p, frame_allocator> vertices;        // gone after this frame
+//     dynarray<edge, two_frame_allocator> edges;        // still valid during the next frame
+//
+// The app calls frame_allocator::end_frame() after draw_world. Keep no pointers to arena
+// memory past the end of the frame (or the next frame for two_frame_allocator) and don't
+// hold arena arrays in objects that outlive the frame.
+//
+// If a frame needs more than the arena holds, the extra blocks come from the heap and
+// the arena grows (up to max_capacity) at the end of the frame, so after the first few
+// frames there are no heap calls at all.
+//
+
+namespace octet { namespace containers {
+  /// One bump-pointer arena, used by frame_allocator and two_frame_allocator.
+  class frame_arena {
+  public:
+    enum {
+      alignment = 16,
+      default_capacity = 256 * 1024,
+      max_capacity = 16 * 1024 * 1024,   // bigger frames (eg. loading) keep using the heap
+    };
+
+  private:
+    // a block from the heap used when the arena is full
+    struct overflow_block {
+      overflow_block *next;
+      size_t size;
+      size_t pad[2];                        // keep the user data 16 byte aligned
+    };
+
+    char *base;
+    size_t capacity;
+    std::atomic<size_t> used;               // may go past capacity; the excess is in overflow blocks
+
+    std::mutex lock;
+    overflow_block *overflow;
+
+    // statistics
+    size_t high_water;                      // most bytes asked for in one frame
+    size_t num_overflows;                   // blocks that did not fit, since the start
+    size_t num_frames;
+
+  public:
+    frame_arena(size_t capacity_ = default_capacity) : used(0) {
+      capacity = capacity_;
+      base = (char*)allocator::malloc(capacity);
+      overflow = 0;
+      high_water = 0;
+      num_overflows = 0;
+      num_frames = 0;
+    }
+
+    /// allocate size bytes that live until the next reset(). safe to call from any thread.
+    void *malloc(size_t size) {
+      size = (size + alignment - 1) & ~(size_t)(alignment - 1);
+      size_t offset = used.fetch_add(size);
+      if (offset + size <= capacity) {
+        return base + offset;
+      }
+
+      std::lock_guard<std::mutex> guard(lock);
+      overflow_block *b = (overflow_block*)allocator::malloc(sizeof(overflow_block) + size);
+      if (!b) return 0;
+      b->next = overflow;
+      b->size = size;
+      overflow = b;
+      num_overflows++;
+      return b + 1;
+    }
+
+    /// there is nothing to free, but a new block is needed if it gets bigger.
+    void *realloc(void *ptr, size_t old_size, size_t size) {
+      if (ptr && size <= old_size) return ptr;
+      void *res = malloc(size);
+      if (res && ptr) memcpy(res, ptr, old_size);
+      return res;
+    }
+
+    /// empty the arena. nothing may be using it while this is called.
+    void reset() {
+      size_t demand = used;
+      if (demand > high_water) high_water = demand;
+
+      while (overflow) {
+        overflow_block *b = overflow;
+        overflow = b->next;
+        allocator::free(b, sizeof(overflow_block) + b->size);
+      }
+
+      if (demand > capacity && capacity < max_capacity) {
+        // grow to fit this frame's demand so the next one stays off the heap
+        size_t new_capacity = capacity ? capacity : (size_t)default_capacity;
+        while (new_capacity < demand && new_capacity < max_capacity) new_capacity *= 2;
+        allocator::free(base, capacity);
+        base = (char*)allocator::malloc(new_capacity);
+        capacity = base ? new_capacity : 0;
+      }
+
+      used = 0;
+      num_frames++;
+    }
+
+    /// bytes allocated since the last reset
+    size_t get_bytes_used() const {
+      return used;
+    }
+
+    /// bytes that fit without using the heap
+    size_t get_capacity() const {
+      return capacity;
+    }
+
+    /// most bytes used between two resets
+    size_t get_high_water() const {
+      return std::max(high_water, (size_t)used);
+    }
+
+    /// number of allocations that had to go to the heap
+    size_t get_num_overflows() const {
+      return num_overflows;
+    }
+
+    /// write one line of statistics
+    void dump_stats(FILE *file, const char *name) const {
+      fprintf(
+        file, "%-12s %9uk capacity %9uk used %9uk high water %8u overflows %8u frames\n", name,
+        (unsigned)(capacity / 1024), (unsigned)(get_bytes_used() / 1024), (unsigned)(get_high_water() / 1024),
+        (unsigned)num_overflows, (unsigned)num_frames
+      );
+    }
+  };
+
+  /// Allocator for data that must last until the end of the next frame.
+  /// Two arenas take turns: each end_frame() empties the one filled two frames ago.
+  class two_frame_allocator {
+    struct state_t {
+      frame_arena arenas[2];
+      std::atomic<unsigned> current;
+
+      state_t() : current(0) {
+      }
+    };
+
+    static state_t &state() {
+      // never destroyed, like the heap allocator's state
+      static state_t *instance = new state_t();
+      return *instance;
+    }
+
+  public:
+    static void *malloc(size_t size) {
+      state_t &s = state();
+      return s.arenas[s.current].malloc(size);
+    }
+
+    static void free(void *ptr, size_t size) {
+    }
+
+    static void *realloc(void *ptr, size_t old_size, size_t size) {
+      state_t &s = state();
+      return s.arenas[s.current].realloc(ptr, old_size, size);
+    }
+
+    /// switch arenas, emptying the one that was used two frames ago.
+    static void end_frame() {
+      state_t &s = state();
+      unsigned next = s.current ^ 1;
+      s.arenas[next].reset();
+      s.current = next;
+    }
+
+    /// the arena for this frame (0) or the last one (1)
+    static frame_arena &get_arena(unsigned frames_ago = 0) {
+      state_t &s = state();
+      return s.arenas[s.current ^ (frames_ago & 1)];
+    }
+  };
+
+  /// Allocator for data that is thrown away at the end of the frame.
+  /// Use it as the allocator_t of dynarray or hash_map.
+  class frame_allocator {
+    static frame_arena &arena() {
+      static frame_arena *instance = new frame_arena();
+      return *instance;
+    }
+
+  public:
+    static void *malloc(size_t size) {
+      return arena().malloc(size);
+    }
+
+    static void free(void *ptr, size_t size) {
+    }
+
+    static void *realloc(void *ptr, size_t old_size, size_t size) {
+      return arena().realloc(ptr, old_size, size);
+    }
+
+    /// empty the frame arena and switch the two frame arenas.
+    /// called by the app after draw_world; no other thread may be allocating.
+    static void end_frame() {
+      arena().reset();
+      two_frame_allocator::end_frame();
+    }
+
+    static frame_arena &get_arena() {
+      return arena();
+    }
+
+    /// write the arena statistics
+    static void dump_stats(FILE *file) {
+      arena().dump_stats(file, "frame");
+      two_frame_allocator::get_arena(0).dump_stats(file, "two frame 0");
+      two_frame_allocator::get_arena(1).dump_stats(file, "two frame 1");
+    }
+  };
+} }
@@ -46,6 +46,12 @@ namespace octet { namespace containers {
       if (item) item->add_ref();
     }
 
+    /// move constructor - takes the object from a temporary without touching the count.
+    ref(ref &&rhs) {
+      item = rhs.item;
+      rhs.item = 0;
+    }
+
     /// initialize with new item - pointer then "owns" object
     ref(item_t *new_item) {
       if (new_item) new_item->add_ref();
@@ -61,6 +67,16 @@ namespace octet { namespace containers {
       return rhs;
     }
 
+    /// take the item from a temporary - frees any old object
+    ref &operator=(ref &&rhs) {
+      if (this != &rhs) {
+        if (item) item->release();
+        item = rhs.item;
+        rhs.item = 0;
+      }
+      return *this;
+    }
+
     /// replace item with new one - frees any old object
     item_t *operator=(item_t *new_item) {
       if (new_item) new_item->add_ref();
@@ -90,4 +106,8 @@ namespace octet { namespace containers {
       item = 0;
     }
   };
+
+  /// a ref is just a pointer, so dynarrays can move it with memcpy.
+  template <class item_t, class allocator_t> struct is_trivially_relocatable<ref<item_t, allocator_t> > : std::true_type {
+  };
 } }
@@ -23,16 +23,30 @@ namespace octet { namespace containers {
   ///
   class string {
     char *data_;
+    unsigned capacity_; // bytes allocated for data_, which may hold more than strlen()+1
 
     static char *null_string() { static char c; return &c; }
 
     void release() {
       if (data_ != null_string()) {
-        allocator::free((void*)data_, size() + 1);
+        allocator::free((void*)data_, capacity_);
         data_ = null_string();
+        capacity_ = 0;
       }
     }
 
+    // the allocator must be given back the size it handed out, so remember it.
+    char *allocate(size_t bytes) {
+      capacity_ = (unsigned)bytes;
+      return data_ = (char*)allocator::malloc(bytes);
+    }
+
+    char *reallocate(size_t bytes) {
+      data_ = (char*)allocator::realloc(data_, capacity_, bytes);
+      capacity_ = (unsigned)bytes;
+      return data_;
+    }
+
     // When dealing with windows or java, we will come across the less popular
     // utf16 encoding scheme. All other sources of text will likely be in UTF8, ANSI or shift-JIS
     // We use UTF8 internally as it is compact and popular.
@@ -145,19 +159,22 @@ namespace octet { namespace containers {
     }
   public:
     /// Default constructor: empty string.
-    string() { data_ = null_string(); }
+    string() { data_ = null_string(); capacity_ = 0; }
 
     /// Copy a UTF8 C string
-    string(const char *value) { data_ = null_string(); *this = value; }
+    string(const char *value) { data_ = null_string(); capacity_ = 0; *this = value; }
     
     /// Copy of a UFT16 C string
-    string(const wchar_t *value) { data_ = null_string(); *this = value; }
+    string(const wchar_t *value) { data_ = null_string(); capacity_ = 0; *this = value; }
     
     /// Copy of another string
-    string(const string& rhs) { data_ = null_string(); *this = rhs.c_str(); }
+    string(const string& rhs) { data_ = null_string(); capacity_ = 0; *this = rhs.c_str(); }
+
+    /// Take the text of a temporary string
+    string(string &&rhs) { data_ = rhs.data_; capacity_ = rhs.capacity_; rhs.data_ = null_string(); rhs.capacity_ = 0; }
     
     /// Copy of a substring
-    string(const char *value, unsigned size) { data_ = null_string(); set(value, size); }
+    string(const char *value, unsigned size) { data_ = null_string(); capacity_ = 0; set(value, size); }
 
     /// Free up memory used by the string.
     ~string() { release(); }
@@ -190,11 +207,11 @@ namespace octet { namespace containers {
         size_t cur_len = strlen(data_);
         int len = _vscprintf(fmt, v);
         if (len) {
-          if (cur_len) {
-            data_ = (char*)allocator::realloc(data_, cur_len+1, cur_len + len + 1);
+          if (data_ != null_string()) {
+            reallocate(cur_len + len + 1);
             vsprintf_s(data_ + cur_len, len+1, fmt, v);
           } else {
-            data_ = (char*)allocator::malloc(len+1);
+            allocate(len+1);
             vsprintf_s(data_, len+1, fmt, v);
           }
         }
@@ -211,7 +228,7 @@ namespace octet { namespace containers {
       if (value) {
         unsigned size = urldecode_impl(0, value);
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          allocate(size+1);
           urldecode_impl(data_, value);
         }
       }
@@ -224,7 +241,7 @@ namespace octet { namespace containers {
       if (value) {
         unsigned size = urlencode_impl(0, value);
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          allocate(size+1);
           urlencode_impl(data_, value);
         }
       }
@@ -237,7 +254,7 @@ namespace octet { namespace containers {
       if (value) {
         size_t size = strlen(value);
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          allocate(size+1);
           memcpy((char*)data_, value, size+1);
         }
       }
@@ -250,7 +267,7 @@ namespace octet { namespace containers {
       if (value) {
         unsigned size = utf16_to_utf8(0, value);
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          allocate(size+1);
           utf16_to_utf8(data_, value);
         }
       }
@@ -258,14 +275,26 @@ namespace octet { namespace containers {
     }
 
     /// copy another string
-    string &operator=(const string& rhs) { data_ = null_string(); *this = rhs.c_str(); return *this; }
+    string &operator=(const string& rhs) { if (this != &rhs) *this = rhs.c_str(); return *this; }
+
+    /// take the text of a temporary string
+    string &operator=(string &&rhs) {
+      if (this != &rhs) {
+        release();
+        data_ = rhs.data_;
+        capacity_ = rhs.capacity_;
+        rhs.data_ = null_string();
+        rhs.capacity_ = 0;
+      }
+      return *this;
+    }
 
     /// copy a substring
     string &set(const char *value, unsigned size) {
       release();
       if (value) {
         if (size) {
-          data_ = (char*)allocator::malloc(size+1);
+          allocate(size+1);
           memcpy((char*)data_, value, size);
           data_[size] = 0;
         }
@@ -278,9 +307,9 @@ namespace octet { namespace containers {
       int size = (int)strlen(data_);
       if (new_len < size) {
         if (data_ == null_string()) {
-          data_ = (char*)allocator::malloc(new_len+1);
+          allocate(new_len+1);
         } else {
-          data_ = (char*)allocator::realloc((void*)data_, size+1, new_len+1);
+          reallocate(new_len+1);
         }
         data_[new_len] = 0;
       }
@@ -302,9 +331,9 @@ namespace octet { namespace containers {
         size_t data_size = strlen(data_);
         size_t rhs_size = strlen(rhs);
         if (data_ == null_string()) {
-          data_ = (char*)allocator::malloc(data_size+rhs_size+1);
+          allocate(data_size+rhs_size+1);
         } else {
-          data_ = (char*)allocator::realloc(data_, data_size + 1, data_size+rhs_size+1);
+          reallocate(data_size+rhs_size+1);
         }
         memcpy(data_ + data_size, rhs, rhs_size+1);
       }
@@ -316,12 +345,14 @@ namespace octet { namespace containers {
       if (rhs) {
         size_t data_size = strlen(data_);
         size_t rhs_size = strlen(rhs);
-        char *new_data = (char*)allocator::malloc(data_size+rhs_size+1);
+        size_t new_capacity = data_size+rhs_size+1;
+        char *new_data = (char*)allocator::malloc(new_capacity);
         memcpy(new_data, data_, pos);
         memcpy(new_data + pos, rhs, rhs_size);
         memcpy(new_data + pos + rhs_size, data_, data_size - pos + 1);
         release();
         data_ = new_data;
+        capacity_ = (unsigned)new_capacity;
       }
       return *this;
     }
@@ -388,19 +419,17 @@ namespace octet { namespace containers {
     ///     string my_csv = "100,fred,bert,harry";
     ///     my_csv.split(parts, ",")
     ///     // parts now contains four strings: "100", "fred", "bert", "harry"
-    void split(dynarray<string> &result, const char *delimiter) {
+    template <class allocator_t> void split(dynarray<string, allocator_t> &result, const char *delimiter) {
       result.resize(0);
       char *cur = data_;
       unsigned delim_len = (unsigned)strlen(delimiter);
       for(;;) {
         char *next = strstr(cur, delimiter);
         if (!next) break;
-        result.push_back(string());
-        result.back().set(cur, (int)(next - cur));
+        result.emplace_back(cur, (unsigned)(next - cur));
         cur = next + delim_len;
       }
-      result.push_back(string());
-      result.back() = cur;
+      result.emplace_back(cur);
     }
 
     /// return true if the string is empty.
@@ -408,4 +437,8 @@ namespace octet { namespace containers {
       return size() == 0;
     }
   };
+
+  /// a string is just a pointer to its text, so dynarrays can move it with memcpy.
+  template <> struct is_trivially_relocatable<string> : std::true_type {
+  };
 } }
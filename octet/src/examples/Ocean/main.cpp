@@ -10,7 +10,21 @@
 #include "AntTweakBar\AntTweakBar.h"
 #include "../../octet.h"
 
+#include "wave_thread_pool.h"
+#include "wave_clock.h"
+#include "wave_kernel.h"
+#include "wave_phase_cache.h"
+#include "wave_refresh.h"
+#include "wave_gpu.h"
+#include "wave_stream.h"
+#include "wave_fft.h"
+#include "wave_vertex.h"
+#include "wave_clipmap.h"
+#include "wave_frustum.h"
 #include "wave_mesh.h"
+#include "wave_governor.h"
+#include "wave_buoyancy.h"
+#include "wave_bake.h"
 #include "water_simulation.h"
 
 /// Create a box with octet
@@ -5,6 +5,7 @@
 // Modular Framework for OpenGLES2 rendering on multiple platforms.
 //
 #include <math.h>
+#include <chrono>
 
 #ifndef WATER_SIMULATION_H_INCLUDED
 #define WATER_SIMULATION_H_INCLUDED
@@ -19,6 +20,12 @@ namespace octet {
     ref<wave_mesh> wave_geometry;
     ref<camera_instance> camera;
 
+    //real time between frames drives the waves and the physics
+    std::chrono::steady_clock::time_point last_frame;
+
+    //trades the ocean's detail for time when frames run long
+    wave_governor governor;
+
     TwBar* tweakBar;
     typedef enum { COMPLEX, SPIRO1, SPIRO2 } FunctionsType;
 
@@ -79,9 +86,15 @@ namespace octet {
       int vx = 0, vy = 0;
       get_viewport_size(vx, vy);
 
-      //create our wave geometry object
+      //create our wave geometry object, rings of grids that follow the camera out to the horizon
       wave_geometry = new wave_mesh();
+      wave_geometry->set_clipmap(true);
+      wave_geometry->set_phase_cache(true);
+      wave_geometry->set_wave_culling(4.0f);
+      wave_geometry->get_clock().set_mode(wave_clock::variable_step);
       wave_geometry->init(app_scene);
+      governor.attach(wave_geometry);
+      last_frame = std::chrono::steady_clock::now();
 
       create_skybox();
 
@@ -104,14 +117,27 @@ namespace octet {
       app_scene->begin_render(vx, vy);
       TwWindowSize(vx, vy);
 
-      //update the geometry
-      wave_geometry->update();
+      //update the geometry around the camera, skipping the tiles it can't see.
+      //render() sets up the camera matrices too, but we need them before then.
+      camera->set_cameraToWorld(camera->get_node()->calcModelToWorld(), (float)vx / vy);
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      double dt = std::chrono::duration<double>(now - last_frame).count();
+      last_frame = now;
+      wave_geometry->set_camera(camera, vy);
+      wave_geometry->update(dt);
+      std::chrono::steady_clock::time_point updated = std::chrono::steady_clock::now();
 
-      // update matrices. assume 30 fps.
-      app_scene->update(1.0f / 30);
+      // update matrices
+      app_scene->update((float)std::min(dt, 0.25));
       // draw the scene
       app_scene->render((float)vx / vy);
 
+      std::chrono::steady_clock::time_point rendered = std::chrono::steady_clock::now();
+      governor.frame_done(
+        std::chrono::duration<double, std::milli>(updated - now).count(),
+        std::chrono::duration<double, std::milli>(rendered - updated).count()
+      );
+
       //keep this out of the way -> updates the inputs and the UI
       mat4t &camera = app_scene->get_camera_instance(0)->get_node()->access_nodeToParent();
       keyboard_inputs();
@@ -171,6 +197,10 @@ namespace octet {
       if (is_key_going_down('8')){
         wave_geometry->wireframe_mode_off();
       }
+      //swap between the Gerstner waves and the FFT ocean
+      if (is_key_going_down('E')){
+        wave_geometry->toggle_engine();
+      }
 
       if (is_key_down(key_esc)){
         exit(0);
@@ -0,0 +1,401 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Baking a loop of the ocean to a file, and playing it back.
+//
+// wave_baker runs a headless wave_mesh (compact vertices, fixed grid, Gerstner waves) over one loop
+// and writes every frame's vertices to disk as they are. The loop is either
+//
+//   a common period of the waves   a time at which every wave is back where it started to within
+//                                  a tolerance, found by trying whole periods of the slowest wave,
+//                                  with the frame time nudged so the loop is a whole number of frames.
+//   a loop length of our choosing  when there is no common period short enough. The last frames are
+//                                  cross-faded into the frames before the start so the loop has no seam.
+//
+// The work of each frame is shared between the mesh's worker threads as it is for drawing.
+//
+// The file is
+//
+//   wave_bake_header
+//   wave_bake_wave[num_waves]           the waves it was baked from
+//   uint32_t[num_indices]               the triangles, the same for every frame
+//   frames                              each num_vertices compact_vertex, starting on a page boundary
+//
+// wave_bake_player maps the file and hands each frame's pages straight to glBufferSubData, so playing
+// back costs no wave maths and no copy of our own.
+//
+
+#ifndef WAVE_BAKE_H_INCLUDED
+#define WAVE_BAKE_H_INCLUDED
+
+namespace octet {
+
+  /// the start of a baked ocean file
+  struct wave_bake_header {
+    enum { current_version = 1, page_size = 4096 };
+
+    char magic[4];              // "OCNB"
+    uint32_t version;
+    uint32_t grid_size;         // vertices along each side of the grid
+    uint32_t num_vertices;      // in each frame
+    uint32_t num_indices;
+    uint32_t num_frames;        // in the loop
+    uint32_t crossfade_frames;  // at the end of the loop blended into its start, 0 for a common period
+    uint32_t num_waves;
+    float frame_seconds;
+    float colour[3];
+    compact_scale packing;      // the same for every frame
+    uint64_t waves_offset;      // bytes from the start of the file
+    uint64_t indices_offset;
+    uint64_t frames_offset;
+    uint64_t frame_stride;      // bytes from one frame to the next
+  };
+
+  /// the parameters of one wave of a baked ocean
+  struct wave_bake_wave {
+    float amplitude;
+    float speed;
+    float frequency;
+    float steepness;
+    float direction_x, direction_y;
+    float weight;               // how much of it was added in (see wave_mesh::set_active_waves)
+  };
+
+  class wave_baker {
+    ref<wave_mesh> ocean;
+    float frame_seconds;
+    float max_period;           // longest common period looked for
+    float tolerance;            // radians a wave may be out by at the end of a common period
+    float loop_seconds;         // otherwise
+    float crossfade_seconds;
+    const char *error;
+
+    static uint64_t round_to_page(uint64_t bytes) {
+      return (bytes + wave_bake_header::page_size - 1) & ~(uint64_t)(wave_bake_header::page_size - 1);
+    }
+
+    static bool pad(FILE *file, uint64_t from, uint64_t to) {
+      static const uint8_t zeros[wave_bake_header::page_size] = { 0 };
+      return to == from || fwrite(zeros, 1, (size_t)(to - from), file) == to - from;
+    }
+
+    // the vertices of the sea at a time
+    bool make_frame(double seconds, const compact_scale &packing, dynarray<compact_vertex> &dest) {
+      ocean->set_time(seconds);
+      ocean->update(0.0);
+      if (memcmp(&ocean->get_packing(), &packing, sizeof(packing)) || ocean->get_num_vertices() != dest.size()) {
+        error = "the waves changed while baking";
+        return false;
+      }
+      memcpy(dest.data(), ocean->get_headless_vertices(), dest.size() * sizeof(compact_vertex));
+      return true;
+    }
+
+    // a = 0 keeps dest, 1 takes other
+    static void blend(dynarray<compact_vertex> &dest, const dynarray<compact_vertex> &other, float a, const compact_scale &packing) {
+      for (unsigned i = 0; i != dest.size(); ++i) {
+        compact_vertex &v = dest[i];
+        const compact_vertex &w = other[i];
+        float x = packing.decode_x(v.pos[0]) * (1.0f - a) + packing.decode_x(w.pos[0]) * a;
+        float y = packing.decode_y(v.pos[1]) * (1.0f - a) + packing.decode_y(w.pos[1]) * a;
+        float z = packing.decode_height(v.pos[2]) * (1.0f - a) + packing.decode_height(w.pos[2]) * a;
+        vec3 normal = octahedral::decode(v.normal) * (1.0f - a) + octahedral::decode(w.normal) * a;
+        v.pos[0] = packing.encode_x(x);
+        v.pos[1] = packing.encode_y(y);
+        v.pos[2] = packing.encode_height(z);
+        octahedral::encode(normal.squared() > 0.0f ? normal : vec3(0, 0, 1), v.normal);
+      }
+    }
+
+  public:
+    wave_baker(wave_mesh *ocean) {
+      this->ocean = ocean;
+      frame_seconds = 1.0f / 30;
+      max_period = 60.0f;
+      tolerance = 1e-3f;
+      loop_seconds = 10.0f;
+      crossfade_seconds = 1.0f;
+      error = 0;
+    }
+
+    /// seconds between frames, nudged to fit a common period
+    void set_frame_seconds(float value) {
+      frame_seconds = value;
+    }
+
+    /// look for a common period of every wave up to this many seconds, within tolerance radians
+    void set_max_period(float seconds, float tolerance = 1e-3f) {
+      max_period = seconds;
+      this->tolerance = tolerance;
+    }
+
+    /// the loop to bake if there is no common period, and how much of its end to cross-fade into the start
+    void set_loop(float seconds, float crossfade) {
+      loop_seconds = seconds;
+      crossfade_seconds = crossfade;
+    }
+
+    /// seconds after which every wave is back where it started, 0 if there isn't one up to the max period
+    double find_period() const {
+      const double two_pi = 6.283185307179586;
+      double slowest = 0.0;
+      for (unsigned i = 0; i != ocean->sine_waves.size(); ++i) {
+        double omega = fabs(ocean->get_wave_omega(i));
+        if (omega > 0.0 && (slowest == 0.0 || omega < slowest)) slowest = omega;
+      }
+      // waves that don't move repeat every frame
+      if (slowest == 0.0) return frame_seconds;
+
+      for (double period = two_pi / slowest; period <= max_period; period += two_pi / slowest) {
+        bool all = true;
+        for (unsigned i = 0; all && i != ocean->sine_waves.size(); ++i) {
+          double out = fmod(fabs(ocean->get_wave_omega(i)) * period, two_pi);
+          all = std::min(out, two_pi - out) <= tolerance;
+        }
+        if (all) return period;
+      }
+      return 0.0;
+    }
+
+    /// write a loop of the sea to a file. false if it couldn't, see get_error()
+    bool bake(const char *file_name) {
+      error = 0;
+      if (!ocean->get_headless() || !ocean->get_compact() || ocean->get_clipmap() || ocean->get_gpu_waves() || ocean->get_engine() != wave_mesh::engine_gerstner) {
+        error = "only a headless, compact, fixed grid of Gerstner waves can be baked";
+        return false;
+      }
+
+      // every tile, worked out every frame
+      ocean->clear_frustum();
+      ocean->set_refresh_policy(nullptr);
+      ocean->set_wave_culling(0.0f);
+
+      unsigned num_frames, crossfade_frames = 0;
+      double dt = frame_seconds, period = find_period();
+      if (period > 0.0) {
+        num_frames = std::max(1u, (unsigned)(period / frame_seconds + 0.5));
+        dt = period / num_frames;
+      } else {
+        num_frames = std::max(1u, (unsigned)(loop_seconds / frame_seconds + 0.5));
+        crossfade_frames = std::min(num_frames - 1, (unsigned)(crossfade_seconds / frame_seconds + 0.5));
+      }
+
+      // the first frame writes the indices and fixes the packing
+      ocean->set_time(0.0);
+      ocean->update(0.0);
+
+      wave_bake_header header;
+      memset(&header, 0, sizeof(header));
+      memcpy(header.magic, "OCNB", 4);
+      header.version = wave_bake_header::current_version;
+      header.grid_size = (uint32_t)ocean->get_grid_size();
+      header.num_vertices = (uint32_t)ocean->get_num_vertices();
+      header.num_indices = (uint32_t)ocean->get_num_indices();
+      header.num_frames = num_frames;
+      header.crossfade_frames = crossfade_frames;
+      header.num_waves = ocean->sine_waves.size();
+      header.frame_seconds = (float)dt;
+      vec3 colour = ocean->sine_waves.size() ? ocean->sine_waves[0].colour : vec3(0.0f, 0.3f, 1.0f);
+      header.colour[0] = colour.x();
+      header.colour[1] = colour.y();
+      header.colour[2] = colour.z();
+      header.packing = ocean->get_packing();
+      header.waves_offset = sizeof(header);
+      header.indices_offset = header.waves_offset + sizeof(wave_bake_wave) * header.num_waves;
+      header.frames_offset = round_to_page(header.indices_offset + sizeof(uint32_t) * header.num_indices);
+      header.frame_stride = round_to_page(sizeof(compact_vertex) * header.num_vertices);
+
+      dynarray<wave_bake_wave> waves(header.num_waves);
+      for (unsigned i = 0; i != header.num_waves; ++i) {
+        waves[i].amplitude = ocean->sine_waves[i].amplitude;
+        waves[i].speed = ocean->sine_waves[i].speed;
+        waves[i].frequency = ocean->sine_waves[i].frequency;
+        waves[i].steepness = ocean->sine_waves[i].steepness;
+        waves[i].direction_x = ocean->sine_waves[i].direction.x();
+        waves[i].direction_y = ocean->sine_waves[i].direction.y();
+        waves[i].weight = ocean->get_wave_weight(i);
+      }
+
+      FILE *file = fopen(file_name, "wb");
+      if (!file) {
+        error = "could not write the file";
+        return false;
+      }
+
+      bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+      ok = ok && (!header.num_waves || fwrite(waves.data(), sizeof(wave_bake_wave), header.num_waves, file) == header.num_waves);
+      ok = ok && (!header.num_indices || fwrite(ocean->get_headless_indices(), sizeof(uint32_t), header.num_indices, file) == header.num_indices);
+      ok = ok && pad(file, header.indices_offset + sizeof(uint32_t) * header.num_indices, header.frames_offset);
+
+      dynarray<compact_vertex> frame(header.num_vertices), before(header.num_vertices);
+      for (unsigned k = 0; ok && k != num_frames; ++k) {
+        ok = make_frame(k * dt, header.packing, frame);
+        // blend the end of the loop into the frames before its start
+        unsigned fade_start = num_frames - crossfade_frames;
+        if (ok && k >= fade_start) {
+          ok = make_frame(((double)k - num_frames) * dt, header.packing, before);
+          blend(frame, before, (float)(k - fade_start + 1) / (crossfade_frames + 1), header.packing);
+        }
+        ok = ok && fwrite(frame.data(), sizeof(compact_vertex), frame.size(), file) == frame.size();
+        ok = ok && pad(file, sizeof(compact_vertex) * frame.size(), header.frame_stride);
+      }
+
+      if (fclose(file) != 0) ok = false;
+      if (!ok && !error) error = "could not write the file";
+      return ok;
+    }
+
+    const char *get_error() const {
+      return error;
+    }
+  };
+
+  /// Plays back a baked ocean from a mapping of its file.
+  class wave_bake_player : public resource {
+    file_map *map;
+    const wave_bake_header *header;
+    const char *error;
+
+    // drawing, see init()
+    enum { num_buffers = 3 };
+    ref<mesh> water;
+    ref<material> water_material;
+    param_uniform *unpack_param;
+    param_uniform *colour_param;
+    ref<gl_resource> buffers[num_buffers];
+    unsigned current;
+    unsigned last_frame;
+
+    void close() {
+      delete map;
+      map = 0;
+      header = 0;
+    }
+
+  public:
+    wave_bake_player() {
+      map = 0;
+      header = 0;
+      error = 0;
+      unpack_param = colour_param = 0;
+      current = 0;
+      last_frame = ~0u;
+    }
+
+    ~wave_bake_player() {
+      close();
+    }
+
+    /// map a file made by wave_baker. false if it couldn't, see get_error()
+    bool open(const char *file_name) {
+      close();
+      map = new file_map(file_name);
+      error = map->get_error();
+      if (!error && !map->get_data()) error = "could not map file";
+      if (!error && map->get_size() < sizeof(wave_bake_header)) error = "not a baked ocean";
+
+      if (!error) {
+        const wave_bake_header *h = (const wave_bake_header *)map->get_data();
+        uint64_t frames_end = h->frames_offset + h->frame_stride * h->num_frames;
+        if (memcmp(h->magic, "OCNB", 4) || h->version != wave_bake_header::current_version) {
+          error = "not a baked ocean";
+        } else if (
+          h->num_frames == 0 || h->frame_stride < sizeof(compact_vertex) * (uint64_t)h->num_vertices ||
+          h->indices_offset + sizeof(uint32_t) * (uint64_t)h->num_indices > h->frames_offset || frames_end > map->get_size()
+        ) {
+          error = "baked ocean is cut short";
+        } else {
+          header = h;
+        }
+      }
+
+      if (error) close();
+      return error == 0;
+    }
+
+    const char *get_error() const {
+      return error;
+    }
+
+    /// null until open() succeeds
+    const wave_bake_header *get_header() const {
+      return header;
+    }
+
+    const wave_bake_wave *get_waves() const {
+      return (const wave_bake_wave *)(map->get_data() + header->waves_offset);
+    }
+
+    const uint32_t *get_indices() const {
+      return (const uint32_t *)(map->get_data() + header->indices_offset);
+    }
+
+    /// the vertices of a frame of the loop, in the mapping
+    const compact_vertex *get_frame(unsigned frame) const {
+      return (const compact_vertex *)(map->get_data() + header->frames_offset + header->frame_stride * (frame % header->num_frames));
+    }
+
+    /// the frame to show seconds after the start
+    unsigned get_frame_at(double seconds) const {
+      double frames = floor(seconds / header->frame_seconds);
+      double wrapped = fmod(frames, (double)header->num_frames);
+      return (unsigned)(wrapped < 0.0 ? wrapped + header->num_frames : wrapped);
+    }
+
+    /// add the baked ocean to a scene, drawn as wave_mesh draws its compact vertices
+    void init(visual_scene *vs) {
+      assert(header);
+      param_shader *shader = new param_shader("shaders/ocean_compact.vs", "shaders/ocean_shader.fs");
+      water_material = new material(vec4(1.0f, 0.0f, 0.0f, 1), shader);
+
+      water = new mesh();
+      size_t index_bytes = sizeof(uint32_t) * header->num_indices;
+      water->get_indices()->allocate(GL_ELEMENT_ARRAY_BUFFER, index_bytes);
+      water->get_indices()->assign(get_indices(), 0, index_bytes);
+      water->set_params(sizeof(compact_vertex), header->num_indices, header->num_vertices, GL_TRIANGLES, GL_UNSIGNED_INT);
+      water->add_attribute(attribute_pos, 3, GL_UNSIGNED_SHORT, 0);
+      water->add_attribute(attribute_normal, 2, GL_BYTE, 6, GL_TRUE);
+
+      const compact_scale &p = header->packing;
+      vec4 unpack(p.x_origin, p.xy_scale, p.height_scale, p.y_origin);
+      vec4 colour(header->colour[0], header->colour[1], header->colour[2], 1.0f);
+      unpack_param = water_material->add_uniform(&unpack, app_utils::get_atom("ocean_unpack"), GL_FLOAT_VEC4, 1, param::stage_vertex);
+      colour_param = water_material->add_uniform(&colour, app_utils::get_atom("ocean_colour"), GL_FLOAT_VEC4, 1, param::stage_vertex);
+
+      size_t frame_bytes = sizeof(compact_vertex) * header->num_vertices;
+      for (unsigned i = 0; i != num_buffers; ++i) {
+        buffers[i] = new gl_resource();
+        buffers[i]->allocate(GL_ARRAY_BUFFER, frame_bytes, GL_STREAM_DRAW);
+      }
+      last_frame = ~0u;
+      update(0.0);
+
+      scene_node *node = new scene_node();
+      node->translate(vec3(100, 0, 100));
+      node->rotate(90.0f, vec3(1.0, 0.0f, 0.0f));
+      vs->add_mesh_instance(new mesh_instance(node, water, water_material));
+    }
+
+    /// show the frame for seconds after the start. the pages go straight from the mapping to the driver
+    void update(double seconds) {
+      unsigned frame = get_frame_at(seconds);
+      if (frame == last_frame) return;
+      last_frame = frame;
+
+      // the next buffer in the ring, so we don't write one the GPU may still be drawing from
+      current = (current + 1) % num_buffers;
+      gl_resource *buf = buffers[current];
+      buf->bind();
+      glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(compact_vertex) * header->num_vertices, get_frame(frame));
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      water->set_vertices(buf);
+
+      // and have the frame after read in while this one is drawn
+      unsigned next = (frame + 1) % header->num_frames;
+      map->will_need(header->frames_offset + header->frame_stride * next, header->frame_stride);
+    }
+  };
+}
+
+#endif
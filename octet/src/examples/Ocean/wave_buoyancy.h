@@ -0,0 +1,176 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Floats rigid bodies on the ocean.
+//
+// Each body is given a few probe points, in its own space, that share its volume between them.
+// Before every step of the physics world the probes of every body are sampled in one batch
+// (wave_mesh::sample), so the render mesh is never read back, and each probe pushes its body
+//
+//   up      by density * |gravity| * volume * wet, against the gravity of the world
+//   along   by drag * wet * (velocity of the water - velocity of the probe)
+//
+// where wet goes from 0 to 1 as the surface rises from probe_height / 2 below the probe to as far above it.
+// The pushes are applied as impulses of force * step so they don't build up over the sub-steps of a frame.
+//
+// A world has only one pre-step callback, which wave_buoyancy takes while it is alive.
+//
+
+#ifndef WAVE_BUOYANCY_H_INCLUDED
+#define WAVE_BUOYANCY_H_INCLUDED
+
+#ifdef OCTET_BULLET
+
+namespace octet {
+
+  class wave_buoyancy : public resource {
+    struct body {
+      btRigidBody *rigid_body;
+      unsigned first_probe, num_probes;
+      float probe_volume;      // volume each probe stands for
+      float probe_height;      // depth over which a probe goes under
+    };
+
+    ref<wave_mesh> ocean;
+    btDiscreteDynamicsWorld *world;
+
+    dynarray<body> bodies;
+    dynarray<vec3> probes;     // in the space of the body, all the bodies' probes one after another
+
+    // one batch for wave_mesh::sample()
+    dynarray<vec3> points;
+    dynarray<float> heights;
+    dynarray<vec3> velocities;
+
+    float density;
+    float drag;
+    unsigned wet_probes;
+
+    static void pre_step(btDynamicsWorld *world, btScalar step) {
+      ((wave_buoyancy *)world->getWorldUserInfo())->apply(step);
+    }
+
+  public:
+    /// float bodies of a world, such as visual_scene::get_dynamics_world(), on the ocean
+    wave_buoyancy(wave_mesh *ocean, btDiscreteDynamicsWorld *world) {
+      this->ocean = ocean;
+      this->world = world;
+      world->setInternalTickCallback(pre_step, this, true);
+      density = 1.0f;
+      drag = 1.0f;
+      wet_probes = 0;
+    }
+
+    ~wave_buoyancy() {
+      world->setInternalTickCallback(0, 0, true);
+    }
+
+    /// float a body on probes, given in the body's space. volume is how much it displaces when it is right under.
+    void add_body(btRigidBody *rigid_body, const vec3 *body_probes, unsigned num_probes, float volume, float probe_height) {
+      assert(num_probes > 0);
+      body b;
+      b.rigid_body = rigid_body;
+      b.first_probe = probes.size();
+      b.num_probes = num_probes;
+      b.probe_volume = volume / num_probes;
+      b.probe_height = std::max(probe_height, 1e-3f);
+      for (unsigned i = 0; i != num_probes; ++i) {
+        probes.push_back(body_probes[i]);
+      }
+      bodies.push_back(b);
+    }
+
+    /// float a body on the centres of the eight octants of its collision shape's bounds
+    void add_body(btRigidBody *rigid_body, float volume) {
+      btTransform identity;
+      identity.setIdentity();
+      btVector3 bb_min, bb_max;
+      rigid_body->getCollisionShape()->getAabb(identity, bb_min, bb_max);
+      vec3 centre = get_vec3((bb_min + bb_max) * 0.5f), quarter = get_vec3((bb_max - bb_min) * 0.25f);
+      vec3 octants[8];
+      for (unsigned i = 0; i != 8; ++i) {
+        octants[i] = centre + quarter * vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+      }
+      float size = (quarter.x() + quarter.y() + quarter.z()) * (4.0f / 3.0f);
+      add_body(rigid_body, octants, 8, volume, size);
+    }
+
+    /// stop floating a body
+    void remove_body(btRigidBody *rigid_body) {
+      for (unsigned i = 0; i != bodies.size(); ++i) {
+        if (bodies[i].rigid_body != rigid_body) continue;
+        unsigned first = bodies[i].first_probe, count = bodies[i].num_probes;
+        for (unsigned p = first + count; p != probes.size(); ++p) {
+          probes[p - count] = probes[p];
+        }
+        probes.resize(probes.size() - count);
+        for (unsigned j = i + 1; j != bodies.size(); ++j) {
+          bodies[j - 1] = bodies[j];
+          bodies[j - 1].first_probe -= count;
+        }
+        bodies.resize(bodies.size() - 1);
+        return;
+      }
+    }
+
+    /// mass per unit volume of the water
+    void set_density(float value) {
+      density = value;
+    }
+
+    /// force per unit of velocity between a probe right under and the water around it
+    void set_drag(float value) {
+      drag = value;
+    }
+
+    /// probes under the surface in the last step
+    unsigned get_wet_probes() const {
+      return wet_probes;
+    }
+
+    /// push every body for a step of the world. called before each step once this is made.
+    void apply(float step) {
+      unsigned num_points = probes.size();
+      points.resize(num_points);
+      heights.resize(num_points);
+      velocities.resize(num_points);
+      for (unsigned i = 0; i != bodies.size(); ++i) {
+        const body &b = bodies[i];
+        const btTransform &transform = b.rigid_body->getCenterOfMassTransform();
+        for (unsigned p = b.first_probe; p != b.first_probe + b.num_probes; ++p) {
+          points[p] = get_vec3(transform * get_btVector3(probes[p]));
+        }
+      }
+      ocean->sample(points.data(), num_points, heights.data(), nullptr, velocities.data());
+
+      vec3 up = ocean->get_up();
+      btVector3 gravity = world->getGravity();
+      wet_probes = 0;
+      for (unsigned i = 0; i != bodies.size(); ++i) {
+        const body &b = bodies[i];
+        btRigidBody *rigid_body = b.rigid_body;
+        if (rigid_body->getInvMass() == 0.0f) continue;
+
+        bool wet = false;
+        for (unsigned p = b.first_probe; p != b.first_probe + b.num_probes; ++p) {
+          float depth = heights[p] - points[p].dot(up);
+          float under = std::min(std::max(depth / b.probe_height + 0.5f, 0.0f), 1.0f);
+          if (under == 0.0f) continue;
+
+          btVector3 offset = get_btVector3(points[p]) - rigid_body->getCenterOfMassPosition();
+          btVector3 relative = get_btVector3(velocities[p]) - rigid_body->getVelocityInLocalPoint(offset);
+          btVector3 force = -gravity * (density * b.probe_volume * under) + relative * (drag * under);
+          rigid_body->applyImpulse(force * step, offset);
+          wet_probes++;
+          wet = true;
+        }
+        if (wet) rigid_body->activate();
+      }
+    }
+  };
+}
+
+#endif
+
+#endif
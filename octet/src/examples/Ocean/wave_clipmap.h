@@ -0,0 +1,123 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Geometry clipmap for the ocean: nested square grids centred on the camera.
+//
+// Every level has the same number of vertices, but each is spaced twice as far apart as the one
+// inside it, so the vertex count stays the same however far the sea reaches. A level leaves a
+// hole where the finer level inside it is drawn. Levels snap to multiples of twice their spacing
+// so their vertices stay still as the camera moves and the hole always lands on grid lines.
+//
+// Fine levels are dropped when the camera is high enough that they would only cover a few pixels.
+//
+// This class only chooses the levels and their holes; wave_mesh makes the tiles and triangles
+// from them. It has no GL in it so it can be driven and checked without a window.
+//
+
+#ifndef WAVE_CLIPMAP_H_INCLUDED
+#define WAVE_CLIPMAP_H_INCLUDED
+
+namespace octet {
+
+  class wave_clipmap {
+  public:
+    /// one square grid of (cells + 1) x (cells + 1) vertices
+    struct level {
+      int origin_x, origin_y;   // position of vertex (0, 0) in finest grid units
+      int spacing;              // finest grid units between vertices
+      int hole_x, hole_y;       // first cell of the hole left for the next level in
+      bool has_hole;
+      bool visible;
+    };
+
+  private:
+    unsigned cells;             // cells along each side of each level, a power of two
+    float min_extent;           // a level must be at least this many camera heights across to be drawn
+    dynarray<level> levels;
+    unsigned first_visible;
+
+    static int snap(float value, int step) {
+      return (int)floorf(value / step) * step;
+    }
+
+  public:
+    wave_clipmap(unsigned cells = 64, unsigned num_levels = 6) {
+      min_extent = 0.5f;
+      first_visible = 0;
+      init(cells, num_levels);
+    }
+
+    void init(unsigned cells, unsigned num_levels) {
+      assert(cells >= 4 && (cells & (cells - 1)) == 0 && num_levels >= 1);
+      this->cells = cells;
+      levels.resize(num_levels);
+      for (unsigned i = 0; i != num_levels; ++i) {
+        level &lev = levels[i];
+        lev.origin_x = lev.origin_y = 0;
+        lev.spacing = 1 << i;
+        lev.hole_x = lev.hole_y = 0;
+        lev.has_hole = false;
+        lev.visible = true;
+      }
+    }
+
+    /// centre the levels on a camera at (x, y) in finest grid units, height units above the sea
+    void update(float x, float y, float height) {
+      unsigned num_levels = levels.size();
+
+      // skip the fine levels that are too small to see from up here, but always keep the outermost
+      unsigned first = 0;
+      while (first + 1 < num_levels && (float)(cells << first) < fabsf(height) * min_extent) {
+        ++first;
+      }
+      first_visible = first;
+
+      for (unsigned i = 0; i != num_levels; ++i) {
+        level &lev = levels[i];
+        int half = (int)cells / 2 * lev.spacing;
+        lev.origin_x = snap(x, lev.spacing * 2) - half;
+        lev.origin_y = snap(y, lev.spacing * 2) - half;
+        lev.visible = i >= first;
+      }
+
+      // the hole in each level is where the next level in lands, measured in this level's cells
+      for (unsigned i = 0; i != num_levels; ++i) {
+        level &lev = levels[i];
+        bool has_hole = i > first;
+        int hole_x = 0, hole_y = 0;
+        if (has_hole) {
+          hole_x = (levels[i - 1].origin_x - lev.origin_x) / lev.spacing;
+          hole_y = (levels[i - 1].origin_y - lev.origin_y) / lev.spacing;
+        }
+        lev.has_hole = has_hole;
+        lev.hole_x = hole_x;
+        lev.hole_y = hole_y;
+      }
+    }
+
+    unsigned get_num_levels() const {
+      return levels.size();
+    }
+
+    const level &get_level(unsigned i) const {
+      return levels[i];
+    }
+
+    unsigned get_first_visible() const {
+      return first_visible;
+    }
+
+    /// vertices along each side of a level
+    unsigned get_level_size() const {
+      return cells + 1;
+    }
+
+    /// the hole is half the level across
+    unsigned get_hole_cells() const {
+      return cells / 2;
+    }
+  };
+}
+
+#endif
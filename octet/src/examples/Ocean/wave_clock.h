@@ -0,0 +1,107 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Simulation clock for the ocean.
+//
+// The app hands in the real time between frames and the clock decides how far the sea moves:
+//
+//   variable_step  by exactly that much, so the waves move at the same speed whatever the frame rate.
+//   fixed_step     by whole steps of get_step(), carrying the remainder over to the next frame,
+//                  so every run sees the same sequence of times (what the headless tests use).
+//
+// Either way a single frame never moves more than max_delta, so a stall (a breakpoint, dragging
+// the window) doesn't make the sea jump.
+//
+// Time is kept in double. The waves don't use it directly: each one keeps its own phase, wrapped
+// to [0, 2pi), which is what goes into the float angles (see wave_mesh::advance_phases).
+//
+
+#ifndef WAVE_CLOCK_H_INCLUDED
+#define WAVE_CLOCK_H_INCLUDED
+
+namespace octet {
+
+  class wave_clock {
+  public:
+    enum mode_kind { fixed_step, variable_step };
+
+  private:
+    mode_kind mode;
+    double step;
+    double max_delta;
+    double accumulator;      // real time not yet simulated in fixed_step mode
+    double seconds;          // simulated time so far
+    unsigned long long steps;
+
+  public:
+    wave_clock() {
+      mode = fixed_step;
+      step = 1.0 / 30;
+      max_delta = 0.25;
+      reset();
+    }
+
+    /// back to time zero
+    void reset() {
+      accumulator = 0.0;
+      seconds = 0.0;
+      steps = 0;
+    }
+
+    void set_mode(mode_kind value) {
+      mode = value;
+      accumulator = 0.0;
+    }
+
+    mode_kind get_mode() const {
+      return mode;
+    }
+
+    /// length of a fixed step in seconds
+    void set_step(double value) {
+      assert(value > 0.0);
+      step = value;
+    }
+
+    double get_step() const {
+      return step;
+    }
+
+    /// most simulated time a single frame can take
+    void set_max_delta(double value) {
+      max_delta = value;
+    }
+
+    /// real time has moved on by dt seconds. returns how far to move the sea.
+    double advance(double dt) {
+      dt = std::max(0.0, std::min(dt, std::max(max_delta, step)));
+      double delta = dt;
+      if (mode == fixed_step) {
+        accumulator += dt;
+        double whole = floor(accumulator / step);
+        accumulator -= whole * step;
+        steps += (unsigned long long)whole;
+        delta = whole * step;
+        // counting steps stops the total drifting from a sum of rounded steps
+        seconds = steps * step;
+      } else {
+        seconds += dt;
+        steps++;
+      }
+      return delta;
+    }
+
+    /// simulated seconds since the start
+    double get_seconds() const {
+      return seconds;
+    }
+
+    /// fixed steps taken, or frames in variable_step mode
+    unsigned long long get_steps() const {
+      return steps;
+    }
+  };
+}
+
+#endif
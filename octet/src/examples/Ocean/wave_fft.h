@@ -0,0 +1,282 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Statistical ocean from a Phillips spectrum, after Tessendorf's "Simulating Ocean Water".
+//
+// A grid of random spectral amplitudes h0(k) is made once. Every frame it is advanced in time
+// (each wave travels at sqrt(g|k|)) and turned back into heights, choppy horizontal displacement
+// and slopes with 2D inverse FFTs. That costs O(n^2 log n) for an n x n grid however many
+// waves there are in the spectrum - every grid cell is a wave.
+//
+// Five real fields are needed. An inverse FFT of a Hermitian spectrum is real, so two fields
+// share one complex FFT (A + iB), and three FFTs do the lot.
+//
+
+#ifndef WAVE_FFT_H_INCLUDED
+#define WAVE_FFT_H_INCLUDED
+
+#include <complex>
+#include <random>
+
+namespace octet {
+
+  class wave_fft {
+  public:
+    typedef std::complex<float> complex;
+
+    /// shape of the sea. changing any of these rebuilds the spectrum on the next update.
+    struct spectrum_params {
+      unsigned size;        // grid cells along each side, a power of two
+      float patch_length;   // world units covered by the grid (it repeats after this)
+      float wind_speed;     // bigger wind, longer waves
+      vec2 wind_direction;
+      float small_waves;    // waves shorter than this are damped to stop the grid aliasing
+      unsigned seed;
+
+      spectrum_params() {
+        size = 128;
+        patch_length = 128.0f;
+        wind_speed = 8.0f;
+        wind_direction = vec2(1.0f, 0.3f);
+        small_waves = 0.5f;
+        seed = 0x9bac7615;
+      }
+    };
+
+  private:
+    enum { max_size = 2048 };
+
+    spectrum_params params;
+    bool dirty;
+    unsigned log2_size;
+
+    // per grid cell, made when the spectrum changes
+    dynarray<complex> h0;        // h0(k)
+    dynarray<complex> h0_minus;  // conj(h0(-k))
+    dynarray<float> omega;       // angular speed of each wave
+    dynarray<vec2> k_unit;       // k / |k|, zero at k = 0
+    dynarray<vec2> k_vec;
+
+    // for the FFT
+    dynarray<complex> twiddle;
+    dynarray<unsigned> bit_reverse;
+
+    // (height, displacement x), (displacement y, slope x), (slope y, unused)
+    dynarray<complex> fields[3];
+
+    float height_scale;
+    float choppiness;
+    float max_height;
+    float max_horizontal;
+
+    static float gravity() { return 9.81f; }
+    static float two_pi() { return 6.28318530718f; }
+
+    float phillips(const vec2 &k) const {
+      float k2 = dot(k, k);
+      if (k2 < 1e-12f) return 0.0f;
+      float largest = params.wind_speed * params.wind_speed / gravity();
+      float cos_wind = dot(k, params.wind_direction.normalize()) / sqrtf(k2);
+      float result = expf(-1.0f / (k2 * largest * largest)) / (k2 * k2) * cos_wind * cos_wind;
+      // waves running into the wind are much weaker
+      if (cos_wind < 0.0f) result *= 0.07f;
+      return result * expf(-k2 * params.small_waves * params.small_waves);
+    }
+
+    void build_spectrum() {
+      unsigned n = params.size;
+      assert(n >= 2 && n <= max_size && (n & (n - 1)) == 0);
+
+      log2_size = 0;
+      while ((1u << log2_size) < n) ++log2_size;
+
+      h0.resize(n * n);
+      h0_minus.resize(n * n);
+      omega.resize(n * n);
+      k_unit.resize(n * n);
+      k_vec.resize(n * n);
+      for (unsigned i = 0; i != 3; ++i) {
+        fields[i].resize(n * n);
+      }
+
+      // gaussian random amplitudes with the variance of the spectrum
+      std::mt19937 engine(params.seed);
+      std::normal_distribution<float> gaussian;
+      dynarray<float> power(n * n);
+      double total_power = 0.0;
+      for (unsigned y = 0; y != n; ++y) {
+        for (unsigned x = 0; x != n; ++x) {
+          unsigned idx = y * n + x;
+          vec2 k = (vec2((float)x, (float)y) - vec2(n * 0.5f, n * 0.5f)) * (two_pi() / params.patch_length);
+          float len = k.length();
+          k_vec[idx] = k;
+          k_unit[idx] = len > 0.0f ? k / len : vec2(0, 0);
+          omega[idx] = sqrtf(gravity() * len);
+          power[idx] = phillips(k);
+          total_power += power[idx];
+          h0[idx] = complex(gaussian(engine), gaussian(engine)) * sqrtf(power[idx] * 0.5f);
+        }
+      }
+
+      // normalise so that the height multiplier is the rms height of the sea.
+      // each height coefficient is h0(k) + conj(h0(-k)), so its expected power is P(k) + P(-k).
+      float normalise = total_power > 0.0 ? (float)(1.0 / sqrt(2.0 * total_power)) : 0.0f;
+      for (unsigned y = 0; y != n; ++y) {
+        for (unsigned x = 0; x != n; ++x) {
+          h0[y * n + x] *= normalise;
+        }
+      }
+      for (unsigned y = 0; y != n; ++y) {
+        for (unsigned x = 0; x != n; ++x) {
+          unsigned minus = ((n - y) & (n - 1)) * n + ((n - x) & (n - 1));
+          h0_minus[y * n + x] = std::conj(h0[minus]);
+        }
+      }
+
+      twiddle.resize(n / 2);
+      for (unsigned i = 0; i != n / 2; ++i) {
+        twiddle[i] = std::polar(1.0f, two_pi() * i / n);
+      }
+      bit_reverse.resize(n);
+      for (unsigned i = 0; i != n; ++i) {
+        unsigned r = 0;
+        for (unsigned b = 0; b != log2_size; ++b) {
+          r |= ((i >> b) & 1) << (log2_size - 1 - b);
+        }
+        bit_reverse[i] = r;
+      }
+
+      dirty = false;
+    }
+
+    // in place inverse FFT of n values stride apart
+    void inverse_fft(complex *data, unsigned stride) const {
+      unsigned n = params.size;
+      complex line[max_size];
+      for (unsigned i = 0; i != n; ++i) {
+        line[bit_reverse[i]] = data[i * stride];
+      }
+      for (unsigned half = 1, step = n / 2; half < n; half *= 2, step /= 2) {
+        for (unsigned start = 0; start < n; start += half * 2) {
+          for (unsigned k = 0; k != half; ++k) {
+            complex t = twiddle[k * step] * line[start + k + half];
+            line[start + k + half] = line[start + k] - t;
+            line[start + k] += t;
+          }
+        }
+      }
+      for (unsigned i = 0; i != n; ++i) {
+        data[i * stride] = line[i];
+      }
+    }
+
+    // spectra for one row of the grid at time t
+    void make_spectrum_row(unsigned y, double t) {
+      unsigned n = params.size;
+      const complex i_unit(0.0f, 1.0f);
+      for (unsigned x = 0; x != n; ++x) {
+        unsigned idx = y * n + x;
+        // wrapped in double so the angle stays accurate however long we run
+        float angle = (float)fmod(omega[idx] * t, 6.283185307179586);
+        float c = cosf(angle), s = sinf(angle);
+        complex h = h0[idx] * complex(c, s) + h0_minus[idx] * complex(c, -s);
+        vec2 k = k_vec[idx], ku = k_unit[idx];
+        complex chop_x = -i_unit * ku.x() * h, chop_y = -i_unit * ku.y() * h;
+        complex slope_x = i_unit * k.x() * h, slope_y = i_unit * k.y() * h;
+        fields[0][idx] = h + i_unit * chop_x;
+        fields[1][idx] = chop_y + i_unit * slope_x;
+        fields[2][idx] = slope_y;
+      }
+    }
+
+  public:
+    wave_fft() {
+      dirty = true;
+      log2_size = 0;
+      height_scale = 1.0f;
+      choppiness = 1.0f;
+      max_height = 0.0f;
+      max_horizontal = 0.0f;
+    }
+
+    void set_params(const spectrum_params &value) {
+      params = value;
+      dirty = true;
+    }
+
+    const spectrum_params &get_params() const {
+      return params;
+    }
+
+    /// rms height and horizontal choppiness, cheap to change every frame
+    void set_shape(float rms_height, float choppiness) {
+      height_scale = rms_height;
+      this->choppiness = choppiness;
+    }
+
+    /// advance the sea to time t (seconds) using the pool for the row and column FFTs
+    void update(double t, wave_thread_pool &workers) {
+      if (dirty) build_spectrum();
+
+      unsigned n = params.size;
+      auto rows = [&](unsigned y) {
+        make_spectrum_row(y, t);
+        for (unsigned f = 0; f != 3; ++f) {
+          inverse_fft(&fields[f][y * n], 1);
+        }
+      };
+      workers.run(n, rows);
+
+      auto columns = [&](unsigned x) {
+        for (unsigned f = 0; f != 3; ++f) {
+          inverse_fft(&fields[f][x], n);
+        }
+      };
+      workers.run(n, columns);
+
+      // the compact vertex format needs to know how far things moved
+      max_height = 0.0f;
+      max_horizontal = 0.0f;
+      for (unsigned i = 0; i != n * n; ++i) {
+        max_height = std::max(max_height, fabsf(fields[0][i].real()));
+        max_horizontal = std::max(max_horizontal, std::max(fabsf(fields[0][i].imag()), fabsf(fields[1][i].real())));
+      }
+      max_height *= height_scale;
+      max_horizontal *= height_scale * choppiness;
+    }
+
+    /// largest |height| in the last update
+    float get_max_height() const {
+      return max_height;
+    }
+
+    /// largest horizontal displacement on either axis in the last update
+    float get_max_horizontal() const {
+      return max_horizontal;
+    }
+
+    /// displacement and normal of count vertices from (x0, y), step cells apart, on a grid with one vertex per cell.
+    /// the sea repeats every size cells. y runs down the grid so displacement y is flipped to match wave_mesh.
+    void evaluate(int y, int x0, int step, unsigned count, float *dx, float *dy, float *dz, float *nx, float *ny, float *nz) const {
+      unsigned n = params.size, mask = n - 1;
+      unsigned wrapped_y = (unsigned)y & mask;
+      unsigned row = wrapped_y * n;
+      for (unsigned k = 0; k != count; ++k) {
+        unsigned x = (unsigned)(x0 + (int)k * step) & mask;
+        // the spectrum is centred on k = 0, which flips the sign of alternate outputs
+        float sign = ((x + wrapped_y) & 1) ? -height_scale : height_scale;
+        complex a = fields[0][row + x], b = fields[1][row + x], c = fields[2][row + x];
+        dx[k] = a.imag() * sign * choppiness;
+        dy[k] = -b.real() * sign * choppiness;
+        dz[k] = a.real() * sign;
+        vec3 normal = vec3(-b.imag() * sign, c.real() * sign, 1.0f).normalize();
+        nx[k] = normal.x();
+        ny[k] = normal.y();
+        nz[k] = normal.z();
+      }
+    }
+  };
+}
+
+#endif
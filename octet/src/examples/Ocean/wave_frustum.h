@@ -0,0 +1,62 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// View frustum for culling ocean tiles.
+//
+// The six planes are pulled straight out of a model to projection matrix (Gribb and Hartmann),
+// so the tests happen in the ocean mesh's own space and the tiles never need transforming.
+//
+
+#ifndef WAVE_FRUSTUM_H_INCLUDED
+#define WAVE_FRUSTUM_H_INCLUDED
+
+namespace octet {
+
+  class wave_frustum {
+    // dot(p, xyz) + w >= 0 inside
+    vec4 planes[6];
+    bool enabled;
+
+  public:
+    wave_frustum() {
+      enabled = false;
+    }
+
+    /// build the planes from camera_instance::get_matrices()' modelToProjection
+    void set(const mat4t &modelToProjection) {
+      // octet multiplies row vectors by matrices, so clip space x is dot(p, colx()) and so on
+      vec4 x = modelToProjection.colx();
+      vec4 y = modelToProjection.coly();
+      vec4 z = modelToProjection.colz();
+      vec4 w = modelToProjection.colw();
+      planes[0] = w + x;
+      planes[1] = w - x;
+      planes[2] = w + y;
+      planes[3] = w - y;
+      planes[4] = w + z;
+      planes[5] = w - z;
+      enabled = true;
+    }
+
+    /// stop culling (everything intersects)
+    void clear() {
+      enabled = false;
+    }
+
+    bool is_enabled() const {
+      return enabled;
+    }
+
+    /// false only if the box is certainly outside
+    bool intersects(const aabb &box) const {
+      if (!enabled) return true;
+      for (unsigned i = 0; i != 6; ++i) {
+        if (!half_space(planes[i].xyz(), planes[i].w()).intersects(box)) return false;
+      }
+      return true;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,253 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Keeps the ocean inside a frame budget.
+//
+// The app tells the governor how long wave_mesh::update() and the render took each frame. When the
+// smoothed total goes over the target it gives up some quality, cheapest to see first:
+//
+//   1. refresh far tiles less often (a larger error angle for wave_refresh_by_error)
+//   2. add up fewer waves (the smallest fade out, see wave_mesh::set_active_waves)
+//   3. coarser grids (wave_mesh::set_detail)
+//
+// and when there is room to spare it takes the quality back in the opposite order. A step back up is
+// only taken if the cost it is expected to add still leaves the frame a margin under the target, and
+// after any change the governor waits for the times to settle before changing anything else, so it
+// doesn't flip between two settings. The cost of a finer grid is guessed at first, but once the
+// governor has had to leave a detail it remembers what that detail cost for a while.
+//
+// Every frame is written as a line of CSV to the stat file, if there is one, and the last few changes
+// are kept for the app to show.
+//
+
+#ifndef WAVE_GOVERNOR_H_INCLUDED
+#define WAVE_GOVERNOR_H_INCLUDED
+
+namespace octet {
+
+  class wave_governor {
+  public:
+    /// one frame's measurements and what was done about them
+    struct decision {
+      unsigned frame;
+      float update_ms;          // this frame
+      float render_ms;
+      float smoothed_ms;        // update + render, averaged over the last few frames
+      unsigned detail;          // the settings from now on
+      unsigned waves;
+      float refresh_angle;
+      const char *action;
+    };
+
+    enum { history_size = 32 };
+
+  private:
+    ref<wave_mesh> mesh;
+    ref<wave_refresh_by_error> refresh;
+
+    float target_ms;
+    float margin;               // step up only if the estimate is this fraction under the target
+    unsigned settle_frames;     // frames to wait after a change
+    float smoothing;            // weight of each new frame in the averages
+
+    float min_angle, max_angle; // range of the refresh error
+    unsigned min_waves;
+
+    double update_ms, render_ms;
+    unsigned frame, last_change;
+    bool measured;
+
+    // what update() took at each detail when the governor last left it
+    enum { max_detail = 4 };
+    float detail_ms[max_detail];
+    unsigned detail_frame[max_detail];
+    unsigned memory_frames;     // how long to trust them
+
+    decision history[history_size];
+    unsigned num_decisions;
+    FILE *stat_file;
+
+    void record(float update, float render, const char *action) {
+      decision d;
+      d.frame = frame;
+      d.update_ms = update;
+      d.render_ms = render;
+      d.smoothed_ms = (float)(update_ms + render_ms);
+      d.detail = mesh->get_detail();
+      d.waves = mesh->get_active_waves();
+      d.refresh_angle = refresh->get_max_angle();
+      d.action = action;
+
+      if (stat_file) {
+        fprintf(
+          stat_file, "%u,%.3f,%.3f,%.3f,%u,%u,%g,%s\n",
+          d.frame, d.update_ms, d.render_ms, d.smoothed_ms, d.detail, d.waves, d.refresh_angle, d.action
+        );
+      }
+
+      if (action[0] != '-') {
+        history[num_decisions % history_size] = d;
+        num_decisions++;
+        last_change = frame;
+      }
+    }
+
+    // the cost of update() if every tile were refreshed every frame
+    double all_refreshed_ms() const {
+      size_t total = mesh->get_num_vertices();
+      double fraction = total ? (double)mesh->get_refreshed_vertices() / total : 1.0;
+      return update_ms / std::max(fraction, 0.25);
+    }
+
+    // give up one step of quality. returns what was done, or null if there is nothing left
+    const char *step_down() {
+      unsigned waves = mesh->get_active_waves();
+      if (refresh->get_max_angle() < max_angle) {
+        refresh->set_max_angle(std::min(refresh->get_max_angle() * 2.0f, max_angle));
+        return "refresh less";
+      } else if (waves > min_waves) {
+        mesh->set_active_waves(std::max(min_waves, waves - std::max(1u, waves / 4)));
+        return "fewer waves";
+      } else if (mesh->get_detail() < mesh->get_max_detail()) {
+        unsigned detail = mesh->get_detail();
+        detail_ms[detail] = (float)update_ms;
+        detail_frame[detail] = frame;
+        mesh->set_detail(detail + 1);
+        return "coarser grid";
+      }
+      return nullptr;
+    }
+
+    // take back one step of quality if it should still fit. returns what was done, or null
+    const char *step_up() {
+      double limit = target_ms * (1.0f - margin);
+      unsigned waves = mesh->get_active_waves(), all_waves = mesh->sine_waves.size();
+      if (mesh->get_detail() > 0) {
+        // four times the vertices, unless we know better
+        unsigned finer = mesh->get_detail() - 1;
+        bool known = finer < max_detail && detail_frame[finer] && frame - detail_frame[finer] < memory_frames;
+        double estimate = known ? detail_ms[finer] : update_ms * 4.0;
+        if (estimate + render_ms > limit) return nullptr;
+        mesh->set_detail(finer);
+        return "finer grid";
+      } else if (waves < all_waves) {
+        unsigned more = std::min(all_waves, waves + std::max(1u, waves / 3));
+        if (update_ms * more / std::max(waves, 1u) + render_ms > limit) return nullptr;
+        mesh->set_active_waves(more);
+        return "more waves";
+      } else if (refresh->get_max_angle() > min_angle) {
+        if (all_refreshed_ms() + render_ms > limit) return nullptr;
+        refresh->set_max_angle(std::max(refresh->get_max_angle() * 0.5f, min_angle));
+        return "refresh more";
+      }
+      return nullptr;
+    }
+
+  public:
+    wave_governor() {
+      target_ms = 8.0f;
+      margin = 0.25f;
+      settle_frames = 30;
+      smoothing = 0.1f;
+      min_angle = 0.001f;
+      max_angle = 0.008f;
+      min_waves = 1;
+      update_ms = render_ms = 0.0;
+      frame = last_change = 0;
+      measured = false;
+      num_decisions = 0;
+      stat_file = nullptr;
+      memory_frames = 1800;
+      for (unsigned i = 0; i != max_detail; ++i) {
+        detail_ms[i] = 0.0f;
+        detail_frame[i] = 0;
+      }
+    }
+
+    /// take over the quality settings of a mesh. this gives it a wave_refresh_by_error policy
+    void attach(wave_mesh *value) {
+      mesh = value;
+      refresh = new wave_refresh_by_error(min_angle);
+      mesh->set_refresh_policy(refresh);
+    }
+
+    /// milliseconds update() and the render together should take
+    void set_target_ms(float value) {
+      target_ms = value;
+    }
+
+    float get_target_ms() const {
+      return target_ms;
+    }
+
+    /// the range the refresh error angle is moved over, in radians
+    void set_refresh_angles(float least, float most) {
+      min_angle = least;
+      max_angle = most;
+    }
+
+    /// never fade out below this many waves
+    void set_min_waves(unsigned value) {
+      min_waves = std::max(1u, value);
+    }
+
+    /// the fraction under the target the estimate must be for a step back up
+    void set_margin(float value) {
+      margin = value;
+    }
+
+    /// frames to wait after a change before making another
+    void set_settle_frames(unsigned value) {
+      settle_frames = value;
+    }
+
+    /// write one line of CSV a frame to this file, null for none
+    void set_stat_file(FILE *file) {
+      stat_file = file;
+      if (stat_file) fprintf(stat_file, "frame,update_ms,render_ms,smoothed_ms,detail,waves,refresh_angle,action\n");
+    }
+
+    /// call once a frame with the times of the last update() and render
+    void frame_done(double update, double render) {
+      if (!mesh) return;
+      frame++;
+      if (!measured) {
+        update_ms = update;
+        render_ms = render;
+        measured = true;
+      } else {
+        update_ms += (update - update_ms) * smoothing;
+        render_ms += (render - render_ms) * smoothing;
+      }
+
+      const char *action = nullptr;
+      if (frame - last_change >= settle_frames) {
+        if (update_ms + render_ms > target_ms) {
+          action = step_down();
+        } else {
+          action = step_up();
+        }
+      }
+      record((float)update, (float)render, action ? action : "-");
+    }
+
+    /// changes made so far
+    unsigned get_num_decisions() const {
+      return num_decisions;
+    }
+
+    /// one of the last history_size changes, 0 for the latest
+    const decision &get_decision(unsigned age) const {
+      assert(age < std::min(num_decisions, (unsigned)history_size));
+      return history[(num_decisions - 1 - age) % history_size];
+    }
+
+    /// update() and render times averaged over the last few frames
+    float get_smoothed_ms() const {
+      return (float)(update_ms + render_ms);
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,101 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Gerstner waves in the vertex shader (shaders/ocean_gerstner.vs).
+//
+// The grid goes to the GPU once as undisplaced positions and only the waves change each frame.
+// Each wave takes two vec4 uniforms:
+//
+//   waves[2i]     = (kx, ky, phase, amplitude)
+//   waves[2i + 1] = (qa_x, qa_y, 0, 0)
+//
+// which are the same numbers wave_bank hands to wave_kernel, so both paths add up the same terms.
+//
+// A grid vertex is (x, row, stitch). The odd vertices on the edge of a clipmap level are moved onto
+// the coarser level outside by averaging their neighbours: stitch > 0 averages the vertices stitch
+// units either side along the row, stitch < 0 those -stitch rows either side, 0 leaves it alone.
+//
+// wave_uniforms::evaluate() is the shader written out again in C++, so the GPU path can be checked
+// against the CPU path without a GL context.
+//
+
+#ifndef WAVE_GPU_H_INCLUDED
+#define WAVE_GPU_H_INCLUDED
+
+namespace octet {
+
+  class wave_uniforms {
+  public:
+    /// must match MAX_WAVES in ocean_gerstner.vs
+    enum { max_waves = 16 };
+
+  private:
+    vec4 waves[max_waves * 2];
+    float count;
+
+    // one grid position, the same sums as wave_kernel
+    void evaluate_point(float x, float y, vec3 &disp, vec3 &normal) const {
+      vec3 binormal(1.0f, 0.0f, 0.0f), tangent(0.0f, 1.0f, 0.0f);
+      disp = vec3(0.0f, 0.0f, 0.0f);
+      for (unsigned i = 0; i < (unsigned)count; ++i) {
+        const vec4 &a = waves[i * 2], &b = waves[i * 2 + 1];
+        float angle = a.x() * x + a.y() * y + a.z();
+        float c = cosf(angle), s = sinf(angle);
+        disp += vec3(b.x() * c, b.y() * c, a.w() * s);
+        binormal += vec3(-b.x() * a.x() * s, -b.y() * a.x() * s, a.w() * a.x() * c);
+        tangent += vec3(b.x() * a.y() * s, b.y() * a.y() * s, -a.w() * a.y() * c);
+      }
+      normal = binormal.cross(tangent).normalize();
+    }
+
+  public:
+    wave_uniforms() {
+      count = 0.0f;
+      memset(waves, 0, sizeof(waves));
+    }
+
+    /// copy the first max_waves waves of the bank
+    void set(const wave_bank &bank) {
+      unsigned n = std::min(bank.size(), (unsigned)max_waves);
+      memset(waves, 0, sizeof(waves));
+      for (unsigned i = 0; i != n; ++i) {
+        waves[i * 2] = vec4(bank.kx[i], bank.ky[i], bank.phase[i], bank.amplitude[i]);
+        waves[i * 2 + 1] = vec4(bank.qa_x[i], bank.qa_y[i], 0.0f, 0.0f);
+      }
+      count = (float)n;
+    }
+
+    /// for material::set_uniform()
+    const vec4 *get_waves() const {
+      return waves;
+    }
+
+    size_t get_waves_bytes() const {
+      return sizeof(waves);
+    }
+
+    const float *get_count() const {
+      return &count;
+    }
+
+    /// what the vertex shader does to a grid vertex: position in the mesh's space and unit normal
+    void evaluate(const vec3 &grid, vec3 &pos, vec3 &normal) const {
+      vec3 disp;
+      if (grid.z() == 0.0f) {
+        evaluate_point(grid.x(), grid.y(), disp, normal);
+      } else {
+        vec3 offset = grid.z() > 0.0f ? vec3(grid.z(), 0.0f, 0.0f) : vec3(0.0f, -grid.z(), 0.0f);
+        vec3 d0, d1, n0, n1;
+        evaluate_point(grid.x() - offset.x(), grid.y() - offset.y(), d0, n0);
+        evaluate_point(grid.x() + offset.x(), grid.y() + offset.y(), d1, n1);
+        disp = (d0 + d1) * 0.5f;
+        normal = (n0 + n1) * 0.5f;
+      }
+      //rows run down the grid
+      pos = vec3(grid.x() + disp.x(), -grid.y() + disp.y(), disp.z());
+    }
+  };
+}
+
+#endif
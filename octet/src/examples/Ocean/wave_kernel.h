@@ -0,0 +1,683 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Structure-of-arrays Gerstner wave kernel.
+//
+// wave_bank holds only the parameters the inner loop needs, one array per field,
+// with the products that do not change across the grid folded together:
+//
+//   angle = kx * x + ky * y + phase   (kx = frequency * direction.x, phase wrapped to [0, 2pi) by wave_mesh)
+//   dx += qa_x * cos(angle)           (qa_x = steepness * amplitude * direction.x)
+//   dy += qa_y * cos(angle)
+//   dz += amplitude * sin(angle)
+//
+// The derivatives of the displacement along the row (x) and down the rows (y) reuse the
+// same sin and cos (GPU Gems chapter 1, equations 10-12, for a wave vector k = frequency * direction):
+//
+//   d(dx)/dx = -qa_x kx sin   d(dx)/dy = -qa_x ky sin
+//   d(dy)/dx = -qa_y kx sin   d(dy)/dy = -qa_y ky sin   (qa_x ky == qa_y kx)
+//   d(dz)/dx =  A kx cos      d(dz)/dy =  A ky cos
+//
+// so five more sums per vertex give the binormal, tangent and normal without another sincos.
+// With the phase moving at omega radians a second, three more give the velocity of the water:
+//
+//   d(dx)/dt = -qa_x omega sin   d(dy)/dt = -qa_y omega sin   d(dz)/dt = A omega cos
+//
+// wave_kernel evaluates a run of vertices along one grid row, 4 (SSE) or 8 (AVX2) vertices
+// per instruction, using a polynomial sincos instead of the C library.
+//
+
+#ifndef WAVE_KERNEL_H_INCLUDED
+#define WAVE_KERNEL_H_INCLUDED
+
+#if OCTET_SSE || defined(__SSE2__)
+  #define WAVE_KERNEL_SSE 1
+  #include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+  #define WAVE_KERNEL_AVX2 1
+  #include <immintrin.h>
+#endif
+
+namespace octet {
+
+  /// hot wave parameters in structure-of-arrays form
+  class wave_bank {
+  public:
+    /// wave_kernel keeps a little state per wave on the stack, so a bank holds at most this many
+    enum { max_waves = 256 };
+
+    dynarray<float> kx;
+    dynarray<float> ky;
+    dynarray<float> phase;
+    dynarray<float> qa_x;
+    dynarray<float> qa_y;
+    dynarray<float> amplitude;
+
+    // products for the derivatives
+    dynarray<float> qk_xx;   // qa_x * kx
+    dynarray<float> qk_xy;   // qa_x * ky
+    dynarray<float> qk_yy;   // qa_y * ky
+    dynarray<float> ak_x;    // amplitude * kx
+    dynarray<float> ak_y;    // amplitude * ky
+
+    // for wave_kernel::evaluate_cached()
+    dynarray<float> phase_sin;
+    dynarray<float> phase_cos;
+
+    // products for the velocity, omega is radians a second
+    dynarray<float> qw_x;    // qa_x * omega
+    dynarray<float> qw_y;    // qa_y * omega
+    dynarray<float> aw;      // amplitude * omega
+
+    unsigned size() const {
+      return kx.size();
+    }
+
+    /// make room for num_waves waves, or max_waves if there are more than that
+    void resize(unsigned num_waves) {
+      num_waves = std::min(num_waves, (unsigned)max_waves);
+      kx.resize(num_waves);
+      ky.resize(num_waves);
+      phase.resize(num_waves);
+      qa_x.resize(num_waves);
+      qa_y.resize(num_waves);
+      amplitude.resize(num_waves);
+      qk_xx.resize(num_waves);
+      qk_xy.resize(num_waves);
+      qk_yy.resize(num_waves);
+      ak_x.resize(num_waves);
+      ak_y.resize(num_waves);
+      phase_sin.resize(num_waves);
+      phase_cos.resize(num_waves);
+      qw_x.resize(num_waves);
+      qw_y.resize(num_waves);
+      aw.resize(num_waves);
+    }
+
+    /// fill in wave i < size() from the artist-facing parameters and its phase at this time, moving at omega radians a second
+    void set(unsigned i, float frequency, float steepness, float amp, vec3_in direction, float wave_phase, float omega = 0.0f) {
+      kx[i] = frequency * direction.x();
+      ky[i] = frequency * direction.y();
+      phase[i] = wave_phase;
+      qa_x[i] = steepness * amp * direction.x();
+      qa_y[i] = steepness * amp * direction.y();
+      amplitude[i] = amp;
+      qk_xx[i] = qa_x[i] * kx[i];
+      qk_xy[i] = qa_x[i] * ky[i];
+      qk_yy[i] = qa_y[i] * ky[i];
+      ak_x[i] = amp * kx[i];
+      ak_y[i] = amp * ky[i];
+      phase_sin[i] = sinf(phase[i]);
+      phase_cos[i] = cosf(phase[i]);
+      qw_x[i] = qa_x[i] * omega;
+      qw_y[i] = qa_y[i] * omega;
+      aw[i] = amp * omega;
+    }
+  };
+
+  /// where wave_kernel::evaluate() writes a run of n vertices, n floats per array.
+  /// any of the normal, tangent and binormal arrays may be null.
+  struct wave_frame {
+    float *dx, *dy, *dz;  // displacement
+    float *nx, *ny, *nz;  // unit normal
+    float *tx, *ty, *tz;  // tangent, down the rows (against the grid's y, which runs down), not normalised
+    float *bx, *by, *bz;  // binormal, along the row, not normalised
+
+    wave_frame(float *dx, float *dy, float *dz, float *nx = 0, float *ny = 0, float *nz = 0) {
+      this->dx = dx; this->dy = dy; this->dz = dz;
+      this->nx = nx; this->ny = ny; this->nz = nz;
+      tx = ty = tz = 0;
+      bx = by = bz = 0;
+    }
+  };
+
+  /// Which waves a run of vertices adds up, and how they fade out with distance from the camera
+  /// (see wave_mesh::build_wave_masks). Each wave's weight at a vertex is
+  ///
+  ///   clamp(fade_scale[w] / distance - 1, 0, 1)
+  ///
+  /// which depends only on where the vertex is, so neighbouring runs with different masks still agree.
+  struct wave_mask {
+    const unsigned *waves;     // indices into the bank
+    unsigned count;
+    bool fade;                 // false if every wave listed has a weight of one all over the run
+    float camera_x, camera_y;  // in grid units, y down the rows
+    float camera_z2;           // height above the sea, squared
+    const float *fade_scale;   // per wave of the bank
+  };
+
+  /// vectorised Gerstner displacement over runs of grid vertices
+  class wave_kernel {
+    // Cody-Waite split of pi/2: the first two parts have 8 and 11 significant bits so q * part is exact for |q| < 2^13
+    static float pio2_1() { return 1.5703125f; }
+    static float pio2_2() { return 4.8375129699707031e-4f; }
+    static float pio2_3() { return 7.5497899548918821e-8f; }
+    static float two_over_pi() { return 0.63661977236758134f; }
+
+    // minimax polynomials for sin and cos on [-pi/4, pi/4] (cephes sinf/cosf)
+    static float s1() { return -1.6666654611e-1f; }
+    static float s2() { return 8.3321608736e-3f; }
+    static float s3() { return -1.9515295891e-4f; }
+    static float c1() { return 4.166664568298827e-2f; }
+    static float c2() { return -1.388731625493765e-3f; }
+    static float c3() { return 2.443315711809948e-5f; }
+
+  public:
+    /// most vertices per call to evaluate(). only the n asked for are written.
+    enum { chunk = 64 };
+
+    /// Scalar polynomial sincos, the same sequence of operations as the SIMD versions.
+    ///
+    /// Error bound: at most 1e-7 absolute from the exact sin/cos of x for |x| <= 8192
+    /// (libm sinf is 3.3e-8). Past that the range reduction stops being exact and the error
+    /// grows roughly linearly: 5e-7 at |x| = 32768, 2e-6 at 131072, useless by 1e6.
+    /// Wrap angles into a small range before calling if they can grow without limit.
+    static void sincos(float x, float &s, float &c) {
+      float qf = x * two_over_pi();
+      int q = (int)(qf + (qf >= 0 ? 0.5f : -0.5f));
+      float fq = (float)q;
+      float r = ((x - fq * pio2_1()) - fq * pio2_2()) - fq * pio2_3();
+      float r2 = r * r;
+      float ps = r + r * r2 * (s1() + r2 * (s2() + r2 * s3()));
+      float pc = 1.0f - 0.5f * r2 + r2 * r2 * (c1() + r2 * (c2() + r2 * c3()));
+      float ss = (q & 1) ? pc : ps;
+      float cc = (q & 1) ? ps : pc;
+      s = (q & 2) ? -ss : ss;
+      c = ((q + 1) & 2) ? -cc : cc;
+    }
+
+    #if WAVE_KERNEL_SSE
+      /// four lanes of sincos. see sincos() for the error bound.
+      static void sincos(__m128 x, __m128 &s, __m128 &c) {
+        __m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(two_over_pi())));
+        __m128 fq = _mm_cvtepi32_ps(q);
+        __m128 r = _mm_sub_ps(x, _mm_mul_ps(fq, _mm_set1_ps(pio2_1())));
+        r = _mm_sub_ps(r, _mm_mul_ps(fq, _mm_set1_ps(pio2_2())));
+        r = _mm_sub_ps(r, _mm_mul_ps(fq, _mm_set1_ps(pio2_3())));
+        __m128 r2 = _mm_mul_ps(r, r);
+
+        __m128 ps = _mm_add_ps(_mm_set1_ps(s2()), _mm_mul_ps(r2, _mm_set1_ps(s3())));
+        ps = _mm_add_ps(_mm_set1_ps(s1()), _mm_mul_ps(r2, ps));
+        ps = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), ps));
+
+        __m128 pc = _mm_add_ps(_mm_set1_ps(c2()), _mm_mul_ps(r2, _mm_set1_ps(c3())));
+        pc = _mm_add_ps(_mm_set1_ps(c1()), _mm_mul_ps(r2, pc));
+        pc = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)), _mm_mul_ps(_mm_mul_ps(r2, r2), pc));
+
+        // odd quadrants swap sin and cos; quadrants 2,3 negate sin and 1,2 negate cos
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+        __m128 ss = _mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps));
+        __m128 cc = _mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc));
+        __m128 sign_s = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+        __m128 sign_c = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+        s = _mm_xor_ps(ss, sign_s);
+        c = _mm_xor_ps(cc, sign_c);
+      }
+    #endif
+
+    #if WAVE_KERNEL_AVX2
+      /// eight lanes of sincos. see sincos() for the error bound.
+      static void sincos(__m256 x, __m256 &s, __m256 &c) {
+        __m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(two_over_pi())));
+        __m256 fq = _mm256_cvtepi32_ps(q);
+        __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(fq, _mm256_set1_ps(pio2_1())));
+        r = _mm256_sub_ps(r, _mm256_mul_ps(fq, _mm256_set1_ps(pio2_2())));
+        r = _mm256_sub_ps(r, _mm256_mul_ps(fq, _mm256_set1_ps(pio2_3())));
+        __m256 r2 = _mm256_mul_ps(r, r);
+
+        __m256 ps = _mm256_add_ps(_mm256_set1_ps(s2()), _mm256_mul_ps(r2, _mm256_set1_ps(s3())));
+        ps = _mm256_add_ps(_mm256_set1_ps(s1()), _mm256_mul_ps(r2, ps));
+        ps = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, r2), ps));
+
+        __m256 pc = _mm256_add_ps(_mm256_set1_ps(c2()), _mm256_mul_ps(r2, _mm256_set1_ps(c3())));
+        pc = _mm256_add_ps(_mm256_set1_ps(c1()), _mm256_mul_ps(r2, pc));
+        pc = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), r2)), _mm256_mul_ps(_mm256_mul_ps(r2, r2), pc));
+
+        __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+        __m256 ss = _mm256_blendv_ps(ps, pc, swap);
+        __m256 cc = _mm256_blendv_ps(pc, ps, swap);
+        __m256 sign_s = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, _mm256_set1_epi32(2)), 30));
+        __m256 sign_c = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+        s = _mm256_xor_ps(ss, sign_s);
+        c = _mm256_xor_ps(cc, sign_c);
+      }
+    #endif
+
+    /// the waves to add up: the mask's, or all of them
+    static unsigned select_waves(const wave_bank &bank, const wave_mask *mask, unsigned *waves) {
+      assert(bank.size() <= wave_bank::max_waves);
+      if (mask) {
+        for (unsigned k = 0; k != mask->count; ++k) waves[k] = mask->waves[k];
+        return mask->count;
+      }
+      for (unsigned w = 0; w != bank.size(); ++w) waves[w] = w;
+      return bank.size();
+    }
+
+    static float inverse_distance(float x, float y, const wave_mask &mask) {
+      float ex = x - mask.camera_x, ey = y - mask.camera_y;
+      return 1.0f / sqrtf(ex * ex + ey * ey + mask.camera_z2);
+    }
+
+    static float fade_weight(float inv_d, float scale) {
+      return std::min(std::max(scale * inv_d - 1.0f, 0.0f), 1.0f);
+    }
+
+    #if WAVE_KERNEL_SSE
+      static __m128 inverse_distance(__m128 x, float y, const wave_mask &mask) {
+        __m128 ex = _mm_sub_ps(x, _mm_set1_ps(mask.camera_x));
+        float ey = y - mask.camera_y;
+        return _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_set1_ps(ey * ey + mask.camera_z2))));
+      }
+
+      static __m128 fade_weight(__m128 inv_d, float scale) {
+        __m128 weight = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(scale), inv_d), _mm_set1_ps(1.0f));
+        return _mm_min_ps(_mm_max_ps(weight, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+      }
+    #endif
+
+    #if WAVE_KERNEL_AVX2
+      static __m256 inverse_distance(__m256 x, float y, const wave_mask &mask) {
+        __m256 ex = _mm256_sub_ps(x, _mm256_set1_ps(mask.camera_x));
+        float ey = y - mask.camera_y;
+        return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_set1_ps(ey * ey + mask.camera_z2))));
+      }
+
+      static __m256 fade_weight(__m256 inv_d, float scale) {
+        __m256 weight = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(scale), inv_d), _mm256_set1_ps(1.0f));
+        return _mm256_min_ps(_mm256_max_ps(weight, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+      }
+    #endif
+
+    /// Gerstner displacement of vertices (x0 .. x0+n-1, y), n <= chunk.
+    static void evaluate(const wave_bank &bank, float y, unsigned x0, unsigned n, float *out_x, float *out_y, float *out_z) {
+      evaluate(bank, y, (float)x0, 1.0f, n, wave_frame(out_x, out_y, out_z));
+    }
+
+    /// Gerstner displacement and surface frame of vertices (x0 + i * step, y) for i = 0 .. n-1, n <= chunk.
+    ///
+    /// The frame is for the surface as wave_mesh draws it, (x + dx, -y + dy, dz), with y running down the grid.
+    /// The normal is exact (binormal x tangent), not the GPU Gems approximation that assumes unit directions.
+    /// With a mask only the waves it lists are added up, faded by distance.
+    static void evaluate(const wave_bank &bank, float y, float x0, float step, unsigned n, const wave_frame &out, const wave_mask *mask = 0) {
+      unsigned waves[wave_bank::max_waves], num_waves = select_waves(bank, mask, waves);
+
+      // the y and time terms are the same for the whole row
+      float row[wave_bank::max_waves];
+      for (unsigned w = 0; w != bank.size(); ++w) {
+        row[w] = bank.ky[w] * y + bank.phase[w];
+      }
+
+      frame_sums sums;
+      unsigned i = 0;
+
+      #if WAVE_KERNEL_AVX2
+        row_phase<__m256> phase8(bank, row);
+        i = row_loop<__m256>(bank, waves, num_waves, mask, y, x0, step, i, n, out, sums, phase8);
+      #endif
+
+      #if WAVE_KERNEL_SSE
+        row_phase<__m128> phase4(bank, row);
+        i = row_loop<__m128>(bank, waves, num_waves, mask, y, x0, step, i, n, out, sums, phase4);
+      #endif
+
+      row_phase<float> phase1(bank, row);
+      row_loop<float>(bank, waves, num_waves, mask, y, x0, step, i, n, out, sums, phase1);
+
+      finish_frame(n, sums, out);
+    }
+
+    /// Same as evaluate(), but sin and cos are only computed exactly for the first vertices of each
+    /// run of reseed. After that they are advanced a vertex at a time (a block of SIMD lanes at a time)
+    /// by rotating them through the constant angle kx * step:
+    ///
+    ///   sin(a + d) = sin a cos d + cos a sin d
+    ///   cos(a + d) = cos a cos d - sin a sin d
+    ///
+    /// which costs four multiplies instead of a polynomial. Rounding builds up by about 1e-7 a step,
+    /// so reseed bounds the drift. It is rounded to a multiple of the SIMD width, and the few
+    /// vertices left over after the widest blocks start again from an exact sincos.
+    static void evaluate_stepped(const wave_bank &bank, float y, float x0, float step, unsigned n, const wave_frame &out, unsigned reseed, const wave_mask *mask = 0) {
+      unsigned waves[wave_bank::max_waves], num_waves = select_waves(bank, mask, waves);
+
+      float row[wave_bank::max_waves];
+      for (unsigned w = 0; w != bank.size(); ++w) {
+        row[w] = bank.ky[w] * y + bank.phase[w];
+      }
+
+      frame_sums sums;
+      unsigned i = 0;
+
+      #if WAVE_KERNEL_AVX2
+        if (i + 8 <= n) {
+          stepped_phase<__m256> phase8(bank, row, waves, num_waves, step, i, reseed);
+          i = row_loop<__m256>(bank, waves, num_waves, mask, y, x0, step, i, n, out, sums, phase8);
+        }
+      #endif
+
+      #if WAVE_KERNEL_SSE
+        if (i + 4 <= n) {
+          stepped_phase<__m128> phase4(bank, row, waves, num_waves, step, i, reseed);
+          i = row_loop<__m128>(bank, waves, num_waves, mask, y, x0, step, i, n, out, sums, phase4);
+        }
+      #endif
+
+      if (i < n) {
+        stepped_phase<float> phase1(bank, row, waves, num_waves, step, i, reseed);
+        row_loop<float>(bank, waves, num_waves, mask, y, x0, step, i, n, out, sums, phase1);
+      }
+
+      finish_frame(n, sums, out);
+    }
+
+    /// Same as evaluate(), but with the sin and cos of the spatial part of every angle, kx * x + ky * y,
+    /// already known (see wave_phase_cache.h). Wave w of vertex i is at spatial_sin[w * wave_stride + i].
+    /// They only need rotating through each wave's phase, whose sin and cos are in the bank.
+    /// The grid position of the vertices is only needed for fading.
+    static void evaluate_cached(const wave_bank &bank, const float *spatial_sin, const float *spatial_cos, size_t wave_stride, float y, float x0, float step, unsigned n, const wave_frame &out, const wave_mask *mask = 0) {
+      unsigned waves[wave_bank::max_waves], num_waves = select_waves(bank, mask, waves);
+      cached_phase phase(bank, spatial_sin, spatial_cos, wave_stride);
+      frame_sums sums;
+
+      // the tables end at the last vertex, so only whole blocks of lanes are read from them
+      unsigned i = 0;
+
+      #if WAVE_KERNEL_AVX2
+        i = row_loop<__m256>(bank, waves, num_waves, mask, y, x0, step, i, n, out, sums, phase);
+      #endif
+
+      #if WAVE_KERNEL_SSE
+        i = row_loop<__m128>(bank, waves, num_waves, mask, y, x0, step, i, n, out, sums, phase);
+      #endif
+
+      row_loop<float>(bank, waves, num_waves, mask, y, x0, step, i, n, out, sums, phase);
+
+      finish_frame(n, sums, out);
+    }
+
+    /// Same as evaluate() for n <= chunk grid positions (x[i], y[i]) anywhere, rather than along a row,
+    /// and the velocity of the water there if vx, vy and vz aren't null. Every wave is added up.
+    static void evaluate_points(const wave_bank &bank, const float *x, const float *y, unsigned n, const wave_frame &out, float *vx = 0, float *vy = 0, float *vz = 0) {
+      frame_sums sums;
+
+      // somewhere to put the velocity if it isn't wanted
+      float v_x[chunk], v_y[chunk], v_z[chunk];
+      if (!vx) {
+        vx = v_x; vy = v_y; vz = v_z;
+      }
+
+      unsigned i = 0;
+
+      #if WAVE_KERNEL_AVX2
+        i = points_loop<__m256>(bank, x, y, i, n, out, sums, vx, vy, vz);
+      #endif
+
+      #if WAVE_KERNEL_SSE
+        i = points_loop<__m128>(bank, x, y, i, n, out, sums, vx, vy, vz);
+      #endif
+
+      points_loop<float>(bank, x, y, i, n, out, sums, vx, vy, vz);
+
+      finish_frame(n, sums, out);
+    }
+
+  private:
+    // the operations the loops below need, with the same names for every width
+    static void splat(float &r, float f) { r = f; }
+    static void load_ps(float &r, const float *src) { r = *src; }
+    static void store_ps(float *dest, float a) { *dest = a; }
+    static float add_ps(float a, float b) { return a + b; }
+    static float sub_ps(float a, float b) { return a - b; }
+    static float mul_ps(float a, float b) { return a * b; }
+    static void lanes(float &r, float x0, float step) { r = x0; }
+
+    #if WAVE_KERNEL_SSE
+      static void splat(__m128 &r, float f) { r = _mm_set1_ps(f); }
+      static void load_ps(__m128 &r, const float *src) { r = _mm_loadu_ps(src); }
+      static void store_ps(float *dest, __m128 a) { _mm_storeu_ps(dest, a); }
+      static __m128 add_ps(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+      static __m128 sub_ps(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+      static __m128 mul_ps(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+      static void lanes(__m128 &r, float x0, float step) { r = _mm_add_ps(_mm_set1_ps(x0), _mm_mul_ps(_mm_setr_ps(0, 1, 2, 3), _mm_set1_ps(step))); }
+    #endif
+
+    #if WAVE_KERNEL_AVX2
+      static void splat(__m256 &r, float f) { r = _mm256_set1_ps(f); }
+      static void load_ps(__m256 &r, const float *src) { r = _mm256_loadu_ps(src); }
+      static void store_ps(float *dest, __m256 a) { _mm256_storeu_ps(dest, a); }
+      static __m256 add_ps(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+      static __m256 sub_ps(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+      static __m256 mul_ps(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+      static void lanes(__m256 &r, float x0, float step) { r = _mm256_add_ps(_mm256_set1_ps(x0), _mm256_mul_ps(_mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_ps(step))); }
+    #endif
+
+    // acc + k * v
+    template <class reg> static reg madd(reg acc, float k, reg v) {
+      reg kr;
+      splat(kr, k);
+      return add_ps(acc, mul_ps(kr, v));
+    }
+
+    // acc - k * v
+    template <class reg> static reg msub(reg acc, float k, reg v) {
+      reg kr;
+      splat(kr, k);
+      return sub_ps(acc, mul_ps(kr, v));
+    }
+
+    // the derivative sums of a run of vertices, for finish_frame()
+    struct frame_sums {
+      float s_xx[chunk], s_xy[chunk], s_yy[chunk], c_x[chunk], c_y[chunk];
+    };
+
+    // the sums over the waves for one block of lanes
+    template <class reg> struct wave_sums {
+      reg dx, dy, dz, sxx, sxy, syy, cx, cy;
+
+      wave_sums() {
+        splat(dx, 0.0f); splat(dy, 0.0f); splat(dz, 0.0f);
+        splat(sxx, 0.0f); splat(sxy, 0.0f); splat(syy, 0.0f);
+        splat(cx, 0.0f); splat(cy, 0.0f);
+      }
+
+      // add wave w, whose angle has sin s and cos c here
+      void add(const wave_bank &bank, unsigned w, reg s, reg c) {
+        dx = madd(dx, bank.qa_x[w], c);
+        dy = madd(dy, bank.qa_y[w], c);
+        dz = madd(dz, bank.amplitude[w], s);
+        sxx = madd(sxx, bank.qk_xx[w], s);
+        sxy = madd(sxy, bank.qk_xy[w], s);
+        syy = madd(syy, bank.qk_yy[w], s);
+        cx = madd(cx, bank.ak_x[w], c);
+        cy = madd(cy, bank.ak_y[w], c);
+      }
+
+      // write the lanes for vertices i onwards
+      void store(const wave_frame &out, frame_sums &sums, unsigned i) const {
+        store_ps(out.dx + i, dx);
+        store_ps(out.dy + i, dy);
+        store_ps(out.dz + i, dz);
+        store_ps(sums.s_xx + i, sxx);
+        store_ps(sums.s_xy + i, sxy);
+        store_ps(sums.s_yy + i, syy);
+        store_ps(sums.c_x + i, cx);
+        store_ps(sums.c_y + i, cy);
+      }
+    };
+
+    // evaluate(): the exact sincos of kx * x + the row's ky * y + phase
+    template <class reg> struct row_phase {
+      const wave_bank &bank;
+      const float *row;
+
+      row_phase(const wave_bank &bank, const float *row) : bank(bank), row(row) {
+      }
+
+      void start(unsigned i) {
+      }
+
+      void operator()(unsigned w, unsigned i, reg x, reg &s, reg &c) const {
+        reg kx, r;
+        splat(kx, bank.kx[w]);
+        splat(r, row[w]);
+        sincos(add_ps(mul_ps(kx, x), r), s, c);
+      }
+    };
+
+    // evaluate_stepped(): an exact sincos every reseed vertices from first, rotated through one block of lanes in between
+    template <class reg> struct stepped_phase {
+      enum { width = sizeof(reg) / sizeof(float) };
+      row_phase<reg> exact_phase;
+      unsigned first, reseed;
+      bool exact;
+      float rot_s[wave_bank::max_waves], rot_c[wave_bank::max_waves];
+      reg wave_s[wave_bank::max_waves], wave_c[wave_bank::max_waves];
+
+      stepped_phase(const wave_bank &bank, const float *row, const unsigned *waves, unsigned num_waves, float step, unsigned first, unsigned reseed) :
+        exact_phase(bank, row), first(first), reseed(std::max((unsigned)width, reseed / width * width)), exact(true)
+      {
+        for (unsigned k = 0; k != num_waves; ++k) {
+          unsigned w = waves[k];
+          sincos(bank.kx[w] * step * width, rot_s[w], rot_c[w]);
+        }
+      }
+
+      void start(unsigned i) {
+        exact = (i - first) % reseed == 0;
+      }
+
+      void operator()(unsigned w, unsigned i, reg x, reg &s, reg &c) {
+        if (exact) {
+          exact_phase(w, i, x, wave_s[w], wave_c[w]);
+        } else {
+          reg rs, rc;
+          splat(rs, rot_s[w]);
+          splat(rc, rot_c[w]);
+          reg ps = wave_s[w], pc = wave_c[w];
+          wave_s[w] = add_ps(mul_ps(ps, rc), mul_ps(pc, rs));
+          wave_c[w] = sub_ps(mul_ps(pc, rc), mul_ps(ps, rs));
+        }
+        s = wave_s[w];
+        c = wave_c[w];
+      }
+    };
+
+    // evaluate_cached(): the tabled sin and cos of kx * x + ky * y, rotated through the wave's phase.
+    // the same for every width, so one of these serves all of them.
+    struct cached_phase {
+      const wave_bank &bank;
+      const float *spatial_sin, *spatial_cos;
+      size_t wave_stride;
+
+      cached_phase(const wave_bank &bank, const float *spatial_sin, const float *spatial_cos, size_t wave_stride) :
+        bank(bank), spatial_sin(spatial_sin), spatial_cos(spatial_cos), wave_stride(wave_stride)
+      {
+      }
+
+      void start(unsigned i) {
+      }
+
+      template <class reg> void operator()(unsigned w, unsigned i, reg x, reg &s, reg &c) const {
+        reg ss, sc, ts, tc;
+        load_ps(ss, spatial_sin + w * wave_stride + i);
+        load_ps(sc, spatial_cos + w * wave_stride + i);
+        splat(ts, bank.phase_sin[w]);
+        splat(tc, bank.phase_cos[w]);
+        s = add_ps(mul_ps(ss, tc), mul_ps(sc, ts));
+        c = sub_ps(mul_ps(sc, tc), mul_ps(ss, ts));
+      }
+    };
+    // Adds up the waves for whole blocks of lanes of the vertices (x0 + i * step, y), starting at
+    // vertex i, and returns where it stopped; the caller finishes the run with narrower lanes.
+    // phase(w, i, x, s, c) gives the sin and cos of wave w's angle for the block at i, which is at
+    // grid x positions x. It is all that differs between the entry points.
+    template <class reg, class phase_t> static unsigned row_loop(
+      const wave_bank &bank, const unsigned *waves, unsigned num_waves, const wave_mask *mask,
+      float y, float x0, float step, unsigned i, unsigned n, const wave_frame &out, frame_sums &sums, phase_t &phase
+    ) {
+      const unsigned width = sizeof(reg) / sizeof(float);
+      bool fade = mask && mask->fade;
+      for (; i + width <= n; i += width) {
+        reg x, inv_d;
+        lanes(x, x0 + i * step, step);
+        splat(inv_d, 0.0f);
+        if (fade) inv_d = inverse_distance(x, y, *mask);
+        phase.start(i);
+
+        wave_sums<reg> acc;
+        for (unsigned k = 0; k != num_waves; ++k) {
+          unsigned w = waves[k];
+          reg s, c;
+          phase(w, i, x, s, c);
+          if (fade) {
+            reg weight = fade_weight(inv_d, mask->fade_scale[w]);
+            s = mul_ps(s, weight);
+            c = mul_ps(c, weight);
+          }
+          acc.add(bank, w, s, c);
+        }
+        acc.store(out, sums, i);
+      }
+      return i;
+    }
+    // The same for evaluate_points(): whole blocks of lanes of the points from i, where every wave
+    // is added up and the velocity is wanted too.
+    template <class reg> static unsigned points_loop(
+      const wave_bank &bank, const float *x, const float *y, unsigned i, unsigned n,
+      const wave_frame &out, frame_sums &sums, float *vx, float *vy, float *vz
+    ) {
+      const unsigned width = sizeof(reg) / sizeof(float);
+      for (; i + width <= n; i += width) {
+        reg xs, ys;
+        load_ps(xs, x + i);
+        load_ps(ys, y + i);
+
+        wave_sums<reg> acc;
+        reg wx, wy, wz;
+        splat(wx, 0.0f); splat(wy, 0.0f); splat(wz, 0.0f);
+        for (unsigned w = 0; w != bank.size(); ++w) {
+          reg kx, ky, phase, s, c;
+          splat(kx, bank.kx[w]);
+          splat(ky, bank.ky[w]);
+          splat(phase, bank.phase[w]);
+          sincos(add_ps(add_ps(mul_ps(kx, xs), mul_ps(ky, ys)), phase), s, c);
+          acc.add(bank, w, s, c);
+          wx = msub(wx, bank.qw_x[w], s);
+          wy = msub(wy, bank.qw_y[w], s);
+          wz = madd(wz, bank.aw[w], c);
+        }
+        acc.store(out, sums, i);
+        store_ps(vx + i, wx);
+        store_ps(vy + i, wy);
+        store_ps(vz + i, wz);
+      }
+      return i;
+    }
+
+    // binormal = d/dx (x + dx, -y + dy, dz), tangent = -d/dy of the same, normal = binormal x tangent
+    static void finish_frame(unsigned n, const frame_sums &sums, const wave_frame &out) {
+      for (unsigned i = 0; i != n; ++i) {
+        float bx = 1.0f - sums.s_xx[i], by = -sums.s_xy[i], bz = sums.c_x[i];
+        float tx = sums.s_xy[i], ty = 1.0f + sums.s_yy[i], tz = -sums.c_y[i];
+        if (out.bx) {
+          out.bx[i] = bx; out.by[i] = by; out.bz[i] = bz;
+        }
+        if (out.tx) {
+          out.tx[i] = tx; out.ty[i] = ty; out.tz[i] = tz;
+        }
+        if (out.nx) {
+          float nx = by * tz - bz * ty, ny = bz * tx - bx * tz, nz = bx * ty - by * tx;
+          float len2 = nx * nx + ny * ny + nz * nz;
+          float scale = len2 > 0.0f ? 1.0f / sqrtf(len2) : 0.0f;
+          out.nx[i] = nx * scale; out.ny[i] = ny * scale; out.nz[i] = nz * scale;
+        }
+      }
+    }
+
+  };
+}
+
+#endif
@@ -14,6 +14,7 @@
 #define TWO_PI 6.28318530718f /* TWO PI */
 
 #include <random>
+#include <cfloat>
 #include <fstream>
 
 namespace octet{
@@ -30,6 +31,11 @@ namespace octet{
       uint32_t color;
     };
 
+    //the flat grid for the vertex shader path: grid x, grid row and stitch (see wave_gpu.h)
+    struct grid_vertex {
+      vec3p pos;
+    };
+
     //our struct for the sine wave
     struct sine_wave{
       float amplitude;
@@ -43,12 +49,153 @@ namespace octet{
     };
 
     ref<visual_scene> the_app;
-    mesh *water;
+    mesh *water = nullptr;
+    material *water_material = nullptr;
+
+    //compact 8 byte vertices (wave_vertex.h) instead of my_vertex. choose before init()
+    bool compact = false;
+    compact_scale packing;
+    param_uniform *unpack_param = nullptr;
+    param_uniform *colour_param = nullptr;
+
+    //displace the grid in the vertex shader (wave_gpu.h) instead of on the CPU. choose before init()
+    bool gpu_waves = false;
+    wave_uniforms uniforms;
+    param_uniform *waves_param = nullptr;
+    param_uniform *wave_count_param = nullptr;
+    dynarray<int> grid_key, last_grid_key; //the grid only needs uploading again when this changes
+
+    //where the vertices and indices go each frame (GL buffers, or memory when headless)
+    ref<wave_stream> stream;
+    cpu_wave_stream *cpu_stream = nullptr; //the same stream when headless
+    bool static_indices = true; //the grid topology never changes, so by default the indices are written once
+    bool indices_written = false;
 
     float freq_ = 0.0f, ampli_ = 0.0f, speed_ = 0.0f, steepness_ = 0.0f;
     int num_of_waves = 5;
     size_t mesh_size = 120; //size of our mesh
-    unsigned long long time_step = 0; //the simulation could go on for a really long time
+
+    //knobs for wave_governor. the buffers are made for full detail, so turning these down never reallocates them
+    unsigned detail = 0;              //vertices are 2^detail grid units apart, the sea stays the same size
+    unsigned clip_cells = 64, clip_levels = 6; //the clipmap at full detail
+    unsigned active_waves = ~0u;      //only this many of the tallest waves are added up
+    dynarray<float> wave_weights;     //each wave fades in and out over wave_fade_seconds as active_waves changes
+    float wave_fade_seconds = 0.5f;
+
+    //how far the sea has moved on, and each wave's phase wrapped to [0, 2pi) so the angles stay small
+    //however long the simulation runs. the speeds were tuned at one step of phase per 1/30 s.
+    wave_clock clock;
+    dynarray<double> phases;
+    static double speed_scale() { return 30.0; }
+
+    //a square grid of vertices: the whole fixed ocean, or one level of the clipmap
+    struct grid_patch {
+      int origin_x, origin_y;  //grid position of vertex (0, 0)
+      int spacing;             //grid units between vertices
+      unsigned size;           //vertices along each side
+      int hole_x, hole_y;      //first cell of the hole left for a finer patch
+      int hole_size;           //cells across the hole, 0 for none
+      bool stitch;             //pull the odd vertices on the edge onto the coarser patch outside
+    };
+
+    //a square block of cells of a patch. each visible tile writes its own block of vertices,
+    //including the ones it shares with its neighbours, so culled tiles cost nothing.
+    struct grid_tile {
+      unsigned patch;
+      unsigned first_row, last_row; //vertex rows, last_row - first_row cells
+      unsigned first_col, last_col;
+      size_t first_vertex;          //where the block starts in the vertex buffer
+      unsigned cache_slot;          //its table in phase_cache
+      bool masked;                  //only the waves in mask_waves[mask_first ..] are added up
+      bool mask_fade;
+      unsigned mask_first, mask_count;
+      bool refresh;                 //work the vertices out this frame, rather than between the states in refresh_slots
+      bool keep;                    //save them in refresh_slots[cache_slot] for later frames
+      unsigned ahead;               //work them out for 2^ahead frames from now (see schedule_refresh)
+    };
+
+    dynarray<grid_patch> patches;
+    dynarray<grid_tile> tiles; //the visible tiles, in vertex buffer order
+
+    //culling against the camera
+    wave_frustum frustum;
+    unsigned num_culled_tiles = 0;
+
+    //what the index buffer was last made from, so it is only rewritten when the visible tiles change
+    dynarray<int> index_key, last_index_key;
+    size_t num_indices = 0;
+
+    //camera centred rings of grids instead of one fixed grid. choose before init()
+    bool use_clipmap = false;
+    wave_clipmap clipmap;
+    vec3 camera_pos; //in grid units: x along a row, y down the rows, z height above the sea
+    ref<scene_node> node;
+
+    //how far the waves can move a vertex this frame
+    float max_horizontal = 0.0f, max_height = 0.0f;
+
+    //patches are split into tiles of this many cells along each side, one tile per task
+    enum { tile_cells = 16 };
+    wave_thread_pool workers;
+
+    //structure-of-arrays copy of sine_waves for the vectorised kernel, rebuilt every update
+    wave_bank bank;
+    bool use_simd = true;
+    unsigned phase_reseed = 0; //0 takes sin and cos of every angle, otherwise steps along the rows (see wave_kernel::evaluate_stepped)
+
+    //sin and cos of the part of the angles that stays the same from frame to frame, per tile
+    bool use_phase_cache = false;
+    wave_phase_cache phase_cache;
+    unsigned num_cache_slots = 0;
+
+    //waves shorter than this many pixels where a tile is are left out of it, 0 for all waves everywhere
+    float wave_cull_pixels = 0.0f;
+    float pixel_scale = 0.0f;      //pixels across a unit at a distance of one unit
+    dynarray<float> fade_scale;    //per wave, see wave_mask
+    dynarray<unsigned> mask_waves; //the waves of every masked tile, one after another
+    float mean_waves = 0.0f;
+
+    //the last two refreshes of a tile that isn't worked out every frame, one per cache slot
+    struct refresh_slot {
+      wave_phase_cache::key k;
+      int hole_x, hole_y, hole_size; //of the patch, the vertices in the hole aren't kept
+      unsigned num_states;         //0, 1 or 2 of the states below are for this tile
+      unsigned latest;             //the newest of the two
+      unsigned last_frame;         //frame the newest was made in
+      double time[2];              //clock time each state is for
+      dynarray<float> state[2];    //dx, dy, dz, nx, ny, nz for each vertex of the tile in turn
+
+      refresh_slot(){
+        num_states = 0;
+        latest = 0;
+        last_frame = 0;
+        hole_x = hole_y = hole_size = 0;
+        time[0] = time[1] = 0.0;
+      }
+    };
+
+    //how often the tiles are refreshed, null for every tile every frame
+    ref<wave_refresh_policy> refresh_policy;
+    dynarray<refresh_slot> refresh_slots;
+    dynarray<float> refresh_waves;   //the waves the states were made from
+    wave_bank ahead_banks[4];        //the waves 2, 4 and 8 frames from now
+    dynarray<float> wave_acceleration; //most each wave can accelerate a vertex, grid units per second per second
+    dynarray<unsigned> refresh_order[3]; //tiles to refresh, by priority. kept so their space is reused each frame
+    double frame_delta = 0.0;        //clock time of a frame, for looking ahead
+    unsigned refresh_frame = 0;
+    size_t refresh_budget = 0;       //most vertices refreshed in a frame, 0 for no limit
+    size_t refreshed_vertices = 0;
+
+    //fixed point steps sample() takes to find the grid position under each point
+    unsigned sample_iterations = 8;
+
+  public:
+    //which model makes the sea
+    enum engine_kind { engine_gerstner, engine_fft };
+
+  private:
+    engine_kind engine = engine_gerstner;
+    wave_fft fft;
 
     random rand; // random number for wave pos
 
@@ -60,39 +207,518 @@ namespace octet{
       return 0xff000000 + ((int)(r*255.0f) << 0) + ((int)(g*255.0f) << 8) + ((int)(b*255.0f) << 16);
     }
 
-    vec3 gerstner_wave_position(int x_pos, int y_pos){
+    //scalar reference: displacement at a grid position, and the normal from the same sin and cos
+    //(see wave_kernel.h for the derivatives)
+    vec3 gerstner_wave_position(int x_pos, int y_pos, vec3 *normal = nullptr){
       //store the Gerstner wave function to a vector
       vec3 wavePosition;
+      vec3 binormal(1.0f, 0.0f, 0.0f), tangent(0.0f, 1.0f, 0.0f);
 
       //for each sine wave
       for (unsigned i = 0; i < sine_waves.size(); ++i){
-        sine_wave wave = sine_waves[i];
+        const sine_wave &wave = sine_waves[i];
+
+        float angle = (wave.frequency * wave.direction.dot(vec3(x_pos, y_pos, 0.0f))) + (float)phases[i];
+        float c = cosf(angle), s = sinf(angle);
+        //faded the same way as in build_bank, so this matches the kernels while the governor sheds waves
+        float amplitude = wave.amplitude * get_wave_weight(i);
+        float qa = wave.steepness * amplitude;
+        vec3 k = wave.direction * wave.frequency;
 
-        float angle = (wave.frequency * wave.direction.dot(vec3(x_pos, y_pos, 0.0f))) + wave.speed * time_step;
         //add to our position vector
-        wavePosition.x() += (wave.steepness * wave.amplitude) * wave.direction.x() * cosf(angle);
-        wavePosition.y() += (wave.steepness * wave.amplitude) * wave.direction.y() * cosf(angle);
-        wavePosition.z() += wave.amplitude * sinf(angle);
+        wavePosition.x() += qa * wave.direction.x() * c;
+        wavePosition.y() += qa * wave.direction.y() * c;
+        wavePosition.z() += amplitude * s;
+
+        //rows run down the grid, so the tangent is minus the y derivative
+        binormal += vec3(-qa * wave.direction.x() * k.x() * s, -qa * wave.direction.y() * k.x() * s, amplitude * k.x() * c);
+        tangent += vec3(qa * wave.direction.x() * k.y() * s, qa * wave.direction.y() * k.y() * s, -amplitude * k.y() * c);
       }
+      if (normal) *normal = binormal.cross(tangent).normalize();
       return wavePosition;
     }
 
-    vec3 gerstner_wave_normals(vec3 point_position){
-      //store the Gerstner wave function to a vector
-      vec3 normal;
-      //for each sine wave
+
+    //move every wave's phase on by dt seconds at its current speed
+    void advance_phases(double dt){
+      unsigned old_size = phases.size();
+      phases.resize(sine_waves.size());
+      for (unsigned i = old_size; i < phases.size(); ++i){
+        phases[i] = 0.0;
+      }
       for (unsigned i = 0; i < sine_waves.size(); ++i){
-        sine_wave wave = sine_waves[i];
+        phases[i] = phase_after(i, dt);
+      }
+    }
+
+    //phase of wave i dt seconds from now, wrapped to [0, 2pi)
+    double phase_after(unsigned i, double dt) const{
+      const double two_pi = 6.283185307179586;
+      double phase = fmod(phases[i] + sine_waves[i].speed * speed_scale() * dt, two_pi);
+      return phase < 0.0 ? phase + two_pi : phase;
+    }
+
+    //copy the hot parameters of every wave into the bank for this time step
+    void build_bank(){
+      if (phases.size() != sine_waves.size()) advance_phases(0.0);
+      bank.resize(sine_waves.size());
+      max_horizontal = 0.0f;
+      max_height = 0.0f;
+      for (unsigned i = 0; i < bank.size(); ++i){
+        const sine_wave &wave = sine_waves[i];
+        float amplitude = wave.amplitude * get_wave_weight(i);
+        bank.set(i, wave.frequency, wave.steepness, amplitude, wave.direction, (float)phases[i], (float)(wave.speed * speed_scale()));
+        max_horizontal += fabsf(wave.steepness * amplitude) * std::max(fabsf(wave.direction.x()), fabsf(wave.direction.y()));
+        max_height += fabsf(amplitude);
+      }
+    }
+
+    //move each wave's weight dt seconds towards 1 if it is one of the active_waves tallest, 0 if not
+    void fade_waves(double dt){
+      unsigned num_waves = sine_waves.size(), old_size = wave_weights.size();
+      wave_weights.resize(num_waves);
+      for (unsigned i = old_size; i < num_waves; ++i){
+        wave_weights[i] = 1.0f;
+      }
+      float step = wave_fade_seconds > 0.0f ? (float)dt / wave_fade_seconds : 1.0f;
+      for (unsigned i = 0; i != num_waves; ++i){
+        float amplitude = fabsf(sine_waves[i].amplitude);
+        unsigned taller = 0;
+        for (unsigned j = 0; j != num_waves; ++j){
+          float other = fabsf(sine_waves[j].amplitude);
+          if (other > amplitude || (other == amplitude && j < i)) taller++;
+        }
+        float &weight = wave_weights[i];
+        weight = taller < active_waves ? std::min(weight + step, 1.0f) : std::max(weight - step, 0.0f);
+      }
+    }
+
+    //the bank as it will be ahead seconds from now, for tiles worked out ahead of time
+    void build_bank_ahead(wave_bank &dest, double ahead){
+      dest.resize(sine_waves.size());
+      for (unsigned i = 0; i < dest.size(); ++i){
+        const sine_wave &wave = sine_waves[i];
+        dest.set(i, wave.frequency, wave.steepness, wave.amplitude * get_wave_weight(i), wave.direction, (float)phase_after(i, ahead), (float)(wave.speed * speed_scale()));
+      }
+    }
 
-        float radians = wave.frequency * wave.direction.dot(point_position) + wave.speed * time_step;
+    //choose the grids to evaluate this frame and split them into tiles
+    void build_patches(){
+      patches.resize(0);
+      if (use_clipmap) {
+        clipmap.update(camera_pos.x(), camera_pos.y(), camera_pos.z());
+        for (unsigned i = clipmap.get_first_visible(); i != clipmap.get_num_levels(); ++i) {
+          const wave_clipmap::level &lev = clipmap.get_level(i);
+          grid_patch patch;
+          patch.origin_x = lev.origin_x;
+          patch.origin_y = lev.origin_y;
+          patch.spacing = lev.spacing;
+          patch.size = clipmap.get_level_size();
+          patch.hole_x = lev.hole_x;
+          patch.hole_y = lev.hole_y;
+          patch.hole_size = lev.has_hole ? clipmap.get_hole_cells() : 0;
+          patch.stitch = i + 1 != clipmap.get_num_levels();
+          patches.push_back(patch);
+        }
+      } else {
+        grid_patch patch = { 0, 0, 1 << detail, (unsigned)((mesh_size - 1) >> detail) + 1, 0, 0, 0, false };
+        patches.push_back(patch);
+      }
+    }
+
+    //true if every cell of the block is covered by a finer patch
+    static bool in_hole(const grid_patch &patch, unsigned first_row, unsigned last_row, unsigned first_col, unsigned last_col){
+      return patch.hole_size &&
+        (int)first_row >= patch.hole_y && (int)last_row <= patch.hole_y + patch.hole_size &&
+        (int)first_col >= patch.hole_x && (int)last_col <= patch.hole_x + patch.hole_size;
+    }
 
-        normal.x() += (wave.steepness * wave.amplitude) * wave.direction.x() * cosf(radians);
-        normal.y() += -(wave.steepness * wave.amplitude) * wave.direction.y() * cosf(radians);
-        normal.z() = (wave.steepness * wave.amplitude) * sinf(radians);
+    //conservative bounds of a block of a patch in the mesh's space, allowing for the biggest waves
+    aabb get_bounds(const grid_patch &patch, unsigned first_row, unsigned last_row, unsigned first_col, unsigned last_col) const{
+      float x0 = (float)(patch.origin_x + (int)first_col * patch.spacing) - max_horizontal;
+      float x1 = (float)(patch.origin_x + (int)last_col * patch.spacing) + max_horizontal;
+      //rows run down the grid
+      float y0 = -(float)(patch.origin_y + (int)last_row * patch.spacing) - max_horizontal;
+      float y1 = -(float)(patch.origin_y + (int)first_row * patch.spacing) + max_horizontal;
+      return aabb(vec3((x0 + x1) * 0.5f, (y0 + y1) * 0.5f, 0.0f), vec3((x1 - x0) * 0.5f, (y1 - y0) * 0.5f, max_height));
+    }
+
+    //split the patches into tiles, drop the ones outside the frustum and give the rest their place in the vertex buffer
+    void build_tiles(){
+      tiles.resize(0);
+      index_key.resize(0);
+      num_culled_tiles = 0;
+      num_cache_slots = 0;
+      size_t first_vertex = 0;
+      for (unsigned p = 0; p != patches.size(); ++p) {
+        const grid_patch &patch = patches[p];
+        unsigned cells = patch.size - 1;
+        unsigned across = (cells + tile_cells - 1) / tile_cells;
+        for (unsigned row = 0; row < cells; row += tile_cells) {
+          for (unsigned col = 0; col < cells; col += tile_cells) {
+            unsigned slot = num_cache_slots + row / tile_cells * across + col / tile_cells;
+            //all the waves, worked out this frame, until build_wave_masks and schedule_refresh say otherwise
+            grid_tile tile = {
+              p, row, std::min(row + tile_cells, cells), col, std::min(col + tile_cells, cells), first_vertex, slot,
+              false, false, 0, 0,
+              true, false, 0
+            };
+            if (in_hole(patch, tile.first_row, tile.last_row, tile.first_col, tile.last_col)) continue;
+            if (!frustum.intersects(get_bounds(patch, tile.first_row, tile.last_row, tile.first_col, tile.last_col))) {
+              num_culled_tiles++;
+              continue;
+            }
+            first_vertex += (tile.last_row - tile.first_row + 1) * (tile.last_col - tile.first_col + 1);
+            tiles.push_back(tile);
+
+            int key[] = { (int)p, patch.hole_x, patch.hole_y, patch.hole_size, (int)row, (int)col };
+            for (unsigned k = 0; k != sizeof(key) / sizeof(key[0]); ++k) {
+              index_key.push_back(key[k]);
+            }
+          }
+        }
+        num_cache_slots += across * across;
       }
-      return normal;
     }
 
+    //the cache only feeds the vectorised Gerstner kernel
+    bool phase_cache_active() const{
+      return use_phase_cache && use_simd && engine == engine_gerstner && !gpu_waves;
+    }
+
+    //the block of the grid a tile covers
+    wave_phase_cache::key get_tile_key(const grid_tile &tile) const{
+      const grid_patch &patch = patches[tile.patch];
+      wave_phase_cache::key k = {
+        patch.origin_x + (int)tile.first_col * patch.spacing, patch.origin_y + (int)tile.first_row * patch.spacing, patch.spacing,
+        tile.last_row - tile.first_row + 1, tile.last_col - tile.first_col + 1
+      };
+      return k;
+    }
+
+    //distance from the camera to the nearest and furthest points of a tile, in grid units
+    void get_tile_distance(const grid_tile &tile, float &near_d, float &far_d) const{
+      const grid_patch &patch = patches[tile.patch];
+      float cx = camera_pos.x(), cy = camera_pos.y(), cz2 = camera_pos.z() * camera_pos.z();
+      float x0 = (float)(patch.origin_x + (int)tile.first_col * patch.spacing), x1 = (float)(patch.origin_x + (int)tile.last_col * patch.spacing);
+      float y0 = (float)(patch.origin_y + (int)tile.first_row * patch.spacing), y1 = (float)(patch.origin_y + (int)tile.last_row * patch.spacing);
+      float near_x = std::max(std::max(x0 - cx, cx - x1), 0.0f), near_y = std::max(std::max(y0 - cy, cy - y1), 0.0f);
+      float far_x = std::max(fabsf(x0 - cx), fabsf(x1 - cx)), far_y = std::max(fabsf(y0 - cy), fabsf(y1 - cy));
+      near_d = sqrtf(near_x * near_x + near_y * near_y + cz2);
+      far_d = sqrtf(far_x * far_x + far_y * far_y + cz2);
+    }
+
+    //masks are only used by the vectorised Gerstner kernel
+    bool masks_usable() const{
+      return use_simd && engine == engine_gerstner && !gpu_waves;
+    }
+
+    bool wave_culling_active() const{
+      return wave_cull_pixels > 0.0f && pixel_scale > 0.0f && masks_usable();
+    }
+
+    //choose the waves each tile needs. waves faded right out by set_active_waves() are dropped everywhere.
+    //with culling, a wave is dropped from a tile if it is shorter than wave_cull_pixels everywhere in it,
+    //and faded out between one and two times that.
+    void build_wave_masks(){
+      mask_waves.resize(0);
+      unsigned num_waves = bank.size(), num_weighted = 0;
+      for (unsigned w = 0; w != num_waves; ++w) {
+        if (get_wave_weight(w) > 0.0f) num_weighted++;
+      }
+      bool culling = wave_culling_active();
+      if (!masks_usable() || (!culling && num_weighted == num_waves)) {
+        for (unsigned t = 0; t != tiles.size(); ++t) {
+          tiles[t].masked = false;
+        }
+        mean_waves = (float)num_waves;
+        return;
+      }
+
+      if (culling) {
+        fade_scale.resize(num_waves);
+        for (unsigned w = 0; w != num_waves; ++w) {
+          float k = sqrtf(bank.kx[w] * bank.kx[w] + bank.ky[w] * bank.ky[w]);
+          fade_scale[w] = k > 0.0f ? TWO_PI / k * pixel_scale / wave_cull_pixels : FLT_MAX;
+        }
+      }
+
+      double total_waves = 0.0, total_vertices = 0.0;
+      for (unsigned t = 0; t != tiles.size(); ++t) {
+        grid_tile &tile = tiles[t];
+        float near_d = 0.0f, far_d = 0.0f;
+        if (culling) get_tile_distance(tile, near_d, far_d);
+
+        tile.masked = true;
+        tile.mask_fade = false;
+        tile.mask_first = mask_waves.size();
+        for (unsigned w = 0; w != num_waves; ++w) {
+          if (get_wave_weight(w) == 0.0f) continue;
+          if (culling && fade_scale[w] <= near_d) continue;
+          mask_waves.push_back(w);
+          if (culling && fade_scale[w] < 2.0f * far_d) tile.mask_fade = true;
+        }
+        tile.mask_count = mask_waves.size() - tile.mask_first;
+
+        double vertices = (double)(tile.last_row - tile.first_row + 1) * (tile.last_col - tile.first_col + 1);
+        total_waves += tile.mask_count * vertices;
+        total_vertices += vertices;
+      }
+      mean_waves = total_vertices > 0.0 ? (float)(total_waves / total_vertices) : 0.0f;
+    }
+
+    //the mask for a tile, or null for all the waves
+    const wave_mask *get_mask(const grid_tile &tile, wave_mask &mask) const{
+      if (!tile.masked) return nullptr;
+      mask.waves = mask_waves.data() + tile.mask_first;
+      mask.count = tile.mask_count;
+      mask.fade = tile.mask_fade;
+      mask.camera_x = camera_pos.x();
+      mask.camera_y = camera_pos.y();
+      mask.camera_z2 = camera_pos.z() * camera_pos.z();
+      mask.fade_scale = fade_scale.data();
+      return &mask;
+    }
+
+    //look up every tile being refreshed, before the workers start
+    void begin_phase_cache(){
+      phase_cache.begin_frame(bank, num_cache_slots);
+      for (unsigned t = 0; t != tiles.size(); ++t) {
+        if (tiles[t].refresh) phase_cache.lookup(tiles[t].cache_slot, get_tile_key(tiles[t]));
+      }
+    }
+
+    //tiles are only blended between frames when the CPU adds up the waves
+    bool refresh_active() const{
+      return refresh_policy && use_simd && engine == engine_gerstner && !gpu_waves;
+    }
+
+    //true if the waves differ from the ones the saved states were made from
+    bool refresh_waves_changed(){
+      const dynarray<float> *arrays[] = { &bank.kx, &bank.ky, &bank.amplitude, &bank.qa_x, &bank.qa_y };
+      unsigned n = bank.size(), num_arrays = sizeof(arrays) / sizeof(arrays[0]);
+      bool same = refresh_waves.size() == n * num_arrays;
+      for (unsigned a = 0; same && a != num_arrays; ++a) {
+        same = memcmp(refresh_waves.data() + a * n, arrays[a]->data(), n * sizeof(float)) == 0;
+      }
+      if (same) return false;
+      refresh_waves.resize(n * num_arrays);
+      for (unsigned a = 0; a != num_arrays; ++a) {
+        if (n) memcpy(refresh_waves.data() + a * n, arrays[a]->data(), n * sizeof(float));
+      }
+      return true;
+    }
+
+    //choose the tiles to work out this frame. a tile with an interval of k frames is worked out for
+    //k frames ahead, on frames chosen by its slot so the tiles share out the work, and in between it is
+    //a blend of its last two states. a tile the budget left out is due every frame until it gets a turn,
+    //holding its newest state until then.
+    void schedule_refresh(){
+      refreshed_vertices = 0;
+      if (!refresh_active()) {
+        for (unsigned t = 0; t != tiles.size(); ++t) {
+          tiles[t].refresh = true;
+          tiles[t].keep = false;
+          tiles[t].ahead = 0;
+        }
+        refresh_slots.reset();
+        refresh_waves.reset();
+        refreshed_vertices = get_tile_vertices();
+        return;
+      }
+
+      double now = clock.get_seconds();
+      bool changed = refresh_waves_changed();
+      for (unsigned a = 1; a != 4; ++a) {
+        build_bank_ahead(ahead_banks[a], frame_delta * (1 << a));
+      }
+      wave_acceleration.resize(bank.size());
+      for (unsigned w = 0; w != bank.size(); ++w) {
+        float omega = sine_waves[w].speed * (float)speed_scale();
+        float reach = fabsf(bank.amplitude[w]) + sqrtf(bank.qa_x[w] * bank.qa_x[w] + bank.qa_y[w] * bank.qa_y[w]);
+        wave_acceleration[w] = reach * omega * omega;
+      }
+      if (refresh_slots.size() < num_cache_slots) refresh_slots.resize(num_cache_slots);
+      refresh_frame++;
+
+      //0: tiles that can't be blended yet, 1: tiles the budget left out before, 2: tiles due this frame
+      dynarray<unsigned> *order = refresh_order;
+      for (unsigned o = 0; o != 3; ++o) {
+        order[o].resize(0);
+      }
+      for (unsigned t = 0; t != tiles.size(); ++t) {
+        grid_tile &tile = tiles[t];
+        refresh_slot &slot = refresh_slots[tile.cache_slot];
+        wave_phase_cache::key k = get_tile_key(tile);
+
+        //states that are too old (the tile has been off screen) can't be blended either
+        bool stale = refresh_frame - slot.last_frame > 2 * wave_refresh_policy::max_interval;
+        bool rewound = slot.num_states == 2 && now < slot.time[slot.latest ^ 1];
+        const grid_patch &patch = patches[tile.patch];
+        bool same_hole = slot.hole_x == patch.hole_x && slot.hole_y == patch.hole_y && slot.hole_size == patch.hole_size;
+        if (changed || stale || rewound || !same_hole || !(slot.k == k)) {
+          slot.k = k;
+          slot.hole_x = patch.hole_x;
+          slot.hole_y = patch.hole_y;
+          slot.hole_size = patch.hole_size;
+          slot.num_states = 0;
+        }
+
+        wave_refresh_policy::tile_info info;
+        get_tile_distance(tile, info.near_distance, info.far_distance);
+        info.spacing = patch.spacing;
+        info.vertices = k.rows * k.cols;
+        info.frame_time = (float)frame_delta;
+        info.acceleration = 0.0f;
+        for (unsigned m = 0, num_waves = tile.masked ? tile.mask_count : bank.size(); m != num_waves; ++m) {
+          info.acceleration += wave_acceleration[tile.masked ? mask_waves[tile.mask_first + m] : m];
+        }
+        unsigned interval = std::max(1u, std::min(refresh_policy->get_interval(info), (unsigned)wave_refresh_policy::max_interval));
+        unsigned ahead = 0;
+        while (interval >> (ahead + 1)) ahead++;
+        interval = 1 << ahead;
+
+        tile.refresh = true;
+        tile.keep = interval > 1 && frame_delta > 0.0;
+        tile.ahead = 0;
+        if (!tile.keep) {
+          slot.num_states = 0;
+          refreshed_vertices += info.vertices;
+          continue;
+        }
+
+        //the first state is for now, the rest for interval frames ahead
+        if (slot.num_states) tile.ahead = ahead;
+        unsigned age = refresh_frame - slot.last_frame;
+        if (slot.num_states < 2) {
+          order[0].push_back(t);
+        } else if (age > interval) {
+          order[1].push_back(t);
+        } else if (age == interval || (refresh_frame + tile.cache_slot) % interval == 0) {
+          order[2].push_back(t);
+        } else {
+          tile.refresh = false;
+        }
+      }
+
+      for (unsigned o = 0; o != 3; ++o) {
+        for (unsigned i = 0; i != order[o].size(); ++i) {
+          grid_tile &tile = tiles[order[o][i]];
+          refresh_slot &slot = refresh_slots[tile.cache_slot];
+          unsigned vertices = slot.k.rows * slot.k.cols;
+          if (o != 0 && refresh_budget && refreshed_vertices + vertices > refresh_budget) {
+            tile.refresh = false;
+            continue;
+          }
+          refreshed_vertices += vertices;
+
+          //the new state goes over the older of the two
+          if (slot.num_states) slot.latest ^= 1;
+          slot.num_states = std::min(slot.num_states + 1, 2u);
+          slot.time[slot.latest] = now + frame_delta * (tile.ahead ? 1 << tile.ahead : 0);
+          slot.last_frame = refresh_frame;
+          slot.state[slot.latest].resize(vertices * 6);
+        }
+      }
+    }
+
+    //save a run of freshly made vertices of a tile for later frames
+    void keep_run(const grid_tile &tile, unsigned i, unsigned j, unsigned n, const float *dx, const float *dy, const float *dz, const float *nx, const float *ny, const float *nz){
+      refresh_slot &slot = refresh_slots[tile.cache_slot];
+      float *dest = slot.state[slot.latest].data() + ((i - tile.first_row) * slot.k.cols + (j - tile.first_col)) * 6;
+      for (unsigned k = 0; k != n; ++k) {
+        dest[0] = dx[k]; dest[1] = dy[k]; dest[2] = dz[k];
+        dest[3] = nx[k]; dest[4] = ny[k]; dest[5] = nz[k];
+        dest += 6;
+      }
+    }
+
+    //a run of vertices of a tile for now, from the last two states
+    void blend_run(const grid_tile &tile, unsigned i, unsigned j, unsigned n, float *dx, float *dy, float *dz, float *nx, float *ny, float *nz){
+      const refresh_slot &slot = refresh_slots[tile.cache_slot];
+      double start = slot.time[slot.latest ^ 1], span = slot.time[slot.latest] - start;
+      //a tile the budget has held back past its newest state stays there
+      float t = span > 0.0 ? (float)std::min((clock.get_seconds() - start) / span, 1.0) : 1.0f;
+      size_t offset = ((i - tile.first_row) * slot.k.cols + (j - tile.first_col)) * 6;
+      const float *a = slot.state[slot.latest ^ 1].data() + offset, *b = slot.state[slot.latest].data() + offset;
+      for (unsigned k = 0; k != n; ++k) {
+        dx[k] = a[0] + (b[0] - a[0]) * t;
+        dy[k] = a[1] + (b[1] - a[1]) * t;
+        dz[k] = a[2] + (b[2] - a[2]) * t;
+        vec3 normal(a[3] + (b[3] - a[3]) * t, a[4] + (b[4] - a[4]) * t, a[5] + (b[5] - a[5]) * t);
+        normal = normal.normalize();
+        nx[k] = normal.x(); ny[k] = normal.y(); nz[k] = normal.z();
+        a += 6;
+        b += 6;
+      }
+    }
+
+    //vertices in the visible tiles
+    size_t get_tile_vertices() const{
+      if (tiles.empty()) return 0;
+      const grid_tile &tile = tiles[tiles.size() - 1];
+      return tile.first_vertex + (tile.last_row - tile.first_row + 1) * (tile.last_col - tile.first_col + 1);
+    }
+
+    //vertices needed for a patch of size vertices when every tile is drawn
+    static size_t get_tiled_vertices(unsigned size){
+      unsigned cells = size - 1;
+      unsigned side = cells / tile_cells * (tile_cells + 1) + (cells % tile_cells ? cells % tile_cells + 1 : 0);
+      return (size_t)side * side;
+    }
+
+    //the compact format needs to know the area covered and how far the waves can move a vertex
+    void fit_packing(){
+      int min_x = patches[0].origin_x, min_y = patches[0].origin_y, max_x = min_x, max_y = min_y;
+      for (unsigned p = 0; p != patches.size(); ++p) {
+        const grid_patch &patch = patches[p];
+        int extent = (patch.size - 1) * patch.spacing;
+        min_x = std::min(min_x, patch.origin_x);
+        min_y = std::min(min_y, patch.origin_y);
+        max_x = std::max(max_x, patch.origin_x + extent);
+        max_y = std::max(max_y, patch.origin_y + extent);
+      }
+      packing.fit((float)min_x, (float)min_y, (float)std::max(max_x - min_x, max_y - min_y), max_horizontal, max_height);
+    }
+
+    //room in the vertex buffer for every tile
+    size_t get_vertex_capacity() const{
+      return use_clipmap ? clip_levels * get_tiled_vertices(clip_cells + 1) : get_tiled_vertices((unsigned)mesh_size);
+    }
+
+    size_t get_vertex_size() const{
+      return gpu_waves ? sizeof(grid_vertex) : compact ? sizeof(compact_vertex) : sizeof(my_vertex);
+    }
+
+    static bool same_key(const dynarray<int> &a, const dynarray<int> &b){
+      return a.size() == b.size() && (a.empty() || !memcmp(a.data(), b.data(), a.size() * sizeof(int)));
+    }
+
+    static void copy_key(dynarray<int> &dest, const dynarray<int> &src){
+      dest.resize(src.size());
+      if (src.size()) memcpy(dest.data(), src.data(), src.size() * sizeof(int));
+    }
+
+    //the visible tiles and where their patches are, which is all the flat grid depends on
+    void build_grid_key(){
+      copy_key(grid_key, index_key);
+      for (unsigned p = 0; p != patches.size(); ++p) {
+        grid_key.push_back(patches[p].origin_x);
+        grid_key.push_back(patches[p].origin_y);
+        grid_key.push_back(patches[p].spacing);
+        grid_key.push_back(patches[p].stitch);
+      }
+    }
+
+    //odd vertices on the edge of a stitched patch lie halfway between their neighbours:
+    //+spacing for the ones either side along the row, -spacing for the rows either side, 0 for neither
+    static int get_stitch(const grid_patch &patch, unsigned row, unsigned col){
+      if (!patch.stitch) return 0;
+      unsigned last = patch.size - 1;
+      if ((row == 0 || row == last) && (col & 1)) return patch.spacing;
+      if ((col == 0 || col == last) && (row & 1)) return -patch.spacing;
+      return 0;
+    }
 
     //generate the wave simulation by making the sine waves
     void generate_waves(){
@@ -113,8 +739,492 @@ namespace octet{
       }
     }
 
+    //displacement, normal and velocity of the sea at n <= chunk grid positions anywhere
+    void displace_points(const float *x, const float *y, unsigned n, float *dx, float *dy, float *dz, float *nx, float *ny, float *nz, float *vx, float *vy, float *vz){
+      if (engine == engine_fft && !gpu_waves) {
+        //the nearest vertex of the FFT grid, which doesn't keep a velocity
+        for (unsigned k = 0; k != n; ++k) {
+          fft.evaluate((int)floorf(y[k] + 0.5f), (int)floorf(x[k] + 0.5f), 1, 1, dx + k, dy + k, dz + k, nx + k, ny + k, nz + k);
+          if (vx) vx[k] = vy[k] = vz[k] = 0.0f;
+        }
+        return;
+      }
+      wave_kernel::evaluate_points(bank, x, y, n, wave_frame(dx, dy, dz, nx, ny, nz), vx, vy, vz);
+    }
+
+    //sample() for n <= chunk points
+    void sample_run(const vec3 *points, unsigned n, const mat4t &modelToWorld, const mat4t &worldToModel, vec3_in up, float *heights, vec3 *normals, vec3 *velocities){
+      float qx[wave_kernel::chunk], qy[wave_kernel::chunk], x[wave_kernel::chunk], y[wave_kernel::chunk];
+      float dx[wave_kernel::chunk], dy[wave_kernel::chunk], dz[wave_kernel::chunk];
+      float nx[wave_kernel::chunk], ny[wave_kernel::chunk], nz[wave_kernel::chunk];
+      float vx[wave_kernel::chunk], vy[wave_kernel::chunk], vz[wave_kernel::chunk];
+      for (unsigned k = 0; k != n; ++k) {
+        vec3 local = (vec4(points[k], 1.0f) * worldToModel).xyz();
+        //rows run down the grid
+        qx[k] = x[k] = local.x();
+        qy[k] = y[k] = -local.y();
+      }
+
+      //the wave from grid position p ends up over p + d(p), so look for p = q - d(p) starting from q
+      for (unsigned step = 0; step != sample_iterations; ++step) {
+        displace_points(x, y, n, dx, dy, dz, nx, ny, nz, nullptr, nullptr, nullptr);
+        for (unsigned k = 0; k != n; ++k) {
+          x[k] = qx[k] - dx[k];
+          y[k] = qy[k] + dy[k];
+        }
+      }
+      displace_points(x, y, n, dx, dy, dz, nx, ny, nz, vx, vy, vz);
+
+      for (unsigned k = 0; k != n; ++k) {
+        vec3 surface = (vec4(x[k] + dx[k], -y[k] + dy[k], dz[k], 1.0f) * modelToWorld).xyz();
+        if (heights) heights[k] = surface.dot(up);
+        if (normals) normals[k] = (vec4(nx[k], ny[k], nz[k], 0.0f) * modelToWorld).xyz().normalize();
+        if (velocities) velocities[k] = (vec4(vx[k], vy[k], vz[k], 0.0f) * modelToWorld).xyz();
+      }
+    }
+
   public:
-    wave_mesh(){}
+    wave_mesh(){
+      //tiles go to the app's shared job scheduler, which leaves one core for the render thread
+    }
+
+    //give update() a job scheduler of its own with this many worker threads, 0 evaluates everything on the render thread
+    void set_num_threads(unsigned num_threads){
+      workers.resize(num_threads);
+    }
+
+    //run the tiles on someone else's job scheduler, such as job_scheduler::get_shared()
+    void set_scheduler(job_scheduler *scheduler){
+      workers.share(scheduler);
+    }
+
+    unsigned get_num_threads() const{
+      return workers.size();
+    }
+
+    //switch between the Gerstner sum and the FFT ocean. can be changed at any time.
+    void set_engine(engine_kind value){
+      engine = value;
+    }
+
+    engine_kind get_engine() const{
+      return engine;
+    }
+
+    //spectrum used by the FFT engine
+    void set_fft_params(const wave_fft::spectrum_params &params){
+      fft.set_params(params);
+    }
+
+    const wave_fft::spectrum_params &get_fft_params() const{
+      return fft.get_params();
+    }
+
+    //choose between the vectorised kernel and the scalar reference path
+    void set_simd(bool value){
+      use_simd = value;
+    }
+
+    bool get_simd() const{
+      return use_simd;
+    }
+
+    //advance sin and cos along each row by rotation, with exact values every reseed vertices.
+    //0 goes back to exact values everywhere. only used by the vectorised kernel.
+    void set_phase_stepping(unsigned reseed){
+      phase_reseed = reseed;
+    }
+
+    unsigned get_phase_stepping() const{
+      return phase_reseed;
+    }
+
+    //keep the sin and cos of the spatial part of every wave angle for each tile, so a frame only
+    //rotates them through the time part. false frees the tables.
+    void set_phase_cache(bool value){
+      use_phase_cache = value;
+      if (!value) phase_cache.reset();
+    }
+
+    bool get_phase_cache() const{
+      return use_phase_cache;
+    }
+
+    //bytes held by the phase cache
+    size_t get_phase_cache_bytes() const{
+      return phase_cache.get_bytes();
+    }
+
+    //fraction of the visible tiles whose tables were already made in the last update
+    float get_phase_cache_hit_rate() const{
+      return phase_cache.get_hit_rate();
+    }
+
+    //refresh distant tiles less often than every frame as the policy says (see wave_refresh.h),
+    //null to refresh every tile every frame
+    void set_refresh_policy(wave_refresh_policy *value){
+      refresh_policy = value;
+      refresh_slots.reset();
+    }
+
+    wave_refresh_policy *get_refresh_policy() const{
+      return refresh_policy;
+    }
+
+    //most vertices refreshed in a frame, 0 for no limit. tiles that have nothing to blend from
+    //are always refreshed, so this can be overrun for a frame or two after a jump
+    void set_refresh_budget(size_t vertices){
+      refresh_budget = vertices;
+    }
+
+    size_t get_refresh_budget() const{
+      return refresh_budget;
+    }
+
+    //vertices worked out in the last update, the rest were blended from earlier frames
+    size_t get_refreshed_vertices() const{
+      return refreshed_vertices;
+    }
+
+    //largest difference between the vectorised kernels and the scalar reference over the whole grid, in
+    //displacement or normal. covers the row kernel (with phase stepping if it is on), the phase cache's
+    //kernel fed from tables made here, and the kernel sample() uses for points anywhere.
+    float max_kernel_error(){
+      build_bank();
+      const unsigned chunk = wave_kernel::chunk;
+      float worst = 0.0f;
+      float out[3][6][chunk];
+      dynarray<float> spatial_sin(bank.size() * chunk), spatial_cos(bank.size() * chunk);
+      float px[chunk], py[chunk];
+      for (size_t i = 0; i != mesh_size; ++i) {
+        for (size_t j = 0; j < mesh_size; j += chunk) {
+          unsigned n = (unsigned)std::min((size_t)chunk, mesh_size - j);
+          evaluate_kernel((float)j, (float)i, 1.0f, n, wave_frame(out[0][0], out[0][1], out[0][2], out[0][3], out[0][4], out[0][5]));
+
+          for (unsigned w = 0; w != bank.size(); ++w) {
+            for (unsigned k = 0; k != n; ++k) {
+              float angle = bank.kx[w] * (float)(j + k) + bank.ky[w] * (float)i;
+              spatial_sin[w * chunk + k] = sinf(angle);
+              spatial_cos[w * chunk + k] = cosf(angle);
+            }
+          }
+          wave_frame cached(out[1][0], out[1][1], out[1][2], out[1][3], out[1][4], out[1][5]);
+          wave_kernel::evaluate_cached(bank, spatial_sin.data(), spatial_cos.data(), chunk, (float)i, (float)j, 1.0f, n, cached);
+
+          for (unsigned k = 0; k != n; ++k) {
+            px[k] = (float)(j + k);
+            py[k] = (float)i;
+          }
+          wave_kernel::evaluate_points(bank, px, py, n, wave_frame(out[2][0], out[2][1], out[2][2], out[2][3], out[2][4], out[2][5]));
+
+          for (unsigned k = 0; k != n; ++k) {
+            vec3 normal;
+            vec3 position = gerstner_wave_position(j + k, i, &normal);
+            for (unsigned v = 0; v != 3; ++v) {
+              vec3 error = (position - vec3(out[v][0][k], out[v][1][k], out[v][2][k])).abs();
+              vec3 normal_error = (normal - vec3(out[v][3][k], out[v][4][k], out[v][5][k])).abs();
+              worst = std::max(worst, std::max(error.x(), std::max(error.y(), error.z())));
+              worst = std::max(worst, std::max(normal_error.x(), std::max(normal_error.y(), normal_error.z())));
+            }
+          }
+        }
+      }
+      return worst;
+    }
+
+    //vertices along each side of the fixed grid. must be called before init()
+    void set_grid_size(size_t size){
+      mesh_size = size;
+    }
+
+    size_t get_grid_size() const{
+      return mesh_size;
+    }
+
+    //how many waves generate_waves() makes, up to wave_bank::max_waves. must be called before init()
+    void set_num_waves(int value){
+      num_of_waves = std::min(value, (int)wave_bank::max_waves);
+    }
+
+    //vertices 2^value grid units apart instead of 1, over the same area of sea. can be changed at
+    //any time: the buffers made by init() are big enough for every detail up to get_max_detail()
+    void set_detail(unsigned value){
+      value = std::min(value, get_max_detail());
+      if (value == detail) return;
+      detail = value;
+      if (use_clipmap) clipmap.init(clip_cells >> detail, clip_levels + detail);
+      indices_written = false;
+    }
+
+    unsigned get_detail() const{
+      return detail;
+    }
+
+    //coarsest detail, keeping at least one tile's worth of cells across each grid
+    unsigned get_max_detail() const{
+      unsigned cells = use_clipmap ? clip_cells : (unsigned)mesh_size - 1, most = 0;
+      while (most < 3 && (cells >> (most + 1)) >= tile_cells) most++;
+      return most;
+    }
+
+    //only add up this many of the tallest waves. the others fade out (and back in) over a fraction
+    //of a second so the sea doesn't jump. only the vectorised kernel skips the faded out waves
+    void set_active_waves(unsigned value){
+      active_waves = value;
+    }
+
+    unsigned get_active_waves() const{
+      return std::min(active_waves, sine_waves.size());
+    }
+
+    //how much of wave i is added in, 0 for not at all
+    float get_wave_weight(unsigned i) const{
+      return i < wave_weights.size() ? wave_weights[i] : 1.0f;
+    }
+
+    void set_wave_fade_seconds(float value){
+      wave_fade_seconds = value;
+    }
+
+    //draw a clipmap of num_levels rings of cells x cells around the camera instead of the fixed grid.
+    //must be called before init()
+    void set_clipmap(bool value, unsigned cells = 64, unsigned num_levels = 6){
+      use_clipmap = value;
+      clip_cells = cells;
+      clip_levels = num_levels;
+      clipmap.init(cells >> detail, num_levels + detail);
+      indices_written = false;
+    }
+
+    bool get_clipmap() const{
+      return use_clipmap;
+    }
+
+    const wave_clipmap &get_clipmap_levels() const{
+      return clipmap;
+    }
+
+    //where the camera is in world space, the clipmap is centred under it
+    void set_camera(vec3_in world_pos){
+      vec3 local = node ? (vec4(world_pos, 1.0f) * node->calcModelToWorld().inverse3x4()).xyz() : world_pos;
+      //rows run down the grid
+      camera_pos = vec3(local.x(), -local.y(), local.z());
+    }
+
+    //cull tiles against the view of this camera. call before update() once the camera has moved.
+    //with the height of the viewport in pixels, the waves are culled for this camera too (see set_wave_culling)
+    void set_camera(camera_instance *cam, int viewport_height = 0){
+      set_camera(cam->get_node()->get_position());
+      if (viewport_height > 0 && !cam->get_is_ortho()) pixel_scale = viewport_height * 0.5f / cam->get_yscale();
+      mat4t modelToProjection, modelToCamera;
+      cam->get_matrices(modelToProjection, modelToCamera, node ? node->calcModelToWorld() : mat4t());
+      frustum.set(modelToProjection);
+    }
+
+    //leave waves out of tiles where they are less than min_pixels long on screen, fading them out
+    //from twice that. 0 adds up every wave everywhere
+    void set_wave_culling(float min_pixels){
+      wave_cull_pixels = min_pixels;
+    }
+
+    float get_wave_culling() const{
+      return wave_cull_pixels;
+    }
+
+    //pixels across a unit at a distance of one unit, set by set_camera() (for headless runs)
+    void set_pixel_scale(float value){
+      pixel_scale = value;
+    }
+
+    //waves added up per vertex in the last update, on average
+    float get_mean_waves_per_vertex() const{
+      return mean_waves;
+    }
+
+    //cull tiles against a model to projection matrix of our own (for headless runs)
+    void set_frustum(const mat4t &modelToProjection){
+      frustum.set(modelToProjection);
+    }
+
+    //draw every tile
+    void clear_frustum(){
+      frustum.clear();
+    }
+
+    //vertices written by the last update, shared tile edges are counted once per tile
+    size_t get_num_vertices() const{
+      return get_tile_vertices();
+    }
+
+    //tiles outside the view in the last update
+    unsigned get_num_culled_tiles() const{
+      return num_culled_tiles;
+    }
+
+    //tiles drawn in the last update
+    unsigned get_num_visible_tiles() const{
+      return tiles.size();
+    }
+
+    //use the 8 byte compact vertex format. must be called before init()
+    void set_compact(bool value){
+      compact = value;
+    }
+
+    bool get_compact() const{
+      return compact;
+    }
+
+    //displace the flat grid with Gerstner waves in the vertex shader, so the vertices are only uploaded
+    //when the visible tiles move. the FFT engine has no shader and is not available in this mode.
+    //must be called before init()
+    void set_gpu_waves(bool value){
+      gpu_waves = value;
+      last_grid_key.resize(0);
+      refresh_slots.reset();
+    }
+
+    bool get_gpu_waves() const{
+      return gpu_waves;
+    }
+
+    //largest difference between the vertex shader (as wave_uniforms::evaluate) and the CPU path over
+    //the tiles of the last update, in position or normal
+    float max_gpu_path_error(){
+      build_bank();
+      uniforms.set(bank);
+      float worst = 0.0f;
+      float d[6][wave_kernel::chunk];
+      for (unsigned t = 0; t != tiles.size(); ++t) {
+        const grid_tile &tile = tiles[t];
+        const grid_patch &patch = patches[tile.patch];
+        for (unsigned i = tile.first_row; i <= tile.last_row; ++i) {
+          for (unsigned j = tile.first_col; j <= tile.last_col; j += wave_kernel::chunk) {
+            unsigned n = std::min((unsigned)wave_kernel::chunk, tile.last_col + 1 - j);
+            evaluate_run(tile, i, j, n, d[0], d[1], d[2], d[3], d[4], d[5]);
+            for (unsigned k = 0; k != n; ++k) {
+              vec3 grid((float)(patch.origin_x + (int)(j + k) * patch.spacing), (float)(patch.origin_y + (int)i * patch.spacing), (float)get_stitch(patch, i, j + k));
+              vec3 pos, normal;
+              uniforms.evaluate(grid, pos, normal);
+              vec3 error = (pos - vec3(grid.x() + d[0][k], -grid.y() + d[1][k], d[2][k])).abs();
+              vec3 normal_error = (normal - vec3(d[3][k], d[4][k], d[5][k])).abs();
+              worst = std::max(worst, std::max(error.x(), std::max(error.y(), error.z())));
+              worst = std::max(worst, std::max(normal_error.x(), std::max(normal_error.y(), normal_error.z())));
+            }
+          }
+        }
+      }
+      return worst;
+    }
+
+    //largest error of the tiles blended in the last update, over the distance from the camera to the vertex
+    //(radians seen from the camera). 0 if no tiles are being carried between frames
+    float max_refresh_error(){
+      float worst = 0.0f;
+      float d[6][wave_kernel::chunk], e[6][wave_kernel::chunk];
+      for (unsigned t = 0; t != tiles.size(); ++t) {
+        const grid_tile &tile = tiles[t];
+        if (!tile.keep || refresh_slots[tile.cache_slot].num_states < 2) continue;
+        const grid_patch &patch = patches[tile.patch];
+        wave_mask mask_storage;
+        const wave_mask *mask = get_mask(tile, mask_storage);
+        for_each_run(tile, [&](unsigned i, unsigned j, unsigned n){
+          int x0 = patch.origin_x + (int)j * patch.spacing, y = patch.origin_y + (int)i * patch.spacing;
+          blend_run(tile, i, j, n, d[0], d[1], d[2], d[3], d[4], d[5]);
+          evaluate_chunk(x0, y, patch.spacing, n, e[0], e[1], e[2], e[3], e[4], e[5], mask);
+          for (unsigned k = 0; k != n; ++k) {
+            //the stitched vertices are averages, leave them out
+            if (patch.stitch && get_stitch(patch, i, j + k)) continue;
+            //rows run down the grid
+            vec3 exact((float)(x0 + (int)k * patch.spacing) + e[0][k], (float)y - e[1][k], e[2][k]);
+            float error = (vec3(e[0][k], e[1][k], e[2][k]) - vec3(d[0][k], d[1][k], d[2][k])).length();
+            worst = std::max(worst, error / std::max((exact - camera_pos).length(), 1.0f));
+          }
+        });
+      }
+      return worst;
+    }
+
+    //the sea at n points in world space, from the waves of the last update, without touching the vertices.
+    //heights[i] is how high the surface is where points[i] is, along get_up(), so points[i] is under water
+    //if points[i].dot(get_up()) < heights[i]. normals, and the velocity of the water at the surface, can be
+    //null. big batches are shared out between the worker threads.
+    void sample(const vec3 *points, size_t n, float *heights, vec3 *normals = nullptr, vec3 *velocities = nullptr){
+      if (n == 0) return;
+      if (bank.size() != sine_waves.size()) build_bank();
+      mat4t modelToWorld = node ? node->calcModelToWorld() : mat4t();
+      mat4t worldToModel = modelToWorld.inverse3x4();
+      vec3 up = get_up();
+
+      unsigned num_runs = (unsigned)((n + wave_kernel::chunk - 1) / wave_kernel::chunk);
+      auto sample_task = [&](unsigned r){
+        size_t first = (size_t)r * wave_kernel::chunk;
+        unsigned count = (unsigned)std::min((size_t)wave_kernel::chunk, n - first);
+        sample_run(
+          points + first, count, modelToWorld, worldToModel, up,
+          heights ? heights + first : nullptr, normals ? normals + first : nullptr, velocities ? velocities + first : nullptr
+        );
+      };
+      workers.run(num_runs, sample_task);
+    }
+
+    //the way up from the sea in world space
+    vec3 get_up() const{
+      return node ? (vec4(0.0f, 0.0f, 1.0f, 0.0f) * node->calcModelToWorld()).xyz().normalize() : vec3(0.0f, 0.0f, 1.0f);
+    }
+
+    //a Gerstner wave moves the water sideways as well as up, so the wave over a point comes from somewhere
+    //else on the grid. sample() finds it in this many fixed point steps, each about steepness times closer.
+    //with the default waves 4 steps get the height to about 4e-3 of the tallest wave, the default 8 to 1e-4
+    void set_sample_iterations(unsigned value){
+      sample_iterations = value;
+    }
+
+    unsigned get_sample_iterations() const{
+      return sample_iterations;
+    }
+
+    //largest height error of sample() at the displaced vertices of the fixed grid, where the height is
+    //known from the scalar reference. only for the Gerstner engine
+    float max_sample_error(){
+      build_bank();
+      mat4t modelToWorld = node ? node->calcModelToWorld() : mat4t();
+      vec3 up = get_up();
+      size_t num_points = mesh_size * mesh_size;
+      dynarray<vec3> points(num_points);
+      dynarray<float> expected(num_points), heights(num_points);
+      for (size_t i = 0; i != mesh_size; ++i) {
+        for (size_t j = 0; j != mesh_size; ++j) {
+          vec3 d = gerstner_wave_position((int)j, (int)i);
+          //rows run down the grid
+          vec3 surface = (vec4((float)j + d.x(), -(float)i + d.y(), d.z(), 1.0f) * modelToWorld).xyz();
+          points[i * mesh_size + j] = surface;
+          expected[i * mesh_size + j] = surface.dot(up);
+        }
+      }
+      sample(points.data(), num_points, heights.data());
+      float worst = 0.0f;
+      for (size_t i = 0; i != num_points; ++i) {
+        worst = std::max(worst, fabsf(heights[i] - expected[i]));
+      }
+      return worst;
+    }
+
+    //tallest the sea can be above its rest height, from the waves of the last update
+    float get_max_height() const{
+      return max_height;
+    }
+
+    //false rewrites the index buffer every frame as the original version did (for comparison)
+    void set_static_indices(bool value){
+      static_indices = value;
+      indices_written = false;
+    }
+
+    //bytes of vertices and indices written by the last update
+    size_t get_frame_upload_bytes() const{
+      return stream ? stream->get_frame_bytes() : 0;
+    }
 
     dynarray<sine_wave> sine_waves;
 
@@ -122,72 +1232,392 @@ namespace octet{
     void init(visual_scene *vs){
 
       this->the_app = vs;
-      param_shader *shader = new param_shader("shaders/default.vs", "shaders/ocean_shader.fs");
-      material *water_material = new material(vec4(1.0f, 0.0f, 0.0f, 1), shader);
+      const char *vertex_shader = gpu_waves ? "shaders/ocean_gerstner.vs" : compact ? "shaders/ocean_compact.vs" : "shaders/default.vs";
+      param_shader *shader = new param_shader(vertex_shader, "shaders/ocean_shader.fs");
+      water_material = new material(vec4(1.0f, 0.0f, 0.0f, 1), shader);
 
       //create a mesh object
       water = new mesh();
 
-      // allocate vertices and indices into OpenGL buffers
-      size_t num_vertices = mesh_size * mesh_size;
-      size_t num_indices = (mesh_size - 1) * (mesh_size - 1) * 6;
-      water->allocate(sizeof(my_vertex) * num_vertices, sizeof(uint32_t) * num_indices);
-      water->set_params(sizeof(my_vertex), num_indices, num_vertices, GL_TRIANGLES, GL_UNSIGNED_INT);
+      // the index buffer is allocated here, the vertices are streamed through a ring of buffers
+      size_t num_vertices = get_vertex_capacity();
+      size_t num_indices = get_max_indices();
+      water->get_indices()->allocate(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * num_indices);
+      water->set_params(get_vertex_size(), num_indices, num_vertices, GL_TRIANGLES, GL_UNSIGNED_INT);
+
+      if (gpu_waves){
+        // only the grid position is in the buffer, the waves and colour are uniforms
+        water->add_attribute(attribute_pos, 3, GL_FLOAT, 0);
+        vec4 zero(0, 0, 0, 0);
+        waves_param = water_material->add_uniform(&zero, app_utils::get_atom("ocean_waves"), GL_FLOAT_VEC4, wave_uniforms::max_waves * 2, param::stage_vertex);
+        wave_count_param = water_material->add_uniform(&zero, app_utils::get_atom("ocean_wave_count"), GL_FLOAT, 1, param::stage_vertex);
+        colour_param = water_material->add_uniform(&zero, app_utils::get_atom("ocean_colour"), GL_FLOAT_VEC4, 1, param::stage_vertex);
+      } else if (compact){
+        // describe the structure of compact_vertex to OpenGL, the colour and scales are uniforms
+        water->add_attribute(attribute_pos, 3, GL_UNSIGNED_SHORT, 0);
+        water->add_attribute(attribute_normal, 2, GL_BYTE, 6, GL_TRUE);
+        vec4 zero(0, 0, 0, 0);
+        unpack_param = water_material->add_uniform(&zero, app_utils::get_atom("ocean_unpack"), GL_FLOAT_VEC4, 1, param::stage_vertex);
+        colour_param = water_material->add_uniform(&zero, app_utils::get_atom("ocean_colour"), GL_FLOAT_VEC4, 1, param::stage_vertex);
+      } else {
+        // describe the structure of my_vertex to OpenGL
+        water->add_attribute(attribute_pos, 3, GL_FLOAT, 0);
+        water->add_attribute(attribute_normal, 3, GL_FLOAT, 12);
+        water->add_attribute(attribute_color, 4, GL_UNSIGNED_BYTE, 24, GL_TRUE);
+      }
 
-      // describe the structure of my_vertex to OpenGL
-      water->add_attribute(attribute_pos, 3, GL_FLOAT, 0);
-      water->add_attribute(attribute_normal, 3, GL_FLOAT, 12);
-      water->add_attribute(attribute_color, 4, GL_UNSIGNED_BYTE, 24, GL_TRUE);
+      stream = new gl_wave_stream(water, get_vertex_size() * num_vertices);
 
       //generate our default waves ->> reading in first text file with default params
       generate_waves();
 
-      scene_node *node = new scene_node();
+      node = new scene_node();
       node->translate(vec3(100, 0, 100));
       node->rotate(90.0f, vec3(1.0, 0.0f, 0.0f)); //need to rotate it to be forward facing
       //add the mesh to the scene
       the_app->add_mesh_instance(new mesh_instance(node, water, water_material));
     }
 
+    //set up the waves without OpenGL. the vertices are written to memory each update.
+    void init_headless(){
+      stream = cpu_stream = new cpu_wave_stream();
+      generate_waves();
+    }
 
-    //need to update the points each frame
-    void update(){
+    bool get_headless() const{
+      return cpu_stream != nullptr;
+    }
 
-      ++time_step; //update our time step
+    //the vertices written by the last update of a headless mesh, get_num_vertices() of them
+    const uint8_t *get_headless_vertices() const{
+      return cpu_stream ? cpu_stream->get_vertices() : nullptr;
+    }
 
-      // these write-only locks give access to the vertices and indices.
-      // they will be released at the next } (the end of the scope)
-      gl_resource::wolock vl(water->get_vertices());
-      my_vertex *vtx = (my_vertex *)vl.u8();
-      gl_resource::wolock il(water->get_indices());
-      uint32_t *idx = il.u32();
+    //the indices that draw them, get_num_indices() of them
+    const uint32_t *get_headless_indices() const{
+      return cpu_stream ? (const uint32_t *)cpu_stream->get_indices() : nullptr;
+    }
 
-      // make the vertices
-      for (size_t i = 0; i != mesh_size; ++i) {
-        for (size_t j = 0; j != mesh_size; ++j) {
-          vec3 wavePosition = gerstner_wave_position(j, i);
-          vtx->pos = vec3p(vec3(1.0f * j, -1.0f * i, 0.0f) + wavePosition);
-          vec3 normalPosition = gerstner_wave_normals(wavePosition);
-          vtx->normal = vec3p(wavePosition);
-          vtx->color = make_color(sine_waves[0].colour);
+    //how the compact vertices of the last update unpack (see wave_vertex.h)
+    const compact_scale &get_packing() const{
+      return packing;
+    }
+
+    //room needed in the index buffer
+    size_t get_max_indices() const{
+      return use_clipmap ? (size_t)clip_levels * clip_cells * clip_cells * 6 : (mesh_size - 1) * (mesh_size - 1) * 6;
+    }
+
+    //indices drawn this frame: the cells of the visible tiles, less any holes
+    size_t count_indices() const{
+      size_t total = 0;
+      for (unsigned t = 0; t != tiles.size(); ++t) {
+        const grid_tile &tile = tiles[t];
+        const grid_patch &patch = patches[tile.patch];
+        for (unsigned row = tile.first_row; row != tile.last_row; ++row) {
+          for (unsigned col = tile.first_col; col != tile.last_col; ++col) {
+            if (!in_hole(patch, row, row + 1, col, col + 1)) total += 6;
+          }
+        }
+      }
+      return total;
+    }
+
+    size_t get_num_indices() const{
+      return num_indices;
+    }
+
+    // make the triangles of the visible tiles
+    void write_indices(uint32_t *idx){
+      for (unsigned t = 0; t != tiles.size(); ++t) {
+        const grid_tile &tile = tiles[t];
+        const grid_patch &patch = patches[tile.patch];
+        uint32_t width = tile.last_col - tile.first_col + 1;
+        for (unsigned row = tile.first_row; row != tile.last_row; ++row) {
+          for (unsigned col = tile.first_col; col != tile.last_col; ++col) {
+            if (in_hole(patch, row, row + 1, col, col + 1)) continue;
+            uint32_t i = (uint32_t)tile.first_vertex + (row - tile.first_row) * width + (col - tile.first_col);
+            idx[0] = i;
+            idx[1] = i + width + 1;
+            idx[2] = i + 1;
+            idx += 3;
+
+            idx[0] = i;
+            idx[1] = i + width;
+            idx[2] = i + width + 1;
+            idx += 3;
+          }
+        }
+      }
+    }
+
+    //the vectorised kernel, exact or stepped
+    void evaluate_kernel(float x, float y, float step, unsigned n, const wave_frame &out, const wave_mask *mask = nullptr, const wave_bank *waves = nullptr) const{
+      const wave_bank &b = waves ? *waves : bank;
+      if (phase_reseed) {
+        wave_kernel::evaluate_stepped(b, y, x, step, n, out, phase_reseed, mask);
+      } else {
+        wave_kernel::evaluate(b, y, x, step, n, out, mask);
+      }
+    }
+
+    //displacement and normal of n vertices from grid position (x, y), step apart along the row
+    //the mask, and waves other than the bank for this frame, are only used by the vectorised kernel
+    void evaluate_chunk(int x, int y, int step, unsigned n, float *dx, float *dy, float *dz, float *nx, float *ny, float *nz, const wave_mask *mask = nullptr, const wave_bank *waves = nullptr){
+      if (engine == engine_fft && !gpu_waves) {
+        fft.evaluate(y, x, step, n, dx, dy, dz, nx, ny, nz);
+        return;
+      }
+
+      if (use_simd) {
+        evaluate_kernel((float)x, (float)y, (float)step, n, wave_frame(dx, dy, dz, nx, ny, nz), mask, waves);
+        return;
+      }
+
+      //scalar reference path
+      for (unsigned k = 0; k != n; ++k) {
+        vec3 normal;
+        vec3 wavePosition = gerstner_wave_position(x + k * step, y, &normal);
+        dx[k] = wavePosition.x();
+        dy[k] = wavePosition.y();
+        dz[k] = wavePosition.z();
+        nx[k] = normal.x();
+        ny[k] = normal.y();
+        nz[k] = normal.z();
+      }
+    }
+
+    //average of two grid positions, so an odd vertex on the edge of a patch lies on the coarser patch's edge
+    void evaluate_midpoint(int x0, int y0, int x1, int y1, float &dx, float &dy, float &dz, float &nx, float &ny, float &nz, const wave_mask *mask, const wave_bank *waves){
+      float a[6][wave_kernel::chunk], b[6][wave_kernel::chunk];
+      evaluate_chunk(x0, y0, 1, 1, a[0], a[1], a[2], a[3], a[4], a[5], mask, waves);
+      evaluate_chunk(x1, y1, 1, 1, b[0], b[1], b[2], b[3], b[4], b[5], mask, waves);
+      dx = (a[0][0] + b[0][0]) * 0.5f;
+      dy = (a[1][0] + b[1][0]) * 0.5f;
+      dz = (a[2][0] + b[2][0]) * 0.5f;
+      nx = (a[3][0] + b[3][0]) * 0.5f;
+      ny = (a[4][0] + b[4][0]) * 0.5f;
+      nz = (a[5][0] + b[5][0]) * 0.5f;
+    }
+
+    //displacement and normal of n vertices of row i of a tile, starting at column j, with the edges stitched
+    void evaluate_run(const grid_tile &tile, unsigned i, unsigned j, unsigned n, float *dx, float *dy, float *dz, float *nx, float *ny, float *nz){
+      const grid_patch &patch = patches[tile.patch];
+      int y = patch.origin_y + (int)i * patch.spacing;
+      int x0 = patch.origin_x + (int)j * patch.spacing;
+      wave_mask mask_storage;
+      const wave_mask *mask = get_mask(tile, mask_storage);
+      const wave_bank *waves = tile.ahead ? &ahead_banks[tile.ahead] : &bank;
+      if (phase_cache_active()) {
+        const float *table = phase_cache.get_table(tile.cache_slot);
+        size_t width = tile.last_col - tile.first_col + 1;
+        size_t stride = width * (tile.last_row - tile.first_row + 1);
+        size_t offset = (i - tile.first_row) * width + (j - tile.first_col);
+        wave_kernel::evaluate_cached(*waves, table + offset, table + stride * bank.size() + offset, stride, (float)y, (float)x0, (float)patch.spacing, n, wave_frame(dx, dy, dz, nx, ny, nz), mask);
+      } else {
+        evaluate_chunk(x0, y, patch.spacing, n, dx, dy, dz, nx, ny, nz, mask, waves);
+      }
+
+      if (patch.stitch) {
+        //the coarser patch outside only has every other vertex of our edge
+        for (unsigned k = 0; k != n; ++k) {
+          int x = x0 + (int)k * patch.spacing;
+          int stitch = get_stitch(patch, i, j + k);
+          if (stitch > 0) {
+            evaluate_midpoint(x - stitch, y, x + stitch, y, dx[k], dy[k], dz[k], nx[k], ny[k], nz[k], mask, waves);
+          } else if (stitch < 0) {
+            evaluate_midpoint(x, y + stitch, x, y - stitch, dx[k], dy[k], dz[k], nx[k], ny[k], nz[k], mask, waves);
+          }
+        }
+      }
+    }
+
+    //write n vertices of row i of a tile, starting at column j
+    void write_run(uint8_t *vertices, const grid_tile &tile, unsigned i, unsigned j, unsigned n){
+      const grid_patch &patch = patches[tile.patch];
+      int y = patch.origin_y + (int)i * patch.spacing;
+      int x0 = patch.origin_x + (int)j * patch.spacing;
+      size_t first = tile.first_vertex + (i - tile.first_row) * (tile.last_col - tile.first_col + 1) + (j - tile.first_col);
+
+      if (gpu_waves) {
+        //the shader does the rest
+        grid_vertex *vtx = (grid_vertex *)vertices + first;
+        for (unsigned k = 0; k != n; ++k) {
+          vtx->pos = vec3p((float)(x0 + (int)k * patch.spacing), (float)y, (float)get_stitch(patch, i, j + k));
           vtx++;
         }
+        return;
       }
 
-      // make the triangles
-      uint32_t vn = 0;
-      for (size_t i = 0; i != mesh_size * (mesh_size - 1); ++i) {
-        if (i % mesh_size != mesh_size - 1){
-          idx[0] = i;
-          idx[1] = i + mesh_size + 1;
-          idx[2] = i + 1;
-          idx += 3;
+      uint32_t colour = make_color(sine_waves[0].colour);
+      float dx[wave_kernel::chunk], dy[wave_kernel::chunk], dz[wave_kernel::chunk];
+      float nx[wave_kernel::chunk], ny[wave_kernel::chunk], nz[wave_kernel::chunk];
+      if (tile.refresh) {
+        evaluate_run(tile, i, j, n, dx, dy, dz, nx, ny, nz);
+        if (tile.keep) keep_run(tile, i, j, n, dx, dy, dz, nx, ny, nz);
+      }
+      //a tile worked out ahead of time is blended back to now
+      if (!tile.refresh || tile.ahead) {
+        blend_run(tile, i, j, n, dx, dy, dz, nx, ny, nz);
+      }
+
+      if (compact) {
+        compact_vertex *vtx = (compact_vertex *)vertices + first;
+        for (unsigned k = 0; k != n; ++k) {
+          vec3 normal(nx[k], ny[k], nz[k]);
+          float x = (float)(x0 + (int)k * patch.spacing);
+          vtx->pos[0] = packing.encode_x(x + dx[k]);
+          vtx->pos[1] = packing.encode_y(y - dy[k]); //the shader flips y
+          vtx->pos[2] = packing.encode_height(dz[k]);
+          octahedral::encode(normal.squared() > 0.0f ? normal : vec3(0, 0, 1), vtx->normal);
+          vtx++;
+        }
+      } else {
+        my_vertex *vtx = (my_vertex *)vertices + first;
+        for (unsigned k = 0; k != n; ++k) {
+          float x = (float)(x0 + (int)k * patch.spacing);
+          vtx->pos = vec3p(vec3(x, -1.0f * y, 0.0f) + vec3(dx[k], dy[k], dz[k]));
+          vtx->normal = vec3p(vec3(nx[k], ny[k], nz[k]));
+          vtx->color = colour;
+          vtx++;
+        }
+      }
+    }
+
+    //call fn(i, j, n) for each run of up to a chunk of vertices of a tile that is drawn
+    template <class F> void for_each_run(const grid_tile &tile, F fn){
+      const grid_patch &patch = patches[tile.patch];
+      for (unsigned i = tile.first_row; i <= tile.last_row; ++i) {
+        //rows through the hole only need the vertices on either side of it
+        unsigned spans[2][2] = { { tile.first_col, tile.last_col + 1 }, { 0, 0 } };
+        if (patch.hole_size && (int)i > patch.hole_y && (int)i < patch.hole_y + patch.hole_size) {
+          unsigned hole_first = patch.hole_x + 1, hole_end = patch.hole_x + patch.hole_size;
+          spans[0][1] = std::max(tile.first_col, std::min(tile.last_col + 1, hole_first));
+          spans[1][0] = std::min(tile.last_col + 1, std::max(tile.first_col, hole_end));
+          spans[1][1] = tile.last_col + 1;
+        }
+
+        for (unsigned s = 0; s != 2; ++s) {
+          for (unsigned j = spans[s][0]; j < spans[s][1]; j += wave_kernel::chunk) {
+            unsigned n = std::min((unsigned)wave_kernel::chunk, spans[s][1] - j);
+            fn(i, j, n);
+          }
+        }
+      }
+    }
+
+    //write the vertices of a tile straight into the mapped vertex buffer
+    void update_tile(uint8_t *vertices, const grid_tile &tile){
+      for_each_run(tile, [&](unsigned i, unsigned j, unsigned n){
+        write_run(vertices, tile, i, j, n);
+      });
+    }
+
+    //the clock that drives the waves. it starts in fixed_step mode
+    wave_clock &get_clock(){
+      return clock;
+    }
+
+    //simulated seconds since the start
+    double get_time() const{
+      return clock.get_seconds();
+    }
+
+    //put every wave where it would be seconds after the start had it always moved at its current speed,
+    //so any moment of the sea can be made again (see wave_bake.h). the clock is left alone
+    void set_time(double seconds){
+      phases.resize(sine_waves.size());
+      for (unsigned i = 0; i < phases.size(); ++i){
+        phases[i] = 0.0;
+        phases[i] = phase_after(i, seconds);
+      }
+    }
+
+    //radians a second wave i moves on by at its current speed
+    double get_wave_omega(unsigned i) const{
+      return sine_waves[i].speed * speed_scale();
+    }
+
+    //move on one fixed step of the clock and update the points
+    void update(){
+      update(clock.get_step());
+    }
+
+    //real time has moved on by dt seconds: move the sea on as the clock says and update the points
+    void update(double dt){
+
+      double delta = clock.advance(dt);
+      advance_phases(delta);
+      fade_waves(delta);
+      if (delta > 0.0) frame_delta = delta;
+      if (engine == engine_fft && !gpu_waves) {
+        fft.set_shape(sine_waves[0].amplitude, sine_waves[0].steepness);
+        fft.update(clock.get_seconds(), workers);
+        max_horizontal = fft.get_max_horizontal();
+        max_height = fft.get_max_height();
+      } else {
+        build_bank();
+      }
+
+      build_patches();
+      build_tiles();
+      build_wave_masks();
+      fit_packing();
+
+      stream->begin_frame();
+
+      // the triangles only need writing once unless we have asked for the old behaviour,
+      // or the visible tiles have changed
+      bool same_tiles = same_key(index_key, last_index_key);
+      if (!static_indices || !indices_written || !same_tiles){
+        num_indices = count_indices();
+        if (num_indices) {
+          uint32_t *idx = (uint32_t *)stream->map_indices(sizeof(uint32_t) * num_indices);
+          write_indices(idx);
+          stream->unmap_indices();
+        }
+        if (water) water->set_num_indices((unsigned)num_indices);
+        copy_key(last_index_key, index_key);
+        indices_written = true;
+      }
 
-          idx[0] = i;
-          idx[1] = i + mesh_size;
-          idx[2] = i + mesh_size + 1;
-          idx += 3;
+      if (gpu_waves){
+        uniforms.set(bank);
+        if (water_material){
+          vec4 colour(sine_waves[0].colour, 1.0f);
+          water_material->set_uniform(waves_param, uniforms.get_waves(), uniforms.get_waves_bytes());
+          water_material->set_uniform(wave_count_param, uniforms.get_count(), sizeof(float));
+          water_material->set_uniform(colour_param, &colour, sizeof(colour));
         }
+
+        //the flat grid stays in the last buffer written until the tiles move
+        build_grid_key();
+        if (same_key(grid_key, last_grid_key)) return;
+        copy_key(last_grid_key, grid_key);
+      }
+
+      if (tiles.empty()) return;
+
+      schedule_refresh();
+      if (phase_cache_active()) begin_phase_cache();
+
+      uint8_t *vtx = (uint8_t *)stream->map_vertices(get_vertex_size() * get_tile_vertices());
+
+      // make the vertices, one tile per task.
+      // every vertex depends only on its grid position and the time step, so the result
+      // is the same whichever thread writes it and however many threads there are.
+      auto make_tile = [&](unsigned t){
+        update_tile(vtx, tiles[t]);
+      };
+      workers.run(tiles.size(), make_tile);
+
+      stream->unmap_vertices();
+
+      if (compact && water_material){
+        vec4 unpack(packing.x_origin, packing.xy_scale, packing.height_scale, packing.y_origin);
+        vec4 colour(sine_waves[0].colour, 1.0f);
+        water_material->set_uniform(unpack_param, &unpack, sizeof(unpack));
+        water_material->set_uniform(colour_param, &colour, sizeof(colour));
       }
     }
 
@@ -326,6 +1756,14 @@ namespace octet{
       water->set_mode(4);
       printf("Wireframe mode OFF\n");
     }
+    void toggle_engine(){
+      if (gpu_waves){
+        printf("the FFT engine does not run in the vertex shader\n");
+        return;
+      }
+      set_engine(engine == engine_fft ? engine_gerstner : engine_fft);
+      printf("%s engine\n", engine == engine_fft ? "FFT" : "Gerstner");
+    }
 #pragma endregion
   };
 }
@@ -0,0 +1,156 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Cached sin and cos of the part of each wave angle that does not change with time.
+//
+// A wave's angle at grid position (x, y) is kx * x + ky * y + phase. Only phase moves from frame
+// to frame, so with the sin and cos of the spatial part kept in a table a frame only has to rotate
+// them through phase (see wave_kernel::evaluate_cached) instead of doing a sincos per vertex per wave.
+//
+// There is one slot per tile position in the grid, holding a table for the tile's block of vertices.
+// A slot is made again when the tile it holds has moved (the clipmap follows the camera) or when
+// the frequency or direction of any wave has changed. Changes are found by comparing the wave
+// vectors with the ones the tables were made from, so edits from anywhere - the keys, a config file,
+// AntTweakBar writing straight into sine_waves - are all caught.
+//
+
+#ifndef WAVE_PHASE_CACHE_H_INCLUDED
+#define WAVE_PHASE_CACHE_H_INCLUDED
+
+namespace octet {
+
+  class wave_phase_cache {
+  public:
+    /// which block of which grid a table is for
+    struct key {
+      int origin_x, origin_y;  // grid position of the block's first vertex
+      int spacing;             // grid units between vertices
+      unsigned rows, cols;     // vertices down and across the block
+
+      bool operator==(const key &rhs) const {
+        return origin_x == rhs.origin_x && origin_y == rhs.origin_y && spacing == rhs.spacing && rows == rhs.rows && cols == rhs.cols;
+      }
+    };
+
+  private:
+    struct slot {
+      key k;
+      unsigned version;        // of the waves the table was made from, 0 for never made
+      bool needs_fill;
+      dynarray<float> table;   // sin for each wave then cos for each wave, rows * cols floats each
+
+      slot() {
+        version = 0;
+        needs_fill = false;
+      }
+    };
+
+    dynarray<slot> slots;
+    unsigned version;
+    unsigned num_waves;
+    dynarray<float> wave_kx, wave_ky;
+
+    unsigned hits, misses;
+
+  public:
+    wave_phase_cache() {
+      version = 1;
+      num_waves = 0;
+      hits = misses = 0;
+    }
+
+    /// call once a frame before lookup(). forgets every table if the wave vectors have changed.
+    void begin_frame(const wave_bank &bank, unsigned num_slots) {
+      hits = misses = 0;
+      if (slots.size() < num_slots) slots.resize(num_slots);
+
+      bool same = bank.size() == num_waves;
+      for (unsigned w = 0; same && w != num_waves; ++w) {
+        same = wave_kx[w] == bank.kx[w] && wave_ky[w] == bank.ky[w];
+      }
+      if (!same) {
+        num_waves = bank.size();
+        wave_kx.resize(num_waves);
+        wave_ky.resize(num_waves);
+        for (unsigned w = 0; w != num_waves; ++w) {
+          wave_kx[w] = bank.kx[w];
+          wave_ky[w] = bank.ky[w];
+        }
+        version++;
+      }
+    }
+
+    /// true if the slot already holds this block. if not, it is marked to be filled.
+    /// call from one thread, before the tiles are handed out.
+    bool lookup(unsigned index, const key &k) {
+      slot &s = slots[index];
+      if (s.version == version && s.k == k) {
+        s.needs_fill = false;
+        hits++;
+        return true;
+      }
+      s.k = k;
+      s.version = version;
+      s.needs_fill = true;
+      misses++;
+      return false;
+    }
+
+    /// the table for a slot, made first if lookup() missed. safe to call from many threads on different slots.
+    const float *get_table(unsigned index) {
+      slot &s = slots[index];
+      if (s.needs_fill) {
+        unsigned vertices = s.k.rows * s.k.cols;
+        s.table.resize(vertices * num_waves * 2);
+        float *sin_table = s.table.data(), *cos_table = sin_table + vertices * num_waves;
+        for (unsigned w = 0; w != num_waves; ++w) {
+          for (unsigned r = 0; r != s.k.rows; ++r) {
+            float y = (float)(s.k.origin_y + (int)r * s.k.spacing);
+            for (unsigned c = 0; c != s.k.cols; ++c) {
+              float x = (float)(s.k.origin_x + (int)c * s.k.spacing);
+              float angle = wave_kx[w] * x + wave_ky[w] * y;
+              unsigned i = w * vertices + r * s.k.cols + c;
+              sin_table[i] = sinf(angle);
+              cos_table[i] = cosf(angle);
+            }
+          }
+        }
+        s.needs_fill = false;
+      }
+      return s.table.data();
+    }
+
+    /// tables found already made in the last frame
+    unsigned get_hits() const {
+      return hits;
+    }
+
+    /// tables that had to be made in the last frame
+    unsigned get_misses() const {
+      return misses;
+    }
+
+    /// hits / lookups in the last frame
+    float get_hit_rate() const {
+      return hits + misses ? (float)hits / (hits + misses) : 0.0f;
+    }
+
+    /// bytes held by the tables
+    size_t get_bytes() const {
+      size_t total = 0;
+      for (unsigned i = 0; i != slots.size(); ++i) {
+        total += slots[i].table.capacity() * sizeof(float);
+      }
+      return total;
+    }
+
+    /// free the tables
+    void reset() {
+      slots.reset();
+      version++;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,101 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// How often each tile of the ocean is worked out again.
+//
+// Far away the sea hardly moves on screen from one frame to the next, so wave_mesh can work a tile
+// out for a few frames ahead and blend between that and its last state in the frames in between
+// (see wave_mesh::schedule_refresh). A policy chooses the number of frames between refreshes
+// for each visible tile. wave_mesh rounds it down to a power of two no bigger than
+// wave_refresh_policy::max_interval and staggers tiles with the same interval over the frames,
+// so the work stays about the same every frame.
+//
+// Blending a vertex linearly over t seconds is out by at most a t^2 / 8, where a bounds how fast
+// the vertex accelerates. wave_refresh_by_error uses this to keep the error under an angle seen
+// from the camera.
+//
+
+#ifndef WAVE_REFRESH_H_INCLUDED
+#define WAVE_REFRESH_H_INCLUDED
+
+namespace octet {
+
+  class wave_refresh_policy : public resource {
+  public:
+    enum { max_interval = 8 };
+
+    /// what a policy is told about a tile
+    struct tile_info {
+      float near_distance;   // grid units from the camera to the nearest point of the tile
+      float far_distance;    // and to the furthest
+      int spacing;           // grid units between vertices
+      unsigned vertices;
+      float acceleration;    // most grid units per second per second any vertex of the tile can move by
+      float frame_time;      // seconds of the last frame
+    };
+
+    /// frames between refreshes of this tile, 1 for every frame
+    virtual unsigned get_interval(const tile_info &tile) = 0;
+  };
+
+  /// every tile, every frame
+  class wave_refresh_always : public wave_refresh_policy {
+  public:
+    unsigned get_interval(const tile_info &) {
+      return 1;
+    }
+  };
+
+  /// every frame up to near_distance from the camera, then every 2nd frame up to twice that,
+  /// every 4th up to four times that and so on
+  class wave_refresh_by_distance : public wave_refresh_policy {
+    float near_distance;
+    unsigned longest;
+
+  public:
+    wave_refresh_by_distance(float near_distance = 128.0f, unsigned longest = max_interval) {
+      this->near_distance = near_distance;
+      this->longest = longest;
+    }
+
+    unsigned get_interval(const tile_info &tile) {
+      unsigned interval = 1;
+      for (float d = near_distance; tile.near_distance > d && interval < longest; d *= 2.0f) {
+        interval *= 2;
+      }
+      return interval;
+    }
+  };
+
+  /// as many frames as keep the error of a blended vertex under max_angle radians seen from the camera
+  class wave_refresh_by_error : public wave_refresh_policy {
+    float max_angle;
+
+  public:
+    wave_refresh_by_error(float max_angle = 0.001f) {
+      this->max_angle = max_angle;
+    }
+
+    void set_max_angle(float value) {
+      max_angle = value;
+    }
+
+    float get_max_angle() const {
+      return max_angle;
+    }
+
+    unsigned get_interval(const tile_info &tile) {
+      float max_error = max_angle * tile.near_distance;
+      unsigned interval = 1;
+      while (interval < max_interval) {
+        float t = tile.frame_time * interval * 2;
+        if (tile.acceleration * t * t > 8.0f * max_error) break;
+        interval *= 2;
+      }
+      return interval;
+    }
+  };
+}
+
+#endif
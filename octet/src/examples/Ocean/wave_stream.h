@@ -0,0 +1,154 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Destinations for the ocean's vertices and indices.
+//
+// wave_mesh writes each frame through a wave_stream. gl_wave_stream sends the data to
+// OpenGL through a ring of vertex buffers; cpu_wave_stream keeps it in ordinary memory
+// so the ocean can run (and be measured) without a GL context.
+// Both count the bytes written per frame.
+//
+
+#ifndef WAVE_STREAM_H_INCLUDED
+#define WAVE_STREAM_H_INCLUDED
+
+namespace octet {
+
+  class wave_stream : public resource {
+    size_t frame_bytes;
+    size_t total_bytes;
+
+  protected:
+    virtual void *lock_vertices(size_t size) = 0;
+    virtual void unlock_vertices() = 0;
+    virtual void *lock_indices(size_t size) = 0;
+    virtual void unlock_indices() = 0;
+
+  public:
+    wave_stream(){
+      frame_bytes = 0;
+      total_bytes = 0;
+    }
+
+    /// start counting bytes for a new frame
+    void begin_frame(){
+      frame_bytes = 0;
+    }
+
+    /// get write access to size bytes of vertices
+    void *map_vertices(size_t size){
+      frame_bytes += size;
+      total_bytes += size;
+      return lock_vertices(size);
+    }
+
+    void unmap_vertices(){
+      unlock_vertices();
+    }
+
+    /// get write access to size bytes of indices
+    void *map_indices(size_t size){
+      frame_bytes += size;
+      total_bytes += size;
+      return lock_indices(size);
+    }
+
+    void unmap_indices(){
+      unlock_indices();
+    }
+
+    /// bytes written since begin_frame()
+    size_t get_frame_bytes() const{
+      return frame_bytes;
+    }
+
+    /// bytes written since the stream was made
+    size_t get_total_bytes() const{
+      return total_bytes;
+    }
+  };
+
+  /// Streams vertices to a mesh through a ring of GL buffers.
+  ///
+  /// Each frame writes the next buffer in the ring with a discarding map and then points the mesh at it,
+  /// so we never map a buffer the GPU may still be drawing from.
+  class gl_wave_stream : public wave_stream {
+    enum { num_buffers = 3 };
+
+    ref<mesh> target;
+    ref<gl_resource> buffers[num_buffers];
+    size_t capacity;
+    unsigned current;
+
+  protected:
+    void *lock_vertices(size_t size){
+      current = (current + 1) % num_buffers;
+      gl_resource *buf = buffers[current];
+      //only grow the buffers, the number of visible tiles changes from frame to frame
+      if (!buf || buf->get_size() < size){
+        buf = buffers[current] = new gl_resource();
+        buf->allocate(GL_ARRAY_BUFFER, std::max(size, capacity), GL_STREAM_DRAW);
+      }
+      return buf->lock_write_discard();
+    }
+
+    void unlock_vertices(){
+      buffers[current]->unlock_write_only();
+      target->set_vertices(buffers[current]);
+    }
+
+    void *lock_indices(size_t size){
+      assert(target->get_indices()->get_size() >= size);
+      return target->get_indices()->lock_write_only();
+    }
+
+    void unlock_indices(){
+      target->get_indices()->unlock_write_only();
+    }
+
+  public:
+    /// vertex_capacity is the most vertex bytes a frame will write, so the buffers are only made once
+    gl_wave_stream(mesh *target, size_t vertex_capacity = 0){
+      this->target = target;
+      capacity = vertex_capacity;
+      current = 0;
+    }
+  };
+
+  /// CPU-only stand-in for the GL buffers, used for headless runs and measurements.
+  class cpu_wave_stream : public wave_stream {
+    dynarray<uint8_t> vertices;
+    dynarray<uint8_t> indices;
+
+  protected:
+    void *lock_vertices(size_t size){
+      vertices.resize(size);
+      return vertices.data();
+    }
+
+    void unlock_vertices(){
+    }
+
+    void *lock_indices(size_t size){
+      indices.resize(size);
+      return indices.data();
+    }
+
+    void unlock_indices(){
+    }
+
+  public:
+    /// the most recent vertices written
+    const uint8_t *get_vertices() const{
+      return vertices.data();
+    }
+
+    /// the most recent indices written
+    const uint8_t *get_indices() const{
+      return indices.data();
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,69 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// The worker threads used to evaluate the ocean in tiles.
+//
+// Tiles are handed out by job_scheduler::parallel_for (see resources/job.h), which the
+// calling thread helps with. By default the ocean shares job_scheduler::get_shared() with
+// the rest of the app. resize() gives it a scheduler of its own with a fixed number of
+// workers, which the benchmark uses to sweep thread counts.
+//
+
+#ifndef WAVE_THREAD_POOL_H_INCLUDED
+#define WAVE_THREAD_POOL_H_INCLUDED
+
+namespace octet {
+
+  class wave_thread_pool {
+    job_scheduler *own;        // made by resize()
+    job_scheduler *scheduler;  // own, or a shared one
+
+    wave_thread_pool(const wave_thread_pool &);
+    void operator=(const wave_thread_pool &);
+
+  public:
+    wave_thread_pool() {
+      own = 0;
+      scheduler = job_scheduler::get_shared();
+    }
+
+    ~wave_thread_pool() {
+      delete own;
+    }
+
+    /// number of worker threads (not counting the calling thread)
+    unsigned size() const {
+      return scheduler->get_num_workers();
+    }
+
+    /// use a scheduler of our own with num_workers threads
+    void resize(unsigned num_workers) {
+      if (own) {
+        own->resize(num_workers);
+      } else {
+        own = new job_scheduler(num_workers);
+      }
+      scheduler = own;
+    }
+
+    /// use someone else's scheduler, such as job_scheduler::get_shared()
+    void share(job_scheduler *value) {
+      scheduler = value;
+      delete own;
+      own = 0;
+    }
+
+    job_scheduler *get_scheduler() const {
+      return scheduler;
+    }
+
+    /// call fn(task) for task = 0 .. num_tasks-1, using the calling thread as well as the workers.
+    /// returns when every task has finished.
+    template <class fn_t> void run(unsigned num_tasks, fn_t &fn) {
+      scheduler->parallel_for(num_tasks, fn);
+    }
+  };
+}
+
+#endif
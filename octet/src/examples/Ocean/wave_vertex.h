@@ -0,0 +1,119 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Compact 8 byte ocean vertex and the conversions to and from it.
+//
+// The full vertex is 28 bytes (float position, float normal, colour). The compact one is
+//
+//   uint16 x, y   displaced grid position in fixed point: x_origin + x * xy_scale, y_origin + y * xy_scale
+//   uint16 z      height, biased by 32768:                (z - 32768) * height_scale
+//   int8   n[2]   octahedral normal
+//
+// The colour is the same for every vertex so it lives in a material uniform instead.
+// The scales are recomputed from the wave amplitudes each frame and sent as a uniform too.
+//
+
+#ifndef WAVE_VERTEX_H_INCLUDED
+#define WAVE_VERTEX_H_INCLUDED
+
+namespace octet {
+
+  struct compact_vertex {
+    uint16_t pos[3];
+    int8_t normal[2];
+  };
+
+  /// How to get from compact_vertex back to model space (mirrors ocean_unpack in ocean_compact.vs)
+  struct compact_scale {
+    float x_origin;
+    float y_origin;
+    float xy_scale;
+    float height_scale;
+
+    /// pick scales that fit a square of grid starting at (min_x, min_y) plus the largest possible horizontal and vertical displacement
+    void fit(float min_x, float min_y, float extent, float max_horizontal, float max_height) {
+      float pad = max_horizontal + 1.0f;
+      x_origin = min_x - pad;
+      y_origin = min_y - pad;
+      xy_scale = (extent + 2.0f * pad) / 65535.0f;
+      height_scale = (max_height > 0.0f ? max_height : 1.0f) / 32767.0f;
+    }
+
+    /// quantize one coordinate to the nearest fixed-point step, error about xy_scale / 2.
+    uint16_t encode_x(float value) const {
+      return quantize((value - x_origin) / xy_scale);
+    }
+
+    uint16_t encode_y(float value) const {
+      return quantize((value - y_origin) / xy_scale);
+    }
+
+    float decode_x(uint16_t value) const {
+      return value * xy_scale + x_origin;
+    }
+
+    float decode_y(uint16_t value) const {
+      return value * xy_scale + y_origin;
+    }
+
+    /// quantize a height, error about height_scale / 2.
+    uint16_t encode_height(float value) const {
+      float q = value / height_scale + 32768.5f;
+      return (uint16_t)(q < 1.0f ? 1.0f : q > 65535.0f ? 65535.0f : q);
+    }
+
+    float decode_height(uint16_t value) const {
+      return ((int)value - 32768) * height_scale;
+    }
+
+    static uint16_t quantize(float value) {
+      float q = value + 0.5f;
+      return (uint16_t)(q < 0.0f ? 0.0f : q > 65535.0f ? 65535.0f : q);
+    }
+  };
+
+  /// Octahedral normal encoding: fold the unit sphere onto a square and store it in two signed bytes.
+  /// Round trip error is under 1 degree (0.95 worst case over two million random directions).
+  class octahedral {
+    static float sign_not_zero(float v) {
+      return v >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    static int8_t to_snorm8(float v) {
+      float q = v * 127.0f;
+      return (int8_t)(q >= 0.0f ? q + 0.5f : q - 0.5f);
+    }
+
+  public:
+    /// n does not need to be normalized, but must not be zero.
+    static void encode(vec3_in n, int8_t out[2]) {
+      float l1 = fabsf(n.x()) + fabsf(n.y()) + fabsf(n.z());
+      float x = n.x() / l1, y = n.y() / l1;
+      if (n.z() < 0.0f) {
+        float fx = (1.0f - fabsf(y)) * sign_not_zero(x);
+        float fy = (1.0f - fabsf(x)) * sign_not_zero(y);
+        x = fx;
+        y = fy;
+      }
+      out[0] = to_snorm8(x);
+      out[1] = to_snorm8(y);
+    }
+
+    /// unit normal from two signed bytes (the same sums as ocean_compact.vs)
+    static vec3 decode(const int8_t in[2]) {
+      float x = std::max(in[0] / 127.0f, -1.0f);
+      float y = std::max(in[1] / 127.0f, -1.0f);
+      float z = 1.0f - fabsf(x) - fabsf(y);
+      if (z < 0.0f) {
+        float fx = (1.0f - fabsf(y)) * sign_not_zero(x);
+        float fy = (1.0f - fabsf(x)) * sign_not_zero(y);
+        x = fx;
+        y = fy;
+      }
+      return vec3(x, y, z).normalize();
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,228 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Micro-benchmark for dynarray against std::vector.
+//
+// Times the array operations the framework does most, for ints, octet strings and refs,
+// and writes one CSV row each:
+//
+//   op, impl, type, count, ns_per_op
+//
+//   push_back    fill an empty array one item at a time, growing as it goes
+//   emplace_back the same, building each item in place
+//   insert_front insert at the start of a short array
+//   erase_front  erase from the start until the array is empty
+//   small        make and throw away many arrays of two items, like scene_node children
+//
+// impl is dynarray, small_dynarray (two items inline) or vector. The octet move constructors
+// can't be noexcept (visual studio 2013), so std::vector copies strings and refs when it grows.
+// Every array is checked against the vector and it exits with 1 if they disagree.
+//
+// usage: container_bench [results.csv] [count]
+//
+
+#include "../../octet.h"
+
+namespace octet {
+  class container_bench {
+    typedef std::chrono::high_resolution_clock clock;
+
+    // keep repeating for at least this long
+    static double min_seconds() { return 0.2; }
+
+    // something to count references to
+    class counted : public resource {
+    public:
+      int value;
+      counted(int value) : value(value) {}
+    };
+
+    FILE *csv;
+    unsigned count;
+    bool ok;
+
+    dynarray<int> ints;
+    dynarray<string> strings;
+    dynarray<ref<counted> > refs;
+
+    static int value_of(int x) { return x; }
+    static int value_of(const string &x) { return atoi(x.c_str()); }
+    static int value_of(const ref<counted> &x) { return x->value; }
+
+    // run fn until min_seconds have gone and write the row
+    template <class fn_t> void time(const char *op, const char *impl, const char *type, unsigned ops, fn_t &fn) {
+      unsigned repeats = 0;
+      clock::time_point start = clock::now();
+      double seconds = 0;
+      while (repeats < 3 || seconds < min_seconds()) {
+        fn();
+        repeats++;
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+      }
+      double ns = seconds * 1e9 / ((double)repeats * ops);
+      fprintf(csv, "%s,%s,%s,%u,%.3f\n", op, impl, type, count, ns);
+      fprintf(stderr, "%-13s %-15s %-7s %.3f ns\n", op, impl, type, ns);
+    }
+
+    // the two arrays must hold the same values
+    template <class lhs_t, class rhs_t> void check(const char *op, const char *type, const lhs_t &lhs, const rhs_t &rhs) {
+      bool same = lhs.size() == rhs.size();
+      for (unsigned i = 0; same && i != rhs.size(); ++i) {
+        same = value_of(lhs[i]) == value_of(rhs[i]);
+      }
+      if (!same) {
+        fprintf(stderr, "%s %s: dynarray and vector differ\n", op, type);
+        ok = false;
+      }
+    }
+
+    template <class item_t> void bench_push_back(const char *type, const dynarray<item_t> &src) {
+      dynarray<item_t> dyn;
+      std::vector<item_t> vec;
+      auto dyn_push = [&]() {
+        dyn.reset();
+        for (unsigned i = 0; i != count; ++i) dyn.push_back(src[i]);
+      };
+      auto vec_push = [&]() {
+        std::vector<item_t>().swap(vec);
+        for (unsigned i = 0; i != count; ++i) vec.push_back(src[i]);
+      };
+      time("push_back", "dynarray", type, count, dyn_push);
+      time("push_back", "vector", type, count, vec_push);
+      check("push_back", type, dyn, vec);
+    }
+
+    void bench_emplace_back() {
+      dynarray<string> dyn;
+      std::vector<string> vec;
+      auto dyn_emplace = [&]() {
+        dyn.reset();
+        for (unsigned i = 0; i != count; ++i) dyn.emplace_back(strings[i].c_str());
+      };
+      auto vec_emplace = [&]() {
+        std::vector<string>().swap(vec);
+        for (unsigned i = 0; i != count; ++i) vec.emplace_back(strings[i].c_str());
+      };
+      time("emplace_back", "dynarray", "string", count, dyn_emplace);
+      time("emplace_back", "vector", "string", count, vec_emplace);
+      check("emplace_back", "string", dyn, vec);
+    }
+
+    // insert and erase are quadratic, so keep these arrays short
+    template <class item_t> void bench_insert_erase(const char *type, const dynarray<item_t> &src) {
+      unsigned n = std::min(count, 256u);
+      dynarray<item_t> dyn;
+      std::vector<item_t> vec;
+      auto dyn_insert = [&]() {
+        dyn.resize(0);
+        for (unsigned i = 0; i != n; ++i) dyn.insert(dyn.begin(), src[i]);
+      };
+      auto vec_insert = [&]() {
+        vec.resize(0);
+        for (unsigned i = 0; i != n; ++i) vec.insert(vec.begin(), src[i]);
+      };
+      time("insert_front", "dynarray", type, n, dyn_insert);
+      time("insert_front", "vector", type, n, vec_insert);
+      check("insert_front", type, dyn, vec);
+
+      auto dyn_erase = [&]() {
+        dyn.resize(0);
+        for (unsigned i = 0; i != n; ++i) dyn.push_back(src[i]);
+        while (dyn.size()) dyn.erase(0u);
+      };
+      auto vec_erase = [&]() {
+        vec.resize(0);
+        for (unsigned i = 0; i != n; ++i) vec.push_back(src[i]);
+        while (vec.size()) vec.erase(vec.begin());
+      };
+      time("erase_front", "dynarray", type, n, dyn_erase);
+      time("erase_front", "vector", type, n, vec_erase);
+      check("erase_front", type, dyn, vec);
+    }
+
+    // many short-lived arrays of two refs
+    void bench_small() {
+      unsigned total[3] = { 0, 0, 0 };
+      auto dyn_small = [&]() {
+        for (unsigned i = 0; i + 1 < count; i += 2) {
+          dynarray<ref<counted> > children;
+          children.push_back(refs[i]);
+          children.push_back(refs[i+1]);
+          total[0] += children[0]->value + children[1]->value;
+        }
+      };
+      auto small_small = [&]() {
+        for (unsigned i = 0; i + 1 < count; i += 2) {
+          small_dynarray<ref<counted>, 2> children;
+          children.push_back(refs[i]);
+          children.push_back(refs[i+1]);
+          total[1] += children[0]->value + children[1]->value;
+        }
+      };
+      auto vec_small = [&]() {
+        for (unsigned i = 0; i + 1 < count; i += 2) {
+          std::vector<ref<counted> > children;
+          children.push_back(refs[i]);
+          children.push_back(refs[i+1]);
+          total[2] += children[0]->value + children[1]->value;
+        }
+      };
+      time("small", "dynarray", "ref", count / 2, dyn_small);
+      time("small", "small_dynarray", "ref", count / 2, small_small);
+      time("small", "vector", "ref", count / 2, vec_small);
+
+      // the totals depend on how often each ran, so just check one pass of each
+      total[0] = total[1] = total[2] = 0;
+      dyn_small();
+      small_small();
+      vec_small();
+      if (total[0] != total[2] || total[1] != total[2]) {
+        fprintf(stderr, "small: totals differ\n");
+        ok = false;
+      }
+    }
+
+  public:
+    container_bench(FILE *csv, unsigned count) : csv(csv), count(count), ok(true) {
+      random rand(0x1234);
+      for (unsigned i = 0; i != count; ++i) {
+        int value = (int)(rand.get0xffff() % 100000) + 1;
+        ints.push_back(value);
+        string str;
+        str.format("%d", value);
+        strings.push_back(str);
+        refs.push_back(new counted(value));
+      }
+    }
+
+    bool run_all() {
+      fprintf(csv, "op,impl,type,count,ns_per_op\n");
+      bench_push_back("int", ints);
+      bench_push_back("string", strings);
+      bench_push_back("ref", refs);
+      bench_emplace_back();
+      bench_insert_erase("int", ints);
+      bench_insert_erase("string", strings);
+      bench_insert_erase("ref", refs);
+      bench_small();
+      return ok;
+    }
+  };
+}
+
+int main(int argc, char **argv) {
+  const char *filename = argc > 1 ? argv[1] : "container_bench.csv";
+  unsigned count = argc > 2 ? (unsigned)std::max(2, atoi(argv[2])) : 4096;
+
+  FILE *csv = fopen(filename, "w");
+  if (!csv) {
+    fprintf(stderr, "can't write %s\n", filename);
+    return 1;
+  }
+
+  octet::container_bench bench(csv, count);
+  bool ok = bench.run_all();
+  fclose(csv);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Scaling benchmark for job_scheduler (see resources/job.h).
+//
+// Runs three loads on 1, 2, 4 ... threads and every core, counting the waiting thread,
+// and writes one CSV row for each:
+//
+//   test, threads, ms, speedup
+//
+//   parallel_for   many small tasks handed out a grain at a time
+//   graph          leaf jobs, joins that depend on groups of them and a root that depends on the joins
+//   nested         jobs that split themselves in two and wait for the halves from inside a worker
+//
+// speedup is against the same test on one thread. Every result is checked against a serial sum,
+// and the graph is also run twice in serial mode to check the order is the same both times.
+// Exits with 1 if anything is wrong.
+//
+// usage: job_bench [results.csv] [most threads]
+//
+
+#include "../../octet.h"
+
+namespace octet {
+  class job_bench {
+    typedef std::chrono::high_resolution_clock clock;
+
+    enum { num_items = 1 << 18, num_leaves = 1024, leaves_per_join = 32, nested_depth = 10 };
+
+    // some arithmetic to stand in for real work
+    static double work(unsigned i) {
+      double x = i * 0.001;
+      for (unsigned j = 0; j != 32; ++j) {
+        x = x * 0.999 + sin(x);
+      }
+      return x;
+    }
+
+    // sums work() over a range of items
+    class sum_job : public job {
+      unsigned first, last;
+      dynarray<unsigned> *order;
+      std::mutex *order_lock;
+    public:
+      double sum;
+
+      sum_job() {
+        first = last = 0;
+        order = 0;
+        order_lock = 0;
+        sum = 0;
+      }
+
+      void init(unsigned first, unsigned last, dynarray<unsigned> *order = 0, std::mutex *order_lock = 0) {
+        this->first = first;
+        this->last = last;
+        this->order = order;
+        this->order_lock = order_lock;
+      }
+
+      void kernel() {
+        if (order) {
+          std::lock_guard<std::mutex> guard(*order_lock);
+          order->push_back(first);
+        }
+        for (unsigned i = first; i != last; ++i) {
+          sum += work(i);
+        }
+      }
+    };
+
+    // adds up the sums of the jobs it depends on
+    class join_job : public job {
+      sum_job *parts;
+      unsigned num_parts;
+    public:
+      double sum;
+
+      join_job() {
+        parts = 0;
+        num_parts = 0;
+        sum = 0;
+      }
+
+      void init(sum_job *parts, unsigned num_parts) {
+        this->parts = parts;
+        this->num_parts = num_parts;
+      }
+
+      void kernel() {
+        for (unsigned i = 0; i != num_parts; ++i) {
+          sum += parts[i].sum;
+        }
+      }
+    };
+
+    // splits its range in two jobs until depth runs out, and waits for them
+    class split_job : public job {
+      job_scheduler *scheduler;
+      unsigned first, last, depth;
+    public:
+      double sum;
+
+      split_job(job_scheduler *scheduler, unsigned first, unsigned last, unsigned depth) {
+        this->scheduler = scheduler;
+        this->first = first;
+        this->last = last;
+        this->depth = depth;
+        sum = 0;
+      }
+
+      void kernel() {
+        if (depth == 0) {
+          for (unsigned i = first; i != last; ++i) {
+            sum += work(i);
+          }
+          return;
+        }
+        unsigned middle = (first + last) / 2;
+        split_job left(scheduler, first, middle, depth - 1);
+        split_job right(scheduler, middle, last, depth - 1);
+        job_counter counter;
+        scheduler->submit(&left, &counter);
+        scheduler->submit(&right, &counter);
+        scheduler->wait(counter);
+        sum = left.sum + right.sum;
+      }
+    };
+
+    FILE *csv;
+    dynarray<double> single_ms;
+    double expected;
+
+    static bool close_to(double a, double b) {
+      return fabs(a - b) <= 1e-9 * fabs(b) + 1e-9;
+    }
+
+    double test_parallel_for(job_scheduler &scheduler) {
+      unsigned num_grains = num_items / 256;
+      dynarray<double> sums(num_grains);
+      auto grain_sum = [&](unsigned g) {
+        double sum = 0;
+        for (unsigned i = g * 256; i != g * 256 + 256; ++i) {
+          sum += work(i);
+        }
+        sums[g] = sum;
+      };
+      scheduler.parallel_for(num_grains, grain_sum, 4);
+      double sum = 0;
+      for (unsigned g = 0; g != num_grains; ++g) {
+        sum += sums[g];
+      }
+      return sum;
+    }
+
+    double test_graph(job_scheduler &scheduler, dynarray<unsigned> *order = 0) {
+      std::mutex order_lock;
+      unsigned num_joins = num_leaves / leaves_per_join;
+      unsigned per_leaf = num_items / num_leaves;
+      sum_job *leaves = new sum_job[num_leaves];
+      join_job *joins = new join_job[num_joins + 1];
+      join_job &root = joins[num_joins];
+
+      // the root and the joins first, so they are waiting before the leaves can finish
+      root.init(0, 0);
+      for (unsigned j = 0; j != num_joins; ++j) {
+        joins[j].init(leaves + j * leaves_per_join, leaves_per_join);
+        scheduler.add_dependency(&root, &joins[j]);
+      }
+      for (unsigned i = 0; i != num_leaves; ++i) {
+        leaves[i].init(i * per_leaf, i * per_leaf + per_leaf, order, &order_lock);
+        scheduler.add_dependency(&joins[i / leaves_per_join], &leaves[i]);
+      }
+
+      job_counter counter;
+      scheduler.submit(&root, &counter);
+      for (unsigned j = 0; j != num_joins; ++j) {
+        scheduler.submit(&joins[j], &counter);
+      }
+      for (unsigned i = 0; i != num_leaves; ++i) {
+        scheduler.submit(&leaves[i], &counter);
+      }
+      scheduler.wait(counter);
+
+      bool root_last = true;
+      double sum = 0;
+      for (unsigned j = 0; j != num_joins; ++j) {
+        sum += joins[j].sum;
+        root_last = root_last && joins[j].get_state() == job::state_done;
+      }
+      delete [] leaves;
+      delete [] joins;
+      return root_last ? sum : -1.0;
+    }
+
+    double test_nested(job_scheduler &scheduler) {
+      split_job top(&scheduler, 0, num_items, nested_depth);
+      job_counter counter;
+      scheduler.submit(&top, &counter);
+      scheduler.wait(counter);
+      return top.sum;
+    }
+
+    bool time(unsigned test, const char *name, unsigned threads, job_scheduler &scheduler) {
+      clock::time_point start = clock::now();
+      double sum = test == 0 ? test_parallel_for(scheduler) : test == 1 ? test_graph(scheduler) : test_nested(scheduler);
+      double ms = std::chrono::duration<double>(clock::now() - start).count() * 1e3;
+      if (threads == 1) single_ms[test] = ms;
+      fprintf(csv, "%s,%u,%.3f,%.2f\n", name, threads, ms, single_ms[test] / ms);
+      fflush(csv);
+      fprintf(stderr, "%s %u threads: %.3f ms\n", name, threads, ms);
+      if (!close_to(sum, expected)) {
+        fprintf(stderr, "%s %u threads: sum %.17g, expected %.17g\n", name, threads, sum, expected);
+        return false;
+      }
+      return true;
+    }
+
+  public:
+    job_bench(FILE *csv) {
+      this->csv = csv;
+      single_ms.resize(3);
+      expected = 0;
+      for (unsigned i = 0; i != num_items; ++i) {
+        expected += work(i);
+      }
+    }
+
+    bool run_all(unsigned max_threads) {
+      fprintf(csv, "test,threads,ms,speedup\n");
+      bool ok = true;
+
+      dynarray<unsigned> threads;
+      for (unsigned n = 1; n < max_threads; n *= 2) {
+        threads.push_back(n);
+      }
+      threads.push_back(max_threads);
+
+      for (unsigned i = 0; i != threads.size(); ++i) {
+        job_scheduler scheduler(threads[i] - 1);
+        ok = time(0, "parallel_for", threads[i], scheduler) && ok;
+        ok = time(1, "graph", threads[i], scheduler) && ok;
+        ok = time(2, "nested", threads[i], scheduler) && ok;
+      }
+
+      // serial mode runs the leaves in the same order every time, even with workers about
+      job_scheduler scheduler(max_threads - 1);
+      scheduler.set_serial(true);
+      dynarray<unsigned> first_order, second_order;
+      ok = close_to(test_graph(scheduler, &first_order), expected) && ok;
+      ok = close_to(test_graph(scheduler, &second_order), expected) && ok;
+      bool same = first_order.size() == num_leaves && second_order.size() == num_leaves;
+      for (unsigned i = 0; same && i != num_leaves; ++i) {
+        same = first_order[i] == second_order[i];
+      }
+      fprintf(stderr, "serial: %s order\n", same ? "same" : "different");
+      return ok && same;
+    }
+  };
+}
+
+int main(int argc, char **argv) {
+  const char *filename = argc > 1 ? argv[1] : "job_bench.csv";
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  unsigned max_threads = argc > 2 ? std::max(1, atoi(argv[2])) : cores;
+
+  FILE *csv = fopen(filename, "w");
+  if (!csv) {
+    fprintf(stderr, "can't write %s\n", filename);
+    return 1;
+  }
+
+  octet::job_bench bench(csv);
+  bool ok = bench.run_all(max_threads);
+  fclose(csv);
+  return ok ? 0 : 1;
+}
+
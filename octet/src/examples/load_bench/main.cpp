@@ -0,0 +1,124 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Load-time and memory benchmark for the XML loader.
+//
+// Parses a collada file the way collada_builder::load_xml() used to, reading a copy of it
+// (TiXmlDocument::LoadFile), or the way it does now, in place in a mapping of the file
+// (app_utils::get_url into a url_view). Writes one CSV row:
+//
+//   mode, bytes, loads, first_ms, mean_ms, rss_before_kb, peak_rss_kb
+//
+// Peak RSS only goes up over the life of a process, so run each mode in a process of its own.
+// The file is loaded once before the timing starts, so both modes are timed from the page cache.
+//
+// usage: load_bench [copy|map] [url] [loads]
+//
+
+#include "../../octet.h"
+
+#include <chrono>
+
+#ifdef WIN32
+  #include <psapi.h>
+  #pragma comment(lib, "psapi.lib")
+#else
+  #include <sys/resource.h>
+#endif
+
+namespace octet {
+  class load_bench {
+    typedef std::chrono::high_resolution_clock clock;
+
+    static size_t peak_rss_kb() {
+      #ifdef WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.PeakWorkingSetSize / 1024;
+      #else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        #ifdef __APPLE__
+          return usage.ru_maxrss / 1024; // bytes on mac
+        #else
+          return usage.ru_maxrss;
+        #endif
+      #endif
+    }
+
+    bool mapped;
+    const char *url;
+    size_t bytes;
+
+    // one parse of the file. false if it didn't parse
+    bool load(TiXmlDocument &doc) {
+      if (mapped) {
+        url_view file;
+        app_utils::get_url(file, url);
+        bytes = file.size();
+        doc.Clear();
+        doc.Parse((const char *)file.data());
+      } else {
+        doc.LoadFile(app_utils::get_path(url));
+        FILE *file = fopen(app_utils::get_path(url), "rb");
+        if (file) {
+          fseek(file, 0, SEEK_END);
+          bytes = (size_t)ftell(file);
+          fclose(file);
+        }
+      }
+      return !doc.Error() && doc.RootElement();
+    }
+
+  public:
+    load_bench(bool mapped, const char *url) {
+      this->mapped = mapped;
+      this->url = url;
+      bytes = 0;
+    }
+
+    bool run(unsigned loads, FILE *csv) {
+      size_t rss_before = peak_rss_kb();
+      double first_ms = 0, total_ms = 0;
+      for (unsigned i = 0; i != loads + 1; ++i) {
+        TiXmlDocument doc;
+        clock::time_point start = clock::now();
+        if (!load(doc)) {
+          fprintf(stderr, "can't load %s: %s\n", url, doc.ErrorDesc());
+          return false;
+        }
+        double ms = std::chrono::duration<double>(clock::now() - start).count() * 1e3;
+        if (i == 0) {
+          // the file may not have been in the page cache
+          first_ms = ms;
+        } else {
+          total_ms += ms;
+        }
+      }
+
+      fprintf(csv, "mode,bytes,loads,first_ms,mean_ms,rss_before_kb,peak_rss_kb\n");
+      fprintf(
+        csv, "%s,%u,%u,%.3f,%.3f,%u,%u\n",
+        mapped ? "map" : "copy", (unsigned)bytes, loads, first_ms, total_ms / loads,
+        (unsigned)rss_before, (unsigned)peak_rss_kb()
+      );
+      return true;
+    }
+  };
+}
+
+int main(int argc, char **argv) {
+  const char *mode = argc > 1 ? argv[1] : "map";
+  const char *url = argc > 2 ? argv[2] : "assets/Laurana50k.dae";
+  unsigned loads = argc > 3 ? (unsigned)atoi(argv[3]) : 10;
+
+  if (strcmp(mode, "copy") && strcmp(mode, "map")) {
+    fprintf(stderr, "usage: load_bench [copy|map] [url] [loads]\n");
+    return 1;
+  }
+
+  octet::load_bench bench(!strcmp(mode, "map"), url);
+  return bench.run(std::max(loads, 1u), stdout) ? 0 : 1;
+}
+
@@ -0,0 +1,421 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Micro-benchmark for the math library.
+//
+// Times mat4t multiply, invertQuick, and vec3 dot and cross three ways and writes one CSV row each:
+//
+//   op, impl, simd, count, ns_per_op
+//
+//   scalar   plain float loops, as the math would be without OCTET_SSE
+//   octet    the vec3 / mat4t operators one at a time, in a loop
+//   batch    the math/batch.h array functions
+//
+// Then the transform and culling functions of math/batch.h (points, points to projection space,
+// normals, matrix pairs, boxes, and boxes and spheres against a camera frustum) against the
+// per-element code they replace, as octet and batch rows.
+//
+// simd says what the build used: none, sse or avx2. Build with -D OCTET_SSE=0 to time the
+// scalar operators and with -mavx2 to time the 8 wide batch paths. Every result is checked
+// against the scalar loop, and the batch results against the operators, and it exits with 1
+// if they disagree. The batch functions do the same sums as the operators, but a compiler
+// allowed to fuse multiplies and adds (-mfma, -march=native) may do so in one and not the
+// other, so they only have to agree to a few units in the last place.
+//
+// usage: math_bench [results.csv] [count]
+//
+
+#include "../../octet.h"
+
+namespace octet {
+  class math_bench {
+    typedef std::chrono::high_resolution_clock clock;
+
+    // keep repeating for at least this long
+    static double min_seconds() { return 0.2; }
+
+    static const char *simd() {
+      #if OCTET_AVX2
+        return "avx2";
+      #elif OCTET_SSE
+        return "sse";
+      #else
+        return "none";
+      #endif
+    }
+
+    // reference math on bare floats. matrices are 16 floats, row by row, like mat4t
+    static void scalar_mul(float *d, const float *l, const float *r) {
+      for (int i = 0; i != 4; ++i) {
+        for (int j = 0; j != 4; ++j) {
+          d[i*4+j] = r[0*4+j] * l[i*4+0] + r[1*4+j] * l[i*4+1] + r[2*4+j] * l[i*4+2] + r[3*4+j] * l[i*4+3];
+        }
+      }
+    }
+
+    static void scalar_invert_quick(float *d, const float *s) {
+      for (int i = 0; i != 3; ++i) {
+        d[i*4+0] = s[0*4+i];
+        d[i*4+1] = s[1*4+i];
+        d[i*4+2] = s[2*4+i];
+        d[i*4+3] = 0;
+      }
+      for (int j = 0; j != 4; ++j) {
+        d[12+j] = d[0+j] * -s[12] + d[4+j] * -s[13] + d[8+j] * -s[14] + (j == 3 ? 1.0f : 0.0f);
+      }
+    }
+
+    FILE *csv;
+    unsigned count;
+    bool ok;
+
+    dynarray<mat4t> matrices, matrices_out, matrices_ref;
+    dynarray<vec3p> a, b, vectors_out, vectors_ref;
+    dynarray<float> dots, dots_ref;
+    dynarray<vec4> projected, projected_ref;
+    dynarray<float> radii;
+    dynarray<bool> visible, visible_ref;
+    vec4 planes[6];
+
+    // run fn until min_seconds have gone and write the row
+    template <class fn_t> void time(const char *op, const char *impl, fn_t &fn) {
+      unsigned repeats = 0;
+      clock::time_point start = clock::now();
+      double seconds = 0;
+      while (repeats < 3 || seconds < min_seconds()) {
+        fn();
+        repeats++;
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+      }
+      double ns = seconds * 1e9 / ((double)repeats * count);
+      fprintf(csv, "%s,%s,%s,%u,%.3f\n", op, impl, simd(), count, ns);
+      fprintf(stderr, "%-13s %-7s %.3f ns\n", op, impl, ns);
+    }
+
+    // how far the batch results may be from the operators: a few rounding steps, for fused multiply-adds
+    static float fused_tolerance() { return 8 * std::numeric_limits<float>::epsilon(); }
+
+    // largest difference between two arrays of floats, relative to y where it is bigger than one
+    void check(const char *op, const char *what, const void *x, const void *y, size_t floats, float tolerance) {
+      const float *fx = (const float*)x, *fy = (const float*)y;
+      float worst = 0;
+      for (size_t i = 0; i != floats; ++i) {
+        worst = std::max(worst, fabsf(fx[i] - fy[i]) / std::max(1.0f, fabsf(fy[i])));
+      }
+      if (worst > tolerance) {
+        fprintf(stderr, "%s: %s differ by %g\n", op, what, worst);
+        ok = false;
+      }
+    }
+
+    void bench_mul() {
+      const mat4t &rhs = matrices[count];
+      auto scalar = [&]() {
+        for (unsigned i = 0; i != count; ++i) {
+          scalar_mul((float*)&matrices_ref[i], (const float*)&matrices[i], (const float*)&rhs);
+        }
+      };
+      auto per_element = [&]() {
+        for (unsigned i = 0; i != count; ++i) {
+          matrices_out[i] = matrices[i] * rhs;
+        }
+      };
+      auto batched = [&]() {
+        batch::mul(matrices_out.data(), matrices.data(), rhs, count);
+      };
+
+      time("mat4t_mul", "scalar", scalar);
+      time("mat4t_mul", "octet", per_element);
+      check("mat4t_mul", "octet and scalar", matrices_out.data(), matrices_ref.data(), count * 16, 1e-5f);
+      dynarray<mat4t> one_at_a_time(matrices_out);
+      time("mat4t_mul", "batch", batched);
+      check("mat4t_mul", "batch and octet", matrices_out.data(), one_at_a_time.data(), count * 16, fused_tolerance());
+    }
+
+    void bench_invert_quick() {
+      auto scalar = [&]() {
+        for (unsigned i = 0; i != count; ++i) {
+          scalar_invert_quick((float*)&matrices_ref[i], (const float*)&matrices[i]);
+        }
+      };
+      auto per_element = [&]() {
+        for (unsigned i = 0; i != count; ++i) {
+          matrices[i].invertQuick(matrices_out[i]);
+        }
+      };
+      auto batched = [&]() {
+        batch::invert_quick(matrices_out.data(), matrices.data(), count);
+      };
+
+      time("invertQuick", "scalar", scalar);
+      time("invertQuick", "octet", per_element);
+      check("invertQuick", "octet and scalar", matrices_out.data(), matrices_ref.data(), count * 16, 1e-5f);
+      time("invertQuick", "batch", batched);
+    }
+
+    void bench_dot() {
+      auto scalar = [&]() {
+        const float *fa = (const float*)a.data(), *fb = (const float*)b.data();
+        for (unsigned i = 0; i != count; ++i) {
+          dots_ref[i] = fa[i*3] * fb[i*3] + fa[i*3+1] * fb[i*3+1] + fa[i*3+2] * fb[i*3+2];
+        }
+      };
+      auto per_element = [&]() {
+        for (unsigned i = 0; i != count; ++i) {
+          dots[i] = vec3(a[i]).dot(vec3(b[i]));
+        }
+      };
+      auto batched = [&]() {
+        batch::dot(dots.data(), a.data(), b.data(), count);
+      };
+
+      time("vec3_dot", "scalar", scalar);
+      time("vec3_dot", "octet", per_element);
+      check("vec3_dot", "octet and scalar", dots.data(), dots_ref.data(), count, 1e-5f);
+      dynarray<float> one_at_a_time(dots);
+      time("vec3_dot", "batch", batched);
+      check("vec3_dot", "batch and octet", dots.data(), one_at_a_time.data(), count, fused_tolerance());
+    }
+
+    void bench_cross() {
+      auto scalar = [&]() {
+        const float *fa = (const float*)a.data(), *fb = (const float*)b.data();
+        float *fd = (float*)vectors_ref.data();
+        for (unsigned i = 0; i != count; ++i) {
+          fd[i*3+0] = fa[i*3+1] * fb[i*3+2] - fa[i*3+2] * fb[i*3+1];
+          fd[i*3+1] = fa[i*3+2] * fb[i*3+0] - fa[i*3+0] * fb[i*3+2];
+          fd[i*3+2] = fa[i*3+0] * fb[i*3+1] - fa[i*3+1] * fb[i*3+0];
+        }
+      };
+      auto per_element = [&]() {
+        for (unsigned i = 0; i != count; ++i) {
+          vectors_out[i] = vec3(a[i]).cross(vec3(b[i]));
+        }
+      };
+      auto batched = [&]() {
+        batch::cross(vectors_out.data(), a.data(), b.data(), count);
+      };
+
+      time("vec3_cross", "scalar", scalar);
+      time("vec3_cross", "octet", per_element);
+      check("vec3_cross", "octet and scalar", vectors_out.data(), vectors_ref.data(), count * 3, 1e-5f);
+      dynarray<vec3p> one_at_a_time(vectors_out);
+      time("vec3_cross", "batch", batched);
+      check("vec3_cross", "batch and octet", vectors_out.data(), one_at_a_time.data(), count * 3, fused_tolerance());
+    }
+
+    void bench_transform() {
+      const mat4t &m = matrices[count];
+      auto points = [&]() {
+        for (unsigned i = 0; i != count; ++i) {
+          vectors_ref[i] = (vec3)a[i] * m;
+        }
+      };
+      auto batch_points = [&]() {
+        batch::transform_points(vectors_out.data(), a.data(), m, count);
+      };
+      time("points", "octet", points);
+      time("points", "batch", batch_points);
+      check("points", "batch and octet", vectors_out.data(), vectors_ref.data(), count * 3, fused_tolerance());
+
+      auto projection = [&]() {
+        for (unsigned i = 0; i != count; ++i) {
+          projected_ref[i] = vec4((vec3)a[i], 1.0f) * m;
+        }
+      };
+      auto batch_projection = [&]() {
+        batch::transform_points(projected.data(), a.data(), m, count);
+      };
+      time("points_xyzw", "octet", projection);
+      time("points_xyzw", "batch", batch_projection);
+      check("points_xyzw", "batch and octet", projected.data(), projected_ref.data(), count * 4, fused_tolerance());
+
+      auto normals = [&]() {
+        for (unsigned i = 0; i != count; ++i) {
+          vectors_ref[i] = (((vec3)a[i]).xyz0() * m).xyz();
+        }
+      };
+      auto batch_normals = [&]() {
+        batch::transform_normals(vectors_out.data(), a.data(), m, count);
+      };
+      time("normals", "octet", normals);
+      time("normals", "batch", batch_normals);
+      check("normals", "batch and octet", vectors_out.data(), vectors_ref.data(), count * 3, fused_tolerance());
+    }
+
+    void bench_mul_pairs() {
+      const mat4t *rhs = matrices.data() + 1;
+      auto per_element = [&]() {
+        for (unsigned i = 0; i != count; ++i) {
+          matrices_ref[i] = matrices[i] * rhs[i];
+        }
+      };
+      auto batched = [&]() {
+        batch::mul(matrices_out.data(), matrices.data(), rhs, count);
+      };
+      time("mat4t_mul_pairs", "octet", per_element);
+      time("mat4t_mul_pairs", "batch", batched);
+      check("mat4t_mul_pairs", "batch and octet", matrices_out.data(), matrices_ref.data(), count * 16, fused_tolerance());
+    }
+
+    // centers in a, half extents in b
+    void bench_aabbs() {
+      const mat4t &m = matrices[count];
+      dynarray<vec3p> half_out(count), half_ref(count);
+      auto per_element = [&]() {
+        for (unsigned i = 0; i != count; ++i) {
+          aabb bb = aabb(a[i], abs((vec3)b[i])).get_transform(m);
+          vectors_ref[i] = bb.get_center();
+          half_ref[i] = bb.get_half_extent();
+        }
+      };
+      dynarray<vec3p> half(count);
+      for (unsigned i = 0; i != count; ++i) {
+        half[i] = abs((vec3)b[i]);
+      }
+      auto batched = [&]() {
+        batch::transform_aabbs(vectors_out.data(), half_out.data(), a.data(), half.data(), m, count);
+      };
+      time("aabbs", "octet", per_element);
+      time("aabbs", "batch", batched);
+      check("aabbs", "batch and octet centers", vectors_out.data(), vectors_ref.data(), count * 3, fused_tolerance());
+      check("aabbs", "batch and octet half extents", half_out.data(), half_ref.data(), count * 3, fused_tolerance());
+    }
+
+    // the per-element test. radius < 0 for a box with half extent h
+    bool inside(vec3_in center, float radius, vec3_in h) {
+      for (int j = 0; j != 6; ++j) {
+        vec3 normal = planes[j].xyz();
+        float distance = dot(normal, center) + planes[j].w();
+        float r = radius >= 0 ? radius : dot(abs(normal), h);
+        if (distance < -r) return false;
+      }
+      return true;
+    }
+
+    void bench_culling() {
+      // a camera at the origin looking down -z, with the points spread from -10 to 10 so some are in view
+      mat4t cameraToProjection;
+      cameraToProjection.loadIdentity();
+      cameraToProjection.frustum(-0.1f, 0.1f, -0.1f, 0.1f, 0.1f, 20.0f);
+      batch::get_frustum_planes(planes, cameraToProjection);
+
+      dynarray<vec3p> centers(count), half(count);
+      for (unsigned i = 0; i != count; ++i) {
+        centers[i] = (vec3)a[i] * 10.0f;
+        half[i] = abs((vec3)b[i]) * 0.5f;
+      }
+      size_t num_visible = 0, num_visible_ref = 0;
+
+      auto spheres = [&]() {
+        num_visible_ref = 0;
+        for (unsigned i = 0; i != count; ++i) {
+          visible_ref[i] = inside(centers[i], radii[i], vec3(0));
+          num_visible_ref += visible_ref[i];
+        }
+      };
+      auto batch_spheres = [&]() {
+        num_visible = batch::test_spheres(visible.data(), centers.data(), radii.data(), planes, count);
+      };
+      time("frustum_spheres", "octet", spheres);
+      time("frustum_spheres", "batch", batch_spheres);
+      check_visible("frustum_spheres", num_visible, num_visible_ref);
+
+      auto boxes = [&]() {
+        num_visible_ref = 0;
+        for (unsigned i = 0; i != count; ++i) {
+          visible_ref[i] = inside(centers[i], -1, half[i]);
+          num_visible_ref += visible_ref[i];
+        }
+      };
+      auto batch_boxes = [&]() {
+        num_visible = batch::test_aabbs(visible.data(), centers.data(), half.data(), planes, count);
+      };
+      time("frustum_aabbs", "octet", boxes);
+      time("frustum_aabbs", "batch", batch_boxes);
+      check_visible("frustum_aabbs", num_visible, num_visible_ref);
+    }
+
+    void check_visible(const char *op, size_t num_visible, size_t num_visible_ref) {
+      unsigned differ = 0;
+      for (unsigned i = 0; i != count; ++i) {
+        differ += visible[i] != visible_ref[i];
+      }
+      fprintf(stderr, "%s: %u of %u visible\n", op, (unsigned)num_visible, count);
+      if (differ || num_visible != num_visible_ref) {
+        fprintf(stderr, "%s: batch and octet differ for %u\n", op, differ);
+        ok = false;
+      }
+    }
+
+  public:
+    math_bench(FILE *csv, unsigned count) {
+      this->csv = csv;
+      this->count = count;
+      ok = true;
+
+      // rotate and translate matrices, as invertQuick expects. one more for the right hand side
+      random rand;
+      matrices.resize(count + 1);
+      for (unsigned i = 0; i != count + 1; ++i) {
+        mat4t m;
+        vec3 axis = vec3(rand.get(-1.0f, 1.0f), rand.get(-1.0f, 1.0f), rand.get(-1.0f, 1.0f)).normalize();
+        m.rotate(rand.get(0.0f, 360.0f), axis.x(), axis.y(), axis.z());
+        m.translate(vec3(rand.get(-10.0f, 10.0f), rand.get(-10.0f, 10.0f), rand.get(-10.0f, 10.0f)));
+        matrices[i] = m;
+      }
+      matrices_out.resize(count);
+      matrices_ref.resize(count);
+
+      a.resize(count);
+      b.resize(count);
+      for (unsigned i = 0; i != count; ++i) {
+        a[i] = vec3p(rand.get(-1.0f, 1.0f), rand.get(-1.0f, 1.0f), rand.get(-1.0f, 1.0f));
+        b[i] = vec3p(rand.get(-1.0f, 1.0f), rand.get(-1.0f, 1.0f), rand.get(-1.0f, 1.0f));
+      }
+      vectors_out.resize(count);
+      vectors_ref.resize(count);
+      dots.resize(count);
+      dots_ref.resize(count);
+      projected.resize(count);
+      projected_ref.resize(count);
+      radii.resize(count);
+      for (unsigned i = 0; i != count; ++i) {
+        radii[i] = rand.get(0.0f, 1.0f);
+      }
+      visible.resize(count);
+      visible_ref.resize(count);
+    }
+
+    bool run_all() {
+      fprintf(csv, "op,impl,simd,count,ns_per_op\n");
+      bench_mul();
+      bench_invert_quick();
+      bench_dot();
+      bench_cross();
+      bench_transform();
+      bench_mul_pairs();
+      bench_aabbs();
+      bench_culling();
+      return ok;
+    }
+  };
+}
+
+int main(int argc, char **argv) {
+  const char *filename = argc > 1 ? argv[1] : "math_bench.csv";
+  unsigned count = argc > 2 ? (unsigned)std::max(1, atoi(argv[2])) : 4096;
+
+  FILE *csv = fopen(filename, "w");
+  if (!csv) {
+    fprintf(stderr, "can't write %s\n", filename);
+    return 1;
+  }
+
+  octet::math_bench bench(csv, count);
+  bool ok = bench.run_all();
+  fclose(csv);
+  return ok ? 0 : 1;
+}
+
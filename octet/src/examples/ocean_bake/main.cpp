@@ -0,0 +1,67 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Headless baker for the ocean in examples/Ocean.
+//
+// Runs the default waves over one loop on every core and writes it to a file that
+// wave_bake_player can map and play back without any wave maths (see wave_bake.h).
+// If the waves have no common period of up to a minute, loop seconds of sea are baked
+// instead, with the last crossfade seconds blended into the start.
+//
+// usage: ocean_bake [ocean.bake] [grid size] [loop seconds] [crossfade seconds]
+//
+
+#include "../../octet.h"
+
+#include "../Ocean/wave_thread_pool.h"
+#include "../Ocean/wave_clock.h"
+#include "../Ocean/wave_kernel.h"
+#include "../Ocean/wave_phase_cache.h"
+#include "../Ocean/wave_refresh.h"
+#include "../Ocean/wave_gpu.h"
+#include "../Ocean/wave_stream.h"
+#include "../Ocean/wave_fft.h"
+#include "../Ocean/wave_vertex.h"
+#include "../Ocean/wave_clipmap.h"
+#include "../Ocean/wave_frustum.h"
+#include "../Ocean/wave_mesh.h"
+#include "../Ocean/wave_bake.h"
+
+#include <chrono>
+
+int main(int argc, char **argv) {
+  using namespace octet;
+  const char *filename = argc > 1 ? argv[1] : "ocean.bake";
+  unsigned grid = argc > 2 ? (unsigned)atoi(argv[2]) : 120;
+  float loop = argc > 3 ? (float)atof(argv[3]) : 10.0f;
+  float crossfade = argc > 4 ? (float)atof(argv[4]) : 1.0f;
+
+  ref<wave_mesh> ocean = new wave_mesh();
+  ocean->set_grid_size(grid);
+  ocean->set_compact(true);
+  ocean->init_headless();
+
+  wave_baker baker(ocean);
+  baker.set_loop(loop, crossfade);
+
+  std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+  if (!baker.bake(filename)) {
+    fprintf(stderr, "can't bake %s: %s\n", filename, baker.get_error());
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+  ref<wave_bake_player> player = new wave_bake_player();
+  if (!player->open(filename)) {
+    fprintf(stderr, "baked %s but can't map it: %s\n", filename, player->get_error());
+    return 0;
+  }
+  const wave_bake_header *header = player->get_header();
+  fprintf(
+    stderr, "%s: %u frames of %u vertices (%s), %.1f MB in %.2f s\n",
+    filename, header->num_frames, header->num_vertices, header->crossfade_frames ? "cross-faded loop" : "common period",
+    (header->frames_offset + header->frame_stride * header->num_frames) / 1e6, seconds
+  );
+  return 0;
+}
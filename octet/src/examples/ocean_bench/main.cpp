@@ -0,0 +1,460 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Ryan Singh 2015
+//
+// Headless benchmark for the ocean in examples/Ocean.
+//
+// Runs wave_mesh::update() into memory (no window, no GL calls) over a sweep of grid sizes,
+// wave counts and thread counts and writes one CSV row per run:
+//
+//   grid, waves, threads, vertices, written_vertices, updates, ns_per_vertex, vertices_per_s, peak_rss_kb
+//
+// vertices is the grid's grid x grid vertices, which ns_per_vertex and vertices_per_s are per.
+// written_vertices is how many go into the vertex buffer, a few more because the tiles repeat the
+// vertices on their edges. threads counts the render thread as well as the workers. peak_rss_kb is the peak for the
+// whole process so far, which only goes up as the grids get bigger.
+//
+// After the sweep it checks that the clipmap chooses the levels and holes it should for a few
+// cameras, that tiles refreshed less often than every frame (see wave_refresh.h) stay within their
+// error, that every vectorised kernel (exact, phase stepped, phase cached and points anywhere) stays
+// within 1e-4 of the scalar reference in displacement and normal, also while waves are fading out,
+// that writing the indices once saves all of their bytes every frame after the first, that the
+// compact vertex (wave_vertex.h) gives back positions to within half a step and normals to within a
+// degree, and that sample() finds the height at displaced grid vertices to within 1e-3 of the
+// tallest wave. It exits with 1 if any of these fail. Last it times wave_mesh::sample() over a batch
+// of points the size a few thousand floating bodies would ask for, and a frame of 1000 boxes
+// floating in a Bullet world (wave_buoyancy.h).
+//
+// usage: ocean_bench [results.csv] [largest grid]
+//
+
+#define OCTET_BULLET 1
+
+#include "../../octet.h"
+
+#include "../Ocean/wave_thread_pool.h"
+#include "../Ocean/wave_clock.h"
+#include "../Ocean/wave_kernel.h"
+#include "../Ocean/wave_phase_cache.h"
+#include "../Ocean/wave_refresh.h"
+#include "../Ocean/wave_gpu.h"
+#include "../Ocean/wave_stream.h"
+#include "../Ocean/wave_fft.h"
+#include "../Ocean/wave_vertex.h"
+#include "../Ocean/wave_clipmap.h"
+#include "../Ocean/wave_frustum.h"
+#include "../Ocean/wave_mesh.h"
+#include "../Ocean/wave_buoyancy.h"
+
+#include <chrono>
+
+#ifdef WIN32
+  #include <psapi.h>
+  #pragma comment(lib, "psapi.lib")
+#else
+  #include <sys/resource.h>
+#endif
+
+namespace octet {
+  class ocean_bench {
+    typedef std::chrono::high_resolution_clock clock;
+
+    // keep updating for at least this long so small grids are timed over many frames
+    static double min_seconds() { return 0.25; }
+    enum { min_updates = 3 };
+
+    static size_t peak_rss_kb() {
+      #ifdef WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.PeakWorkingSetSize / 1024;
+      #else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        #ifdef __APPLE__
+          return usage.ru_maxrss / 1024; // bytes on mac
+        #else
+          return usage.ru_maxrss;
+        #endif
+      #endif
+    }
+
+    FILE *csv;
+
+    void run(unsigned grid, unsigned waves, unsigned workers) {
+      ref<wave_mesh> ocean = new wave_mesh();
+      ocean->set_grid_size(grid);
+      ocean->set_num_waves(waves);
+      ocean->set_num_threads(workers);
+      ocean->init_headless();
+
+      // the first update writes the indices, which later ones do not
+      ocean->update();
+
+      unsigned updates = 0;
+      clock::time_point start = clock::now();
+      double seconds = 0;
+      while (updates < min_updates || seconds < min_seconds()) {
+        ocean->update();
+        updates++;
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+      }
+
+      size_t vertices = ocean->get_grid_size() * ocean->get_grid_size();
+      double ns_per_vertex = seconds * 1e9 / ((double)vertices * updates);
+      fprintf(
+        csv, "%u,%u,%u,%u,%u,%u,%.3f,%.0f,%u\n",
+        grid, waves, workers + 1, (unsigned)vertices, (unsigned)ocean->get_num_vertices(), updates,
+        ns_per_vertex, 1e9 / ns_per_vertex, (unsigned)peak_rss_kb()
+      );
+      fflush(csv);
+      fprintf(stderr, "%ux%u %u waves %u threads: %.3f ns/vertex\n", grid, grid, waves, workers + 1, ns_per_vertex);
+    }
+
+    // a camera moving over the clipmap at 60 frames a second, with the tiles blended to within max_angle
+    bool check_refresh(float max_angle) {
+      ref<wave_mesh> ocean = new wave_mesh();
+      ocean->set_clipmap(true);
+      ocean->set_num_waves(16);
+      ocean->set_refresh_policy(new wave_refresh_by_error(max_angle));
+      ocean->init_headless();
+      ocean->get_clock().set_mode(wave_clock::variable_step);
+
+      float worst = 0.0f;
+      size_t refreshed = 0, total = 0;
+      for (unsigned frame = 0; frame != 240; ++frame) {
+        ocean->set_camera(vec3(frame * 0.25f, 0.0f, 10.0f));
+        ocean->update(1.0 / 60);
+        worst = std::max(worst, ocean->max_refresh_error());
+        refreshed += ocean->get_refreshed_vertices();
+        total += ocean->get_num_vertices();
+      }
+      fprintf(stderr, "refresh: %.1f%% of vertices worked out a frame, worst error %g radians (limit %g)\n", refreshed * 100.0 / total, worst, max_angle);
+      return worst <= max_angle;
+    }
+
+    // wave_mesh::get_frame_upload_bytes() a few frames in, with the indices written every frame and once.
+    // written once, a frame should save exactly the 339864 bytes of indices of the 120x120 grid
+    // (743064 -> 403200 before the grid was split into tiles, which repeat the vertices on their edges).
+    bool check_uploads() {
+      size_t bytes[2], indices[2];
+      for (unsigned static_indices = 0; static_indices != 2; ++static_indices) {
+        ref<wave_mesh> ocean = new wave_mesh();
+        ocean->set_static_indices(static_indices != 0);
+        ocean->init_headless();
+        for (unsigned frame = 0; frame != 3; ++frame) {
+          ocean->update();
+        }
+        bytes[static_indices] = ocean->get_frame_upload_bytes();
+        indices[static_indices] = ocean->get_num_indices();
+      }
+      size_t saved = bytes[0] - bytes[1];
+      size_t expected = 743064 - 403200;
+      fprintf(stderr, "uploads: %u bytes a frame, %u with static indices, saving %u (expected %u)\n", (unsigned)bytes[0], (unsigned)bytes[1], (unsigned)saved, (unsigned)expected);
+      return bytes[0] > bytes[1] && saved == expected && indices[0] * sizeof(uint32_t) == expected && indices[1] == indices[0];
+    }
+
+    // compact_scale and octahedral round trips over a sweep of positions and random normals
+    bool check_vertex_encoding() {
+      compact_scale scale;
+      float min_x = -60.0f, min_y = -120.0f, extent = 120.0f, max_horizontal = 3.0f, max_height = 2.5f;
+      scale.fit(min_x, min_y, extent, max_horizontal, max_height);
+
+      // half a fixed point step, and a little for the float sums
+      float xy_limit = scale.xy_scale * 0.51f, height_limit = scale.height_scale * 0.51f;
+      float xy_error = 0.0f, height_error = 0.0f;
+      for (unsigned i = 0; i <= 100000; ++i) {
+        float t = i / 100000.0f;
+        float x = min_x - max_horizontal + t * (extent + 2.0f * max_horizontal);
+        float y = min_y - max_horizontal + t * (extent + 2.0f * max_horizontal);
+        float z = (t * 2.0f - 1.0f) * max_height;
+        xy_error = std::max(xy_error, fabsf(scale.decode_x(scale.encode_x(x)) - x));
+        xy_error = std::max(xy_error, fabsf(scale.decode_y(scale.encode_y(y)) - y));
+        height_error = std::max(height_error, fabsf(scale.decode_height(scale.encode_height(z)) - z));
+      }
+
+      // the poles and axes, then random directions
+      float max_degrees = 1.0f, normal_error = 0.0f;
+      random rand(0x5eed);
+      for (unsigned i = 0; i != 200000; ++i) {
+        vec3 n;
+        if (i < 6) {
+          float axis[3] = { 0, 0, 0 };
+          axis[i / 2] = i & 1 ? -1.0f : 1.0f;
+          n = vec3(axis[0], axis[1], axis[2]);
+        } else {
+          n = vec3(rand.get(-1.0f, 1.0f), rand.get(-1.0f, 1.0f), rand.get(-1.0f, 1.0f));
+          if (n.squared() < 1e-6f) continue;
+          n = n.normalize();
+        }
+        int8_t packed[2];
+        octahedral::encode(n, packed);
+        float cos_angle = std::min(std::max(n.dot(octahedral::decode(packed)), -1.0f), 1.0f);
+        normal_error = std::max(normal_error, acosf(cos_angle) * (180.0f / 3.14159265f));
+      }
+
+      fprintf(
+        stderr, "compact vertex: position error %g (limit %g), height %g (limit %g), normal %g degrees (limit %g)\n",
+        xy_error, xy_limit, height_error, height_limit, normal_error, max_degrees
+      );
+      return xy_error <= xy_limit && height_error <= height_limit && normal_error <= max_degrees;
+    }
+
+    // wave_mesh::max_kernel_error() with phase stepping off, reseeding often and reseeding once a chunk,
+    // then again part way through fading out half the waves (see set_active_waves()).
+    // the normals are only compared with 16 waves: the reference uses the GPU Gems normal, which
+    // drifts from the exact one the kernels work out as more waves pile up.
+    bool check_kernels(float max_error) {
+      ref<wave_mesh> ocean = new wave_mesh();
+      ocean->set_grid_size(256);
+      ocean->set_num_waves(16);
+      ocean->init_headless();
+      ocean->update();
+
+      bool ok = true;
+      unsigned reseeds[] = { 0, 16, wave_kernel::chunk };
+      for (unsigned i = 0; i != sizeof(reseeds) / sizeof(reseeds[0]); ++i) {
+        ocean->set_phase_stepping(reseeds[i]);
+        float error = ocean->max_kernel_error();
+        fprintf(stderr, "kernels: reseed %u, worst error %g (limit %g)\n", reseeds[i], error, max_error);
+        ok = ok && error <= max_error;
+      }
+
+      ocean->set_phase_stepping(0);
+      ocean->set_wave_fade_seconds(0.05f);
+      ocean->set_active_waves(8);
+      ocean->update();
+      float min_weight = 1.0f;
+      for (unsigned i = 0; i != 16; ++i) {
+        min_weight = std::min(min_weight, ocean->get_wave_weight(i));
+      }
+      float error = ocean->max_kernel_error();
+      fprintf(stderr, "kernels: fading waves (smallest weight %g), worst error %g (limit %g)\n", min_weight, error, max_error);
+      return ok && min_weight > 0.0f && min_weight < 1.0f && error <= max_error;
+    }
+
+    // wave_clipmap::update() for cameras whose levels and holes were worked out by hand (64 cells, 6 levels:
+    // a level is dropped while it is less than half the camera height across, and each level snaps to twice
+    // its spacing), then a sweep of cameras checking that each hole is where the finer level lands
+    bool check_clipmap() {
+      struct expected {
+        float x, y, height;
+        unsigned first_visible;
+        int origin_x, origin_y;         // of the first visible level
+        int hole_x, hole_y;             // in the level after it
+      };
+      static const expected cases[] = {
+        { 37.5f, -20.2f, 10.0f, 0, 4, -54, 16, 17 },
+        { 37.5f, -20.2f, -10.0f, 0, 4, -54, 16, 17 },
+        { 37.5f, -20.2f, 200.0f, 1, -28, -88, 17, 16 },
+        { 0.0f, 0.0f, 128.0f, 0, -32, -32, 16, 16 },
+        { 0.0f, 0.0f, 129.0f, 1, -64, -64, 16, 16 },
+        { -1.0f, -1.0f, 10.0f, 0, -34, -34, 17, 17 },
+      };
+
+      wave_clipmap clipmap(64, 6);
+      bool ok = true;
+      for (unsigned c = 0; c != sizeof(cases) / sizeof(cases[0]); ++c) {
+        const expected &e = cases[c];
+        clipmap.update(e.x, e.y, e.height);
+        unsigned first = clipmap.get_first_visible();
+        const wave_clipmap::level &lev = clipmap.get_level(first), &next = clipmap.get_level(first + 1);
+        bool good =
+          first == e.first_visible && lev.origin_x == e.origin_x && lev.origin_y == e.origin_y && !lev.has_hole &&
+          next.has_hole && next.hole_x == e.hole_x && next.hole_y == e.hole_y;
+        if (!good) {
+          fprintf(
+            stderr, "clipmap: camera (%g, %g, %g) chose level %u at (%d, %d) with the next hole at (%d, %d), expected %u at (%d, %d) and (%d, %d)\n",
+            e.x, e.y, e.height, first, lev.origin_x, lev.origin_y, next.hole_x, next.hole_y, e.first_visible, e.origin_x, e.origin_y, e.hole_x, e.hole_y
+          );
+        }
+        ok = ok && good;
+      }
+
+      // the top level is kept however high the camera goes
+      clipmap.update(0.0f, 0.0f, 1e6f);
+      ok = ok && clipmap.get_first_visible() == 5 && clipmap.get_level(5).origin_x == -1024 && !clipmap.get_level(5).has_hole;
+
+      random rand(0xc11f);
+      unsigned cells = clipmap.get_level_size() - 1, hole = clipmap.get_hole_cells();
+      for (unsigned c = 0; c != 10000; ++c) {
+        float x = rand.get(-5000.0f, 5000.0f), y = rand.get(-5000.0f, 5000.0f), height = rand.get(-2000.0f, 2000.0f);
+        clipmap.update(x, y, height);
+        unsigned first = clipmap.get_first_visible();
+        const wave_clipmap::level &top = clipmap.get_level(first);
+        // the camera is over the finest level drawn
+        ok = ok && top.origin_x <= x && x < top.origin_x + (int)cells * top.spacing;
+        ok = ok && top.origin_y <= y && y < top.origin_y + (int)cells * top.spacing;
+        for (unsigned i = 0; i != clipmap.get_num_levels(); ++i) {
+          const wave_clipmap::level &lev = clipmap.get_level(i);
+          ok = ok && lev.visible == (i >= first) && lev.has_hole == (i > first);
+          ok = ok && lev.origin_x % (lev.spacing * 2) == 0 && lev.origin_y % (lev.spacing * 2) == 0;
+          if (!lev.has_hole) continue;
+          // the finer level fills the hole exactly
+          const wave_clipmap::level &inner = clipmap.get_level(i - 1);
+          ok = ok && lev.hole_x >= 0 && lev.hole_x + (int)hole <= (int)cells && lev.hole_y >= 0 && lev.hole_y + (int)hole <= (int)cells;
+          ok = ok && lev.origin_x + lev.hole_x * lev.spacing == inner.origin_x && lev.origin_y + lev.hole_y * lev.spacing == inner.origin_y;
+        }
+      }
+      fprintf(stderr, "clipmap: levels and holes %s\n", ok ? "as expected" : "wrong");
+      return ok;
+    }
+
+    // sample() at displaced grid vertices of the default sea, after 1, 2, 4 and 8 fixed point steps.
+    // the default number of steps must find the height to within max_error of the tallest wave
+    bool check_sample(float max_error) {
+      ref<wave_mesh> ocean = new wave_mesh();
+      ocean->set_num_threads(0);
+      ocean->init_headless();
+      ocean->update();
+
+      unsigned default_iterations = ocean->get_sample_iterations();
+      for (unsigned iterations = 1; iterations <= 8; iterations *= 2) {
+        ocean->set_sample_iterations(iterations);
+        fprintf(stderr, "sample: %u steps, worst height error %g\n", iterations, ocean->max_sample_error());
+      }
+      ocean->set_sample_iterations(default_iterations);
+      float error = ocean->max_sample_error() / ocean->get_max_height();
+      fprintf(stderr, "sample: %u steps by default, worst height error %g of the tallest wave (limit %g)\n", default_iterations, error, max_error);
+      return error <= max_error;
+    }
+
+    // sample() over batches of points spread around the grid
+    void time_sample(unsigned num_points) {
+      ref<wave_mesh> ocean = new wave_mesh();
+      ocean->init_headless();
+      ocean->update();
+
+      dynarray<vec3> points(num_points);
+      dynarray<float> heights(num_points);
+      dynarray<vec3> velocities(num_points);
+      random rand;
+      for (unsigned i = 0; i != num_points; ++i) {
+        points[i] = vec3(rand.get(0.0f, 120.0f), rand.get(-120.0f, 0.0f), 0.0f);
+      }
+
+      unsigned batches = 0;
+      clock::time_point start = clock::now();
+      double seconds = 0;
+      while (batches < min_updates || seconds < min_seconds()) {
+        ocean->sample(points.data(), num_points, heights.data(), nullptr, velocities.data());
+        batches++;
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+      }
+      fprintf(stderr, "sample: %u points in %.3f ms, %.1f ns/point\n", num_points, seconds * 1e3 / batches, seconds * 1e9 / ((double)num_points * batches));
+    }
+
+    // num_boxes one metre boxes floating on the sea in a Bullet world, stepped at 60 frames a second.
+    // the time is for a whole frame: the ocean's update, sampling the probes and the world's step.
+    void time_buoyancy(unsigned num_boxes) {
+      ref<wave_mesh> ocean = new wave_mesh();
+      ocean->init_headless();
+      ocean->update();
+
+      btDefaultCollisionConfiguration config;
+      btCollisionDispatcher dispatcher(&config);
+      btDbvtBroadphase broadphase;
+      btSequentialImpulseConstraintSolver solver;
+      btDiscreteDynamicsWorld *world = new btDiscreteDynamicsWorld(&dispatcher, &broadphase, &solver, &config);
+      world->setGravity(btVector3(0.0f, 0.0f, -9.8f));
+
+      // half the density of the water, so they float half under
+      ref<wave_buoyancy> buoyancy = new wave_buoyancy(ocean, world);
+      buoyancy->set_density(2.0f);
+      btBoxShape shape(btVector3(0.5f, 0.5f, 0.5f));
+      btVector3 inertia;
+      shape.calculateLocalInertia(1.0f, inertia);
+      dynarray<btRigidBody *> bodies;
+      random rand;
+      for (unsigned i = 0; i != num_boxes; ++i) {
+        btTransform transform;
+        transform.setIdentity();
+        transform.setOrigin(btVector3(rand.get(0.0f, 120.0f), rand.get(-120.0f, 0.0f), 0.0f));
+        btRigidBody::btRigidBodyConstructionInfo info(1.0f, new btDefaultMotionState(transform), &shape, inertia);
+        btRigidBody *body = new btRigidBody(info);
+        world->addRigidBody(body);
+        buoyancy->add_body(body, 1.0f);
+        bodies.push_back(body);
+      }
+
+      // let them settle before timing
+      for (unsigned frame = 0; frame != 60; ++frame) {
+        ocean->update(1.0 / 60);
+        world->stepSimulation(1.0f / 60, 1, 1.0f / 60);
+      }
+
+      unsigned frames = 0;
+      clock::time_point start = clock::now();
+      double seconds = 0;
+      while (frames < min_updates || seconds < min_seconds()) {
+        ocean->update(1.0 / 60);
+        world->stepSimulation(1.0f / 60, 1, 1.0f / 60);
+        frames++;
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+      }
+      fprintf(
+        stderr, "buoyancy: %u boxes in %.3f ms a frame, %u of %u probes wet\n",
+        num_boxes, seconds * 1e3 / frames, buoyancy->get_wet_probes(), num_boxes * 8
+      );
+
+      buoyancy = 0;
+      for (unsigned i = 0; i != bodies.size(); ++i) {
+        world->removeRigidBody(bodies[i]);
+        delete bodies[i]->getMotionState();
+        delete bodies[i];
+      }
+      delete world;
+    }
+
+  public:
+    ocean_bench(FILE *csv) {
+      this->csv = csv;
+    }
+
+    bool run_all(unsigned max_grid) {
+      fprintf(csv, "grid,waves,threads,vertices,written_vertices,updates,ns_per_vertex,vertices_per_s,peak_rss_kb\n");
+
+      // 1, 2, 4 ... threads and every core
+      unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+      dynarray<unsigned> threads;
+      for (unsigned n = 1; n < cores; n *= 2) {
+        threads.push_back(n);
+      }
+      threads.push_back(cores);
+
+      for (unsigned grid = 64; grid <= max_grid; grid *= 2) {
+        for (unsigned waves = 1; waves <= 64; waves *= 4) {
+          for (unsigned i = 0; i != threads.size(); ++i) {
+            run(grid, waves, threads[i] - 1);
+          }
+        }
+      }
+
+      bool ok = check_clipmap();
+      ok = check_refresh(0.001f) && ok;
+      ok = check_kernels(1e-4f) && ok;
+      ok = check_uploads() && ok;
+      ok = check_vertex_encoding() && ok;
+      ok = check_sample(1e-3f) && ok;
+      time_sample(8192);
+      time_buoyancy(1000);
+      return ok;
+    }
+  };
+}
+
+int main(int argc, char **argv) {
+  const char *filename = argc > 1 ? argv[1] : "ocean_bench.csv";
+  unsigned max_grid = argc > 2 ? (unsigned)atoi(argv[2]) : 2048;
+
+  FILE *csv = fopen(filename, "w");
+  if (!csv) {
+    fprintf(stderr, "can't write %s\n", filename);
+    return 1;
+  }
+
+  octet::ocean_bench bench(csv);
+  bool ok = bench.run_all(max_grid);
+  fclose(csv);
+  return ok ? 0 : 1;
+}
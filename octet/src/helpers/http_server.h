@@ -34,12 +34,14 @@ namespace octet { namespace helpers {
     void parse_http_request(session &s, char *p) {
       string header(p);
 
-      dynarray<string> lines;
+      // the arrays are only needed for this request. the strings in them still use the heap.
+
+      dynarray<string, frame_allocator> lines;
       lines.reserve(32);
       header.split(lines, "\n");
       if (lines.size() == 0) return;
 
-      dynarray<string> line0;
+      dynarray<string, frame_allocator> line0;
       lines[0].split(line0, " ");
       if (line0.size() < 3) return;
       if (line0[0] != "GET") return;
@@ -47,17 +49,17 @@ namespace octet { namespace helpers {
       log("http get from: %s\n", line0[1].c_str());
 
       // /graph?operation=get_children&id=1
-      dynarray<string> url;
+      dynarray<string, frame_allocator> url;
       line0[1].split(url, "?");
       if (url.size() < 2) return;
 
-      dynarray<string> ops;
+      dynarray<string, frame_allocator> ops;
       url[1].split(ops, "&");
       string id;
       string callback;
       bool get_children = false;
       for (unsigned i = 0; i != ops.size(); ++i) {
-        dynarray<string> lhsrhs;
+        dynarray<string, frame_allocator> lhsrhs;
         ops[i].split(lhsrhs, "=");
         if (lhsrhs[0] == "operation") {
           get_children = lhsrhs[1] == "get_children";
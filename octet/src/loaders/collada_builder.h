@@ -1220,7 +1220,17 @@ namespace octet { namespace loaders {
       const char *path = app_utils::get_path(url);
       char buf[256];
       getcwd(buf, sizeof(buf));
-      doc.LoadFile(path);
+
+      // tinyxml wants every line to end in \n. if none end in \r the file can be parsed where it is mapped
+      url_view file;
+      app_utils::get_url(file, url);
+      if (file.size() && !memchr(file.data(), '\r', file.size())) {
+        doc.Clear();
+        doc.SetValue(path);
+        doc.Parse((const char *)file.data());
+      } else {
+        doc.LoadFile(path);
+      }
 
       TiXmlElement *top = doc.RootElement();
       if (!top) {
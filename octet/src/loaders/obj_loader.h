@@ -16,7 +16,7 @@ namespace octet { namespace loaders {
     /// Load an OBJ file
     /// http://en.wikipedia.org/wiki/Wavefront_.obj_file
     bool load(const char *url, resource_dict &dict, visual_scene *scene) {
-      dynarray<uint8_t> file;
+      url_view file;
       app_utils::get_url(file, url);
       if (file.size() == 0) return false;
 
@@ -25,9 +25,9 @@ namespace octet { namespace loaders {
       material_index = 0;
       
       for (const uint8_t *src = file.data(); src != eof; ) {
-        while (*src == ' ' && src != eof) ++src;
+        while (src != eof && *src == ' ') ++src;
         const uint8_t *begin = src;
-        while (*src != '\n' && *src != '\r' && src != eof) ++src;
+        while (src != eof && *src != '\n' && *src != '\r') ++src;
         const uint8_t *end = src;
         src += src != eof && *src == '\r';
         src += src != eof && *src == '\n';
@@ -0,0 +1,543 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Math over arrays
+//
+// The vec3, vec4 and mat4t operators do one thing at a time. These functions do the same
+// sums over whole arrays, 8 at a time with AVX2 (OCTET_AVX2), 4 at a time with SSE (OCTET_SSE)
+// or one at a time otherwise. The sums are done in the same order as the operators do them, so the
+// results match the operators exactly unless the compiler is allowed to fuse multiplies and adds.
+//
+// vec3p arrays are read and written packed, three floats to an element. The SIMD paths
+// turn each group of 4 or 8 into x, y and z registers and back again with shuffles.
+//
+// Boxes and spheres are passed as separate arrays of centers, half extents and radii so that
+// they can be read the same way.
+//
+
+namespace octet { namespace math { namespace batch {
+  #if OCTET_SSE
+    // 4 packed xyz -> x, y, z. see "3D Vector Normalization Using 256-Bit Intel AVX"
+    inline void load_xyz(const float *src, __m128 &x, __m128 &y, __m128 &z) {
+      __m128 m03 = _mm_loadu_ps(src), m14 = _mm_loadu_ps(src + 4), m25 = _mm_loadu_ps(src + 8);
+      __m128 xy = _mm_shuffle_ps(m14, m25, _MM_SHUFFLE(2, 1, 3, 2));
+      __m128 yz = _mm_shuffle_ps(m03, m14, _MM_SHUFFLE(1, 0, 2, 1));
+      x = _mm_shuffle_ps(m03, xy, _MM_SHUFFLE(2, 0, 3, 0));
+      y = _mm_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+      z = _mm_shuffle_ps(yz, m25, _MM_SHUFFLE(3, 0, 3, 1));
+    }
+
+    // x, y, z -> 4 packed xyz
+    inline void store_xyz(float *dest, __m128 x, __m128 y, __m128 z) {
+      __m128 rxy = _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0));
+      __m128 ryz = _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 1, 3, 1));
+      __m128 rzx = _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 1, 2, 0));
+      _mm_storeu_ps(dest, _mm_shuffle_ps(rxy, rzx, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(dest + 4, _mm_shuffle_ps(ryz, rxy, _MM_SHUFFLE(3, 1, 2, 0)));
+      _mm_storeu_ps(dest + 8, _mm_shuffle_ps(rzx, ryz, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+
+    // x, y, z, w -> 4 xyzw
+    inline void store_xyzw(float *dest, __m128 x, __m128 y, __m128 z, __m128 w) {
+      _MM_TRANSPOSE4_PS(x, y, z, w);
+      _mm_storeu_ps(dest, x);
+      _mm_storeu_ps(dest + 4, y);
+      _mm_storeu_ps(dest + 8, z);
+      _mm_storeu_ps(dest + 12, w);
+    }
+
+    // the operations the loops below need, with the same names for both widths
+    inline void splat(__m128 &r, float f) { r = _mm_set1_ps(f); }
+    inline void load_ps(__m128 &r, const float *src) { r = _mm_loadu_ps(src); }
+    inline void store_ps(float *dest, __m128 a) { _mm_storeu_ps(dest, a); }
+    inline __m128 add_ps(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+    inline __m128 mul_ps(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+    inline __m128 and_ps(__m128 a, __m128 b) { return _mm_and_ps(a, b); }
+    inline __m128 abs_ps(__m128 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    inline __m128 neg_ps(__m128 a) { return _mm_xor_ps(_mm_set1_ps(-0.0f), a); }
+    inline __m128 cmpge_ps(__m128 a, __m128 b) { return _mm_cmpge_ps(a, b); }
+    inline __m128 true_ps(__m128) { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+    inline unsigned movemask_ps(__m128 a) { return (unsigned)_mm_movemask_ps(a); }
+  #endif
+
+  #if OCTET_AVX2
+    // 8 packed xyz -> x, y, z. elements 0-3 in the low half, 4-7 in the high half
+    inline void load_xyz(const float *src, __m256 &x, __m256 &y, __m256 &z) {
+      __m256 m03 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src)), _mm_loadu_ps(src + 12), 1);
+      __m256 m14 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src + 4)), _mm_loadu_ps(src + 16), 1);
+      __m256 m25 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src + 8)), _mm_loadu_ps(src + 20), 1);
+      __m256 xy = _mm256_shuffle_ps(m14, m25, _MM_SHUFFLE(2, 1, 3, 2));
+      __m256 yz = _mm256_shuffle_ps(m03, m14, _MM_SHUFFLE(1, 0, 2, 1));
+      x = _mm256_shuffle_ps(m03, xy, _MM_SHUFFLE(2, 0, 3, 0));
+      y = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+      z = _mm256_shuffle_ps(yz, m25, _MM_SHUFFLE(3, 0, 3, 1));
+    }
+
+    // x, y, z -> 8 packed xyz
+    inline void store_xyz(float *dest, __m256 x, __m256 y, __m256 z) {
+      __m256 rxy = _mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0));
+      __m256 ryz = _mm256_shuffle_ps(y, z, _MM_SHUFFLE(3, 1, 3, 1));
+      __m256 rzx = _mm256_shuffle_ps(z, x, _MM_SHUFFLE(3, 1, 2, 0));
+      __m256 r03 = _mm256_shuffle_ps(rxy, rzx, _MM_SHUFFLE(2, 0, 2, 0));
+      __m256 r14 = _mm256_shuffle_ps(ryz, rxy, _MM_SHUFFLE(3, 1, 2, 0));
+      __m256 r25 = _mm256_shuffle_ps(rzx, ryz, _MM_SHUFFLE(3, 1, 3, 1));
+      _mm_storeu_ps(dest, _mm256_castps256_ps128(r03));
+      _mm_storeu_ps(dest + 4, _mm256_castps256_ps128(r14));
+      _mm_storeu_ps(dest + 8, _mm256_castps256_ps128(r25));
+      _mm_storeu_ps(dest + 12, _mm256_extractf128_ps(r03, 1));
+      _mm_storeu_ps(dest + 16, _mm256_extractf128_ps(r14, 1));
+      _mm_storeu_ps(dest + 20, _mm256_extractf128_ps(r25, 1));
+    }
+
+    // x, y, z, w -> 8 xyzw, a half at a time
+    inline void store_xyzw(float *dest, __m256 x, __m256 y, __m256 z, __m256 w) {
+      store_xyzw(dest, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z), _mm256_castps256_ps128(w));
+      store_xyzw(dest + 16, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1), _mm256_extractf128_ps(w, 1));
+    }
+
+    inline void splat(__m256 &r, float f) { r = _mm256_set1_ps(f); }
+    inline void load_ps(__m256 &r, const float *src) { r = _mm256_loadu_ps(src); }
+    inline void store_ps(float *dest, __m256 a) { _mm256_storeu_ps(dest, a); }
+    inline __m256 add_ps(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+    inline __m256 mul_ps(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+    inline __m256 and_ps(__m256 a, __m256 b) { return _mm256_and_ps(a, b); }
+    inline __m256 abs_ps(__m256 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    inline __m256 neg_ps(__m256 a) { return _mm256_xor_ps(_mm256_set1_ps(-0.0f), a); }
+    inline __m256 cmpge_ps(__m256 a, __m256 b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    inline __m256 true_ps(__m256) { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+    inline unsigned movemask_ps(__m256 a) { return (unsigned)_mm256_movemask_ps(a); }
+
+    // two rows of a matrix, one in each half, times the matrix whose rows are r0 .. r3 in both halves
+    inline __m256 mul_rows(__m256 a, __m256 r0, __m256 r1, __m256 r2, __m256 r3) {
+      return _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+        _mm256_mul_ps(r0, _mm256_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0))),
+        _mm256_mul_ps(r1, _mm256_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)))),
+        _mm256_mul_ps(r2, _mm256_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)))),
+        _mm256_mul_ps(r3, _mm256_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)))
+      );
+    }
+
+    // dest = lhs * rhs with lhs loaded two rows at a time
+    inline void mul_matrix(float *dest, __m256 a, __m256 b, const float *rhs) {
+      __m256 r0 = _mm256_broadcast_ps((const __m128*)rhs), r1 = _mm256_broadcast_ps((const __m128*)(rhs + 4));
+      __m256 r2 = _mm256_broadcast_ps((const __m128*)(rhs + 8)), r3 = _mm256_broadcast_ps((const __m128*)(rhs + 12));
+      _mm256_storeu_ps(dest, mul_rows(a, r0, r1, r2, r3));
+      _mm256_storeu_ps(dest + 8, mul_rows(b, r0, r1, r2, r3));
+    }
+  #endif
+
+  #if OCTET_SSE
+    // The loops shared by both widths. Each takes the index to start at and returns the
+    // index it stopped at, leaving the last few elements for the scalar code.
+
+    // every element of a mat4t in a register of its own
+    template <class reg> void splat_matrix(reg *dest, const mat4t &m) {
+      const float *f = (const float*)&m;
+      for (int i = 0; i != 16; ++i) {
+        splat(dest[i], f[i]);
+      }
+    }
+
+    // (x, y, z, w) * m, for w = 1 (points) or w = 0 (directions)
+    template <class reg> void transform_xyz(reg &rx, reg &ry, reg &rz, reg x, reg y, reg z, const reg *m, bool points) {
+      rx = add_ps(add_ps(mul_ps(m[0], x), mul_ps(m[4], y)), mul_ps(m[8], z));
+      ry = add_ps(add_ps(mul_ps(m[1], x), mul_ps(m[5], y)), mul_ps(m[9], z));
+      rz = add_ps(add_ps(mul_ps(m[2], x), mul_ps(m[6], y)), mul_ps(m[10], z));
+      if (points) {
+        rx = add_ps(rx, m[12]);
+        ry = add_ps(ry, m[13]);
+        rz = add_ps(rz, m[14]);
+      }
+    }
+
+    template <class reg> size_t transform_loop(float *fd, const float *fs, const mat4t &mat, size_t i, size_t n, bool points) {
+      const size_t width = sizeof(reg) / sizeof(float);
+      reg m[16];
+      splat_matrix(m, mat);
+      for (; i + width <= n; i += width) {
+        reg x, y, z, rx, ry, rz;
+        load_xyz(fs + i * 3, x, y, z);
+        transform_xyz(rx, ry, rz, x, y, z, m, points);
+        store_xyz(fd + i * 3, rx, ry, rz);
+      }
+      return i;
+    }
+
+    template <class reg> size_t transform4_loop(float *fd, const float *fs, const mat4t &mat, size_t i, size_t n) {
+      const size_t width = sizeof(reg) / sizeof(float);
+      reg m[16];
+      splat_matrix(m, mat);
+      for (; i + width <= n; i += width) {
+        reg x, y, z, rx, ry, rz;
+        load_xyz(fs + i * 3, x, y, z);
+        transform_xyz(rx, ry, rz, x, y, z, m, true);
+        reg rw = add_ps(add_ps(add_ps(mul_ps(m[3], x), mul_ps(m[7], y)), mul_ps(m[11], z)), m[15]);
+        store_xyzw(fd + i * 4, rx, ry, rz, rw);
+      }
+      return i;
+    }
+
+    template <class reg> size_t transform_aabbs_loop(
+      float *dc, float *dh, const float *sc, const float *sh, const mat4t &mat, size_t i, size_t n
+    ) {
+      const size_t width = sizeof(reg) / sizeof(float);
+      reg m[16], am[16];
+      splat_matrix(m, mat);
+      for (int j = 0; j != 16; ++j) {
+        am[j] = abs_ps(m[j]);
+      }
+      for (; i + width <= n; i += width) {
+        reg x, y, z, rx, ry, rz;
+        load_xyz(sc + i * 3, x, y, z);
+        transform_xyz(rx, ry, rz, x, y, z, m, true);
+        store_xyz(dc + i * 3, rx, ry, rz);
+        load_xyz(sh + i * 3, x, y, z);
+        transform_xyz(rx, ry, rz, x, y, z, am, false);
+        store_xyz(dh + i * 3, rx, ry, rz);
+      }
+      return i;
+    }
+
+    // radius is the radius of each sphere, or null to use the half extents
+    template <class reg> size_t test_loop(
+      bool *visible, size_t &num_visible, const float *sc, const float *radius, const float *sh,
+      const vec4 *planes, size_t i, size_t n
+    ) {
+      const size_t width = sizeof(reg) / sizeof(float);
+      reg p[24], ap[18];
+      const float *fp = (const float*)planes;
+      for (int j = 0; j != 24; ++j) {
+        splat(p[j], fp[j]);
+      }
+      for (int j = 0; j != 6; ++j) {
+        for (int k = 0; k != 3; ++k) {
+          ap[j*3 + k] = abs_ps(p[j*4 + k]);
+        }
+      }
+
+      for (; i + width <= n; i += width) {
+        reg x, y, z, hx, hy, hz, r;
+        load_xyz(sc + i * 3, x, y, z);
+        if (radius) {
+          load_ps(r, radius + i);
+          r = neg_ps(r);
+        } else {
+          load_xyz(sh + i * 3, hx, hy, hz);
+        }
+        reg inside = true_ps(x);
+        for (int j = 0; j != 6; ++j) {
+          const reg *pj = p + j*4;
+          reg distance = add_ps(add_ps(add_ps(mul_ps(pj[0], x), mul_ps(pj[1], y)), mul_ps(pj[2], z)), pj[3]);
+          if (!radius) {
+            const reg *apj = ap + j*3;
+            r = neg_ps(add_ps(add_ps(mul_ps(apj[0], hx), mul_ps(apj[1], hy)), mul_ps(apj[2], hz)));
+          }
+          inside = and_ps(inside, cmpge_ps(distance, r));
+        }
+        unsigned mask = movemask_ps(inside);
+        for (size_t k = 0; k != width; ++k) {
+          bool v = ((mask >> k) & 1) != 0;
+          visible[i + k] = v;
+          num_visible += v;
+        }
+      }
+      return i;
+    }
+  #endif
+
+  // the scalar versions of the loops, for the elements left over
+  inline void transform_xyz(float *d, const float *s, const float *m, bool points) {
+    float x = s[0] * m[0] + s[1] * m[4] + s[2] * m[8];
+    float y = s[0] * m[1] + s[1] * m[5] + s[2] * m[9];
+    float z = s[0] * m[2] + s[1] * m[6] + s[2] * m[10];
+    if (points) {
+      x += m[12];
+      y += m[13];
+      z += m[14];
+    }
+    d[0] = x;
+    d[1] = y;
+    d[2] = z;
+  }
+
+  inline bool test_one(const float *c, const float *radius, const float *h, const vec4 *planes) {
+    for (int j = 0; j != 6; ++j) {
+      const float *p = (const float*)&planes[j];
+      float distance = p[0] * c[0] + p[1] * c[1] + p[2] * c[2] + p[3];
+      float r = radius ? *radius : fabsf(p[0]) * h[0] + fabsf(p[1]) * h[1] + fabsf(p[2]) * h[2];
+      if (!(distance >= -r)) return false;
+    }
+    return true;
+  }
+
+  /// dest[i] = lhs[i] * rhs, for instance every node's modelToWorld by one worldToProjection.
+  /// dest may be lhs.
+  inline void mul(mat4t *dest, const mat4t *lhs, const mat4t &rhs, size_t n) {
+    size_t i = 0;
+    #if OCTET_AVX2
+      // two rows of lhs at a time, against rhs in both halves
+      const float *r = (const float*)&rhs;
+      __m256 r0 = _mm256_broadcast_ps((const __m128*)r), r1 = _mm256_broadcast_ps((const __m128*)(r + 4));
+      __m256 r2 = _mm256_broadcast_ps((const __m128*)(r + 8)), r3 = _mm256_broadcast_ps((const __m128*)(r + 12));
+      for (; i != n; ++i) {
+        const float *src = (const float*)&lhs[i];
+        float *d = (float*)&dest[i];
+        __m256 a = _mm256_loadu_ps(src), b = _mm256_loadu_ps(src + 8);
+        _mm256_storeu_ps(d, mul_rows(a, r0, r1, r2, r3));
+        _mm256_storeu_ps(d + 8, mul_rows(b, r0, r1, r2, r3));
+      }
+    #endif
+    for (; i != n; ++i) {
+      dest[i] = lhs[i] * rhs;
+    }
+  }
+
+  /// dest[i] = lhs * rhs[i], for instance one skin's modelToBind by each of its bindToModel matrices.
+  /// dest may be rhs.
+  inline void mul(mat4t *dest, const mat4t &lhs, const mat4t *rhs, size_t n) {
+    size_t i = 0;
+    #if OCTET_AVX2
+      const float *src = (const float*)&lhs;
+      __m256 a = _mm256_loadu_ps(src), b = _mm256_loadu_ps(src + 8);
+      for (; i != n; ++i) {
+        mul_matrix((float*)&dest[i], a, b, (const float*)&rhs[i]);
+      }
+    #endif
+    for (; i != n; ++i) {
+      dest[i] = lhs * rhs[i];
+    }
+  }
+
+  /// dest[i] = lhs[i] * rhs[i]. dest may be lhs or rhs.
+  inline void mul(mat4t *dest, const mat4t *lhs, const mat4t *rhs, size_t n) {
+    size_t i = 0;
+    #if OCTET_AVX2
+      for (; i != n; ++i) {
+        const float *src = (const float*)&lhs[i];
+        mul_matrix((float*)&dest[i], _mm256_loadu_ps(src), _mm256_loadu_ps(src + 8), (const float*)&rhs[i]);
+      }
+    #endif
+    for (; i != n; ++i) {
+      dest[i] = lhs[i] * rhs[i];
+    }
+  }
+
+  /// lhs[i].invertQuick(dest[i]): the inverse of rotate and translate only matrices.
+  /// dest may not be lhs.
+  inline void invert_quick(mat4t *dest, const mat4t *lhs, size_t n) {
+    // the SSE invertQuick is a transpose and three multiply-adds, there is little left for AVX to do
+    for (size_t i = 0; i != n; ++i) {
+      lhs[i].invertQuick(dest[i]);
+    }
+  }
+
+  /// dest[i] = src[i] * m, as points (vec3 * mat4t). dest may be src.
+  inline void transform_points(vec3p *dest, const vec3p *src, const mat4t &m, size_t n) {
+    const float *fs = (const float*)src, *fm = (const float*)&m;
+    float *fd = (float*)dest;
+    size_t i = 0;
+    #if OCTET_AVX2
+      i = transform_loop<__m256>(fd, fs, m, i, n, true);
+    #endif
+    #if OCTET_SSE
+      i = transform_loop<__m128>(fd, fs, m, i, n, true);
+    #endif
+    for (; i != n; ++i) {
+      transform_xyz(fd + i * 3, fs + i * 3, fm, true);
+    }
+  }
+
+  /// dest[i] = src[i].xyz1() * m, for instance to projection space before the perspective divide.
+  inline void transform_points(vec4 *dest, const vec3p *src, const mat4t &m, size_t n) {
+    const float *fs = (const float*)src, *fm = (const float*)&m;
+    float *fd = (float*)dest;
+    size_t i = 0;
+    #if OCTET_AVX2
+      i = transform4_loop<__m256>(fd, fs, m, i, n);
+    #endif
+    #if OCTET_SSE
+      i = transform4_loop<__m128>(fd, fs, m, i, n);
+    #endif
+    for (; i != n; ++i) {
+      const float *s = fs + i * 3;
+      transform_xyz(fd + i * 4, s, fm, true);
+      fd[i * 4 + 3] = s[0] * fm[3] + s[1] * fm[7] + s[2] * fm[11] + fm[15];
+    }
+  }
+
+  /// dest[i] = (src[i].xyz0() * m).xyz(): directions, which ignore the translation.
+  /// Normals need the inverse transpose of m if m has any scale. dest may be src.
+  inline void transform_normals(vec3p *dest, const vec3p *src, const mat4t &m, size_t n) {
+    const float *fs = (const float*)src, *fm = (const float*)&m;
+    float *fd = (float*)dest;
+    size_t i = 0;
+    #if OCTET_AVX2
+      i = transform_loop<__m256>(fd, fs, m, i, n, false);
+    #endif
+    #if OCTET_SSE
+      i = transform_loop<__m128>(fd, fs, m, i, n, false);
+    #endif
+    for (; i != n; ++i) {
+      transform_xyz(fd + i * 3, fs + i * 3, fm, false);
+    }
+  }
+
+  /// Boxes (centers, half_extents) transformed by m, as aabb::get_transform() does.
+  /// The dest arrays may be the source arrays.
+  inline void transform_aabbs(
+    vec3p *dest_centers, vec3p *dest_half_extents, const vec3p *centers, const vec3p *half_extents, const mat4t &m, size_t n
+  ) {
+    const float *sc = (const float*)centers, *sh = (const float*)half_extents, *fm = (const float*)&m;
+    float *dc = (float*)dest_centers, *dh = (float*)dest_half_extents;
+    size_t i = 0;
+    #if OCTET_AVX2
+      i = transform_aabbs_loop<__m256>(dc, dh, sc, sh, m, i, n);
+    #endif
+    #if OCTET_SSE
+      i = transform_aabbs_loop<__m128>(dc, dh, sc, sh, m, i, n);
+    #endif
+    const float am[12] = {
+      fabsf(fm[0]), fabsf(fm[1]), fabsf(fm[2]), 0, fabsf(fm[4]), fabsf(fm[5]), fabsf(fm[6]), 0,
+      fabsf(fm[8]), fabsf(fm[9]), fabsf(fm[10]), 0
+    };
+    for (; i != n; ++i) {
+      transform_xyz(dc + i * 3, sc + i * 3, fm, true);
+      transform_xyz(dh + i * 3, sh + i * 3, am, false);
+    }
+  }
+
+  /// dest[i] = src[i].get_transform(m[i]), each box with its own matrix. dest may be src.
+  inline void transform_aabbs(aabb *dest, const aabb *src, const mat4t *m, size_t n) {
+    // with SSE get_transform is already a handful of instructions on one box
+    for (size_t i = 0; i != n; ++i) {
+      dest[i] = src[i].get_transform(m[i]);
+    }
+  }
+
+  /// The six planes of the view frustum of toProjection (a modelToProjection or worldToProjection matrix).
+  /// Each plane is (normal, offset) with the normal of length 1 pointing inwards, so dot(p, normal) + offset
+  /// is the distance of p inside the plane.
+  inline void get_frustum_planes(vec4 *planes, const mat4t &toProjection) {
+    // -w <= x, y, z <= w in projection space
+    vec4 x = toProjection.colx(), y = toProjection.coly(), z = toProjection.colz(), w = toProjection.colw();
+    planes[0] = w + x;
+    planes[1] = w - x;
+    planes[2] = w + y;
+    planes[3] = w - y;
+    planes[4] = w + z;
+    planes[5] = w - z;
+    for (int i = 0; i != 6; ++i) {
+      planes[i] = planes[i] * (1.0f / planes[i].xyz().length());
+    }
+  }
+
+  /// visible[i] = the sphere (centers[i], radii[i]) is at least partly inside all six planes.
+  /// Returns the number that are.
+  inline size_t test_spheres(bool *visible, const vec3p *centers, const float *radii, const vec4 *planes, size_t n) {
+    const float *sc = (const float*)centers;
+    size_t i = 0, num_visible = 0;
+    #if OCTET_AVX2
+      i = test_loop<__m256>(visible, num_visible, sc, radii, 0, planes, i, n);
+    #endif
+    #if OCTET_SSE
+      i = test_loop<__m128>(visible, num_visible, sc, radii, 0, planes, i, n);
+    #endif
+    for (; i != n; ++i) {
+      visible[i] = test_one(sc + i * 3, radii + i, 0, planes);
+      num_visible += visible[i];
+    }
+    return num_visible;
+  }
+
+  /// visible[i] = the box (centers[i], half_extents[i]) is at least partly inside all six planes.
+  /// Boxes near the corners of the frustum may pass without being inside. Returns the number that pass.
+  inline size_t test_aabbs(bool *visible, const vec3p *centers, const vec3p *half_extents, const vec4 *planes, size_t n) {
+    const float *sc = (const float*)centers, *sh = (const float*)half_extents;
+    size_t i = 0, num_visible = 0;
+    #if OCTET_AVX2
+      i = test_loop<__m256>(visible, num_visible, sc, 0, sh, planes, i, n);
+    #endif
+    #if OCTET_SSE
+      i = test_loop<__m128>(visible, num_visible, sc, 0, sh, planes, i, n);
+    #endif
+    for (; i != n; ++i) {
+      visible[i] = test_one(sc + i * 3, 0, sh + i * 3, planes);
+      num_visible += visible[i];
+    }
+    return num_visible;
+  }
+
+  /// dest[i] = dot(a[i], b[i])
+  inline void dot(float *dest, const vec3p *a, const vec3p *b, size_t n) {
+    const float *fa = (const float*)a, *fb = (const float*)b;
+    size_t i = 0;
+    #if OCTET_AVX2
+      for (; i + 8 <= n; i += 8) {
+        __m256 ax, ay, az, bx, by, bz;
+        load_xyz(fa + i * 3, ax, ay, az);
+        load_xyz(fb + i * 3, bx, by, bz);
+        __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+        _mm256_storeu_ps(dest + i, d);
+      }
+    #endif
+    #if OCTET_SSE
+      for (; i + 4 <= n; i += 4) {
+        __m128 ax, ay, az, bx, by, bz;
+        load_xyz(fa + i * 3, ax, ay, az);
+        load_xyz(fb + i * 3, bx, by, bz);
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+        _mm_storeu_ps(dest + i, d);
+      }
+    #endif
+    for (; i != n; ++i) {
+      const float *pa = fa + i * 3, *pb = fb + i * 3;
+      dest[i] = pa[0] * pb[0] + pa[1] * pb[1] + pa[2] * pb[2];
+    }
+  }
+
+  /// dest[i] = cross(a[i], b[i]). dest may be a or b.
+  inline void cross(vec3p *dest, const vec3p *a, const vec3p *b, size_t n) {
+    const float *fa = (const float*)a, *fb = (const float*)b;
+    float *fd = (float*)dest;
+    size_t i = 0;
+    #if OCTET_AVX2
+      for (; i + 8 <= n; i += 8) {
+        __m256 ax, ay, az, bx, by, bz;
+        load_xyz(fa + i * 3, ax, ay, az);
+        load_xyz(fb + i * 3, bx, by, bz);
+        store_xyz(
+          fd + i * 3,
+          _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by)),
+          _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz)),
+          _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx))
+        );
+      }
+    #endif
+    #if OCTET_SSE
+      for (; i + 4 <= n; i += 4) {
+        __m128 ax, ay, az, bx, by, bz;
+        load_xyz(fa + i * 3, ax, ay, az);
+        load_xyz(fb + i * 3, bx, by, bz);
+        store_xyz(
+          fd + i * 3,
+          _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)),
+          _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz)),
+          _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx))
+        );
+      }
+    #endif
+    for (; i != n; ++i) {
+      const float *pa = fa + i * 3, *pb = fb + i * 3;
+      float x = pa[1] * pb[2] - pa[2] * pb[1];
+      float y = pa[2] * pb[0] - pa[0] * pb[2];
+      float z = pa[0] * pb[1] - pa[1] * pb[0];
+      float *pd = fd + i * 3;
+      pd[0] = x;
+      pd[1] = y;
+      pd[2] = z;
+    }
+  }
+} } }
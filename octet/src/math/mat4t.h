@@ -278,9 +278,17 @@ namespace octet { namespace math {
     // works for orthonormal rotation component matrices
     void invertQuick(mat4t &d) const {
       // transpose x, y, z
-      for (int i = 0; i != 3; ++i) {
-        d[i] = vec4(v[0][i], v[1][i], v[2][i], 0.0f);
-      }
+      #if OCTET_SSE
+        __m128 x = v[0].get_m(), y = v[1].get_m(), z = v[2].get_m(), w = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        d[0] = vec4(x);
+        d[1] = vec4(y);
+        d[2] = vec4(z);
+      #else
+        for (int i = 0; i != 3; ++i) {
+          d[i] = vec4(v[0][i], v[1][i], v[2][i], 0.0f);
+        }
+      #endif
       d[3] = vec4(0, 0, 0, 1);
       // translate by new matrix
       d[3] = d.lmul(vec4(-v[3][0], -v[3][1], -v[3][2], 1.0f));
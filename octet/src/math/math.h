@@ -87,4 +87,7 @@ namespace octet {
 #include "zcylinder.h"
 #include "voxel_grid.h"
 
+// arrays
+#include "batch.h"
+
 #endif
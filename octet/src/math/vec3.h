@@ -438,12 +438,10 @@ namespace octet { namespace math {
     vec3p(const vec3p &in) { v[0] = in.v[0]; v[1] = in.v[1]; v[2] = in.v[2]; }
     vec3p(const vec3 &in) {
       #if OCTET_SSE
-        static const u_m128_i4 mask = { -1, -1, -1, 0 };
-        #ifdef OCTET_MAC
-          _mm_maskmoveu_si128(in.get_m(), (__m128i&)mask.m, (char*)v);
-        #else
-          _mm_maskmoveu_si128((__m128i&)in.get_m(), (__m128i&)mask.m, (char*)v);
-        #endif
+        // x and y, then z. (maskmoveu is a non-temporal store, so reading v back missed the cache)
+        __m128 m = in.get_m();
+        _mm_storel_pi((__m64*)v, m);
+        _mm_store_ss(v + 2, _mm_movehl_ps(m, m));
       #else
         v[0] = in[0]; v[1] = in[1]; v[2] = in[2];
       #endif
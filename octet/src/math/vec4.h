@@ -34,6 +34,10 @@ namespace octet { namespace math {
       OCTET_HOT vec4(__m128 m) {
         this->m = m;
       }
+
+      OCTET_HOT __m128 get_m() const {
+        return m;
+      }
     #endif
 
     OCTET_HOT vec4(const vec4 &rhs) {
@@ -169,7 +169,9 @@ namespace octet {
       return frame_number;
     }
 
+    // called by the platform after draw_world. temporary frame data is thrown away here.
     void inc_frame_number() {
+      frame_allocator::end_frame();
       frame_number++;
     }
 
@@ -31,11 +31,23 @@
   #pragma warning(disable : 4996)
 #endif
 
+// SSE2 is part of every x86-64 chip. build with -D OCTET_SSE=0 to use the scalar math instead.
+#if defined(OCTET_LINUX) && (defined(__x86_64__) || defined(__SSE2__)) && !defined(OCTET_SSE)
+  #define OCTET_SSE 1
+  #include <emmintrin.h>
+#endif
+
 #if OCTET_MAC
   #define OCTET_SSE 1
   #define GL_UNIFORM_BUFFER 0
 #endif
 
+// the 8 wide paths in math/batch.h. build with -mavx2 (or /arch:AVX2 on windows) to use them.
+#if OCTET_SSE && defined(__AVX2__) && !defined(OCTET_AVX2)
+  #define OCTET_AVX2 1
+  #include <immintrin.h>
+#endif
+
 // use <> to include from standard directories
 // use "" to include from our own project
 #include <stdio.h>
@@ -54,6 +66,13 @@
 #include <numeric>
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <type_traits>
+#include <utility>
+#include <chrono>
 
 #if defined(WIN32)
   #include <direct.h>
@@ -118,6 +118,16 @@ namespace octet { namespace resources {
       }
     }
 
+    /// Get a read-only view of a file, given a URL.
+    /// Plain files are mapped and parsed in place, zip:// files are copied as get_url(buffer, url) would.
+    static void get_url(url_view &view, const char *url, file_map::access pattern = file_map::access_sequential) {
+      if (strncmp(url, "zip://", 6) && strncmp(url, "http://", 7)) {
+        if (view.set_map(new file_map(get_path(url), pattern))) return;
+      }
+      get_url(view.begin_copy(), url);
+      view.end_copy();
+    }
+
     /// Generate a stock texture. To be deprecated.
     static GLuint get_stock_texture(unsigned gl_kind, const char *name) {
       //stock_texture_generator stock;
@@ -7,6 +7,15 @@
 // map a file to memory
 
 class file_map {
+public:
+  /// how the mapping is going to be read, a hint for the OS page cache
+  enum access {
+    access_normal,
+    access_sequential,  // front to back once: read ahead hard and drop pages behind
+    access_random,      // jumping around: don't read ahead
+  };
+
+private:
   #ifdef WIN32
     HANDLE file_handle;
     HANDLE mapping_handle;
@@ -16,23 +25,37 @@ class file_map {
   uint64_t size;
   const uint8_t *data;
   const char *error;
+
+  // not copyable: the destructor unmaps
+  file_map(const file_map &);
+  void operator=(const file_map &);
+
 public:
-  file_map(const char *file_name) {
+  file_map(const char *file_name, access pattern = access_normal) {
     error = 0;
     data = 0;
     size = 0;
 
+    #ifdef WIN32
+      file_handle = INVALID_HANDLE_VALUE;
+      mapping_handle = 0;
+    #else
+      file_handle = -1;
+    #endif
+
     if (file_name == NULL) {
       error = "no file name";
       return;
     }
 
     #ifdef WIN32
-      mapping_handle = INVALID_HANDLE_VALUE;
+      DWORD flags = FILE_ATTRIBUTE_NORMAL;
+      flags |= pattern == access_sequential ? FILE_FLAG_SEQUENTIAL_SCAN : 0;
+      flags |= pattern == access_random ? FILE_FLAG_RANDOM_ACCESS : 0;
 
       file_handle = CreateFileA(
         file_name, GENERIC_READ, FILE_SHARE_READ, 0,
-        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0
+        OPEN_EXISTING, flags, 0
       );
 
       if (file_handle == INVALID_HANDLE_VALUE) {
@@ -42,29 +65,89 @@ public:
 
       DWORD sizehi = 0, sizelo = GetFileSize(file_handle, &sizehi);
       size = ((uint64_t)sizehi << 32) | sizelo;
+      if (size == 0) {
+        error = "empty file";
+        return;
+      }
+
+      // CreateFileMapping returns null, not INVALID_HANDLE_VALUE, when it fails
       mapping_handle = CreateFileMappingA(file_handle, 0, PAGE_READONLY, 0, 0, 0);
 
-      if (mapping_handle == INVALID_HANDLE_VALUE) {
+      if (mapping_handle == 0) {
         error = "could not map file";
         return;
       }
 
       data = (const uint8_t *)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
     #else
-      //file_handle = open(file_name, O_RDONLY);
-      //mmap
+      file_handle = open(file_name, O_RDONLY);
+      if (file_handle < 0) {
+        error = "could not open file";
+        return;
+      }
+
+      struct stat info;
+      if (fstat(file_handle, &info) != 0) {
+        error = "could not open file";
+        return;
+      }
+
+      size = (uint64_t)info.st_size;
+      if (size == 0) {
+        error = "empty file";
+        return;
+      }
+
+      void *ptr = mmap(0, (size_t)size, PROT_READ, MAP_PRIVATE, file_handle, 0);
+      if (ptr == MAP_FAILED) {
+        error = "could not map file";
+        return;
+      }
+      data = (const uint8_t *)ptr;
+
+      if (pattern == access_sequential) {
+        madvise(ptr, (size_t)size, MADV_SEQUENTIAL);
+        madvise(ptr, (size_t)size, MADV_WILLNEED);
+      } else if (pattern == access_random) {
+        madvise(ptr, (size_t)size, MADV_RANDOM);
+      }
     #endif
+
+    if (!data) {
+      error = "could not map file";
+      size = 0;
+    }
   }
 
   ~file_map() {
     #ifdef WIN32
-      UnmapViewOfFile(data);
-      CloseHandle(file_handle);
-      CloseHandle(mapping_handle);
+      if (data) UnmapViewOfFile(data);
+      if (mapping_handle) CloseHandle(mapping_handle);
+      if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
     #else
+      if (data) munmap((void *)data, (size_t)size);
+      if (file_handle >= 0) close(file_handle);
     #endif
   }
 
+  /// ask for bytes [offset, offset+bytes) to be read in ahead of being touched.
+  void will_need(uint64_t offset, uint64_t bytes) const {
+    if (!data || offset >= size) return;
+    bytes = std::min(bytes, size - offset);
+    #ifndef WIN32
+      // madvise wants a page aligned start
+      uint64_t start = offset & ~(uint64_t)(get_page_size() - 1);
+      madvise((void *)(data + start), (size_t)(offset + bytes - start), MADV_WILLNEED);
+    #endif
+  }
+
+  /// true if there is a zero byte just past the end of the data.
+  /// the last page of a mapping is zero filled beyond the end of the file,
+  /// so only files a whole number of pages long are not terminated.
+  bool is_zero_terminated() const {
+    return data && (size & (get_page_size() - 1)) != 0;
+  }
+
   const char *get_error() const {
     return error;
   }
@@ -76,5 +159,16 @@ public:
   uint64_t get_size() const {
     return size;
   }
+
+  /// the granularity of mappings
+  static uint64_t get_page_size() {
+    #ifdef WIN32
+      SYSTEM_INFO info;
+      GetSystemInfo(&info);
+      return info.dwPageSize;
+    #else
+      return (uint64_t)sysconf(_SC_PAGESIZE);
+    #endif
+  }
 };
 
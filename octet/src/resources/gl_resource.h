@@ -37,6 +37,19 @@ namespace octet { namespace resources {
       float *f32() const { return (float*)ptr; }
     };
 
+    /// Helper class to make a write-only lock that throws away the old contents
+    class wdlock {
+      gl_resource *res;
+      void *ptr;
+    public:
+      wdlock(gl_resource *res) { this->res = res; ptr = res->lock_write_discard(); }
+      ~wdlock() { res->unlock_write_only(); }
+      uint8_t *u8() const { return (uint8_t*)ptr; }
+      uint16_t *u16() const { return (uint16_t*)ptr; }
+      uint32_t *u32() const { return (uint32_t*)ptr; }
+      float *f32() const { return (float*)ptr; }
+    };
+
     /// Helper class to make a read-write lock
     class rwlock {
       gl_resource *res;
@@ -203,6 +216,24 @@ namespace octet { namespace resources {
       #endif
     }
 
+    /// get a write-only lock on this buffer, discarding the old contents.
+    /// The driver can hand us fresh memory (orphaning) instead of waiting for the GPU to finish with the old data.
+    /// Use this for buffers that are completely rewritten every frame.
+    void *lock_write_discard() const {
+      #ifdef OCTET_GLES2
+        return (void*)&bytes[0];
+      #else
+        glBindBuffer(target, buffer);
+        #ifdef __APPLE__
+          // orphan the old storage by respecifying it
+          glBufferData(target, size, NULL, GL_STREAM_DRAW);
+          return glMapBuffer(target, GL_WRITE_ONLY);
+        #else
+          return glMapBufferRange(target, 0, size, GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_BUFFER_BIT);
+        #endif
+      #endif
+    }
+
     /// release a read-write lock
     /// deprecated
     void unlock_write_only() const {
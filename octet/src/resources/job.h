@@ -4,52 +4,418 @@
 //
 // Modular Framework for OpenGLES2 rendering on multiple platforms.
 //
-// work in progress
+// jobs and a work stealing scheduler to run them
+//
+// Each worker thread has a deque of jobs. It pushes and pops the jobs it makes at the back, so
+// it works depth first on things that are still in its cache, and when it runs out it steals
+// from the front of the other workers' deques, where the oldest and usually biggest jobs are.
+// Threads outside the pool hand their jobs to the workers in turn.
+//
+// A thread that waits for a job_counter runs queued jobs until the counter reaches zero
+// rather than sleeping, so the main thread does its share and nested waits can't deadlock.
+//
+// In serial mode (set_serial(), or build with OCTET_SERIAL_JOBS) the workers sit idle and
+// jobs run one at a time on the waiting thread, in the order they became ready. Use it to
+// take threading out of the picture when debugging.
+//
 
 namespace octet { namespace resources {
+  class job_scheduler;
+
+  /// Counts unfinished jobs submitted with it. See job_scheduler::wait().
+  class job_counter {
+    friend class job_scheduler;
+    std::atomic<unsigned> count;
+
+    job_counter(const job_counter &);
+    void operator=(const job_counter &);
+  public:
+    job_counter() : count(0) {
+    }
+
+    ~job_counter() {
+      assert(count == 0 && "job_counter destroyed while jobs are running");
+    }
+
+    /// true once every job submitted with this counter has finished.
+    bool is_done() const {
+      return count == 0;
+    }
+  };
+
+  /// A piece of work for a job_scheduler.
+  /// The job must stay alive until it has finished, for example by waiting on its counter.
   class job : public resource {
-    ref<job> next;
+    friend class job_scheduler;
 
+  public:
     enum state_t {
-      state_waiting,
+      state_new,        // not submitted yet
+      state_waiting,    // submitted, waiting for the jobs it depends on
+      state_queued,     // in a worker's deque
       state_running,
+      state_done,
     };
 
+  private:
+    // guarded by the scheduler's lock once the job has been submitted
     state_t state;
+    unsigned dependencies;      // unfinished jobs this one waits for
+    dynarray<job*> dependents;  // jobs waiting for this one
+    job_counter *counter;
+
+  public:
+    job() {
+      state = state_new;
+      dependencies = 0;
+      counter = 0;
+    }
+
+    virtual ~job() {
+    }
+
+    /// do the work.
+    virtual void kernel() = 0;
+
+    /// a job whose dependencies have finished is only run when this is true.
+    /// a job that isn't ready is put back and asked again later, so only use this for things that will soon be true.
+    virtual bool is_ready() {
+      return true;
+    }
+
+    state_t get_state() {
+      return state;
+    }
+  };
+
+  /// A pool of worker threads that run jobs.
+  class job_scheduler {
+    struct job_deque {
+      std::mutex lock;
+      std::deque<job*> jobs;
+    };
+
+    std::vector<std::thread> threads;
+    job_deque *deques;                  // one per worker, or one for the waiting threads if there are none
+    unsigned num_deques;
 
-    class scheduler {
-      job *waiting;
-      job *running;
+    std::mutex lock;                    // dependencies and sleeping
+    std::condition_variable wake;
+    std::atomic<unsigned> num_queued;   // jobs in all the deques
+    std::atomic<unsigned> num_sleeping; // threads waiting on wake
+    std::atomic<unsigned> next_deque;   // where threads outside the pool put the next job
+    std::atomic<bool> serial;
+    bool quitting;
+
+    // calls fn(i) for i = first .. end-1 a grain at a time, shared between the caller and its helpers.
+    template <class fn_t> class range_job : public job {
+      std::atomic<unsigned> *next;
+      unsigned end;
+      unsigned grain;
+      fn_t *fn;
     public:
-      scheduler() {
-        waiting = 0;
-        running = 0;
+      void init(std::atomic<unsigned> *next, unsigned end, unsigned grain, fn_t *fn) {
+        this->next = next;
+        this->end = end;
+        this->grain = grain;
+        this->fn = fn;
       }
 
-      void add_to_waiting(job *jb) {
-        jb->next = waiting;
-        waiting = this;
+      void kernel() {
+        for (;;) {
+          unsigned first = next->fetch_add(grain);
+          if (first >= end) break;
+          unsigned last = std::min(end, first + grain);
+          for (unsigned i = first; i != last; ++i) {
+            (*fn)(i);
+          }
+        }
       }
     };
 
-    scheduler *get_scheduler() {
-      static scheduler sch;
-      return &sch;
+    // the scheduler and worker index of the calling thread, set as each worker starts.
+    // reading threads here would race with start() adding to it.
+    struct worker_id {
+      const job_scheduler *scheduler;
+      int index;
+    };
+
+    static worker_id &this_worker() {
+      static thread_local worker_id id = { 0, -1 };
+      return id;
+    }
+
+    // index of the calling thread in the pool, -1 if it is not a worker
+    int get_worker_index() const {
+      const worker_id &id = this_worker();
+      return id.scheduler == this ? id.index : -1;
+    }
+
+    void wake_one() {
+      if (num_sleeping != 0) {
+        std::lock_guard<std::mutex> guard(lock);
+        wake.notify_one();
+      }
+    }
+
+    void wake_all() {
+      if (num_sleeping != 0) {
+        std::lock_guard<std::mutex> guard(lock);
+        wake.notify_all();
+      }
+    }
+
+    // put a ready job in a deque. at the front if it is being put back because is_ready() said no.
+    void push(job *jb, bool at_front = false) {
+      int self = get_worker_index();
+      unsigned index = serial ? 0 : self >= 0 ? (unsigned)self : next_deque++ % num_deques;
+      job_deque &d = deques[index];
+      num_queued++;
+      {
+        std::lock_guard<std::mutex> guard(d.lock);
+        if (at_front) {
+          d.jobs.push_front(jb);
+        } else {
+          d.jobs.push_back(jb);
+        }
+      }
+      wake_one();
+    }
+
+    // the next job for this thread: its own newest, or someone else's oldest
+    job *pop(int self) {
+      if (num_queued == 0) return 0;
+      if (serial) {
+        // one deque, in order
+        job_deque &d = deques[0];
+        std::lock_guard<std::mutex> guard(d.lock);
+        if (d.jobs.empty()) return 0;
+        job *jb = d.jobs.front();
+        d.jobs.pop_front();
+        num_queued--;
+        return jb;
+      }
+
+      if (self >= 0) {
+        job_deque &d = deques[self];
+        std::lock_guard<std::mutex> guard(d.lock);
+        if (!d.jobs.empty()) {
+          job *jb = d.jobs.back();
+          d.jobs.pop_back();
+          num_queued--;
+          return jb;
+        }
+      }
+
+      unsigned start = self >= 0 ? (unsigned)self + 1 : 0;
+      for (unsigned i = 0; i != num_deques; ++i) {
+        job_deque &d = deques[(start + i) % num_deques];
+        std::lock_guard<std::mutex> guard(d.lock);
+        if (!d.jobs.empty()) {
+          job *jb = d.jobs.front();
+          d.jobs.pop_front();
+          num_queued--;
+          return jb;
+        }
+      }
+      return 0;
+    }
+
+    // run a job and release the jobs that were waiting for it. false if it wasn't ready
+    bool run(job *jb) {
+      if (!jb->is_ready()) {
+        push(jb, true);
+        return false;
+      }
+
+      jb->state = job::state_running;
+      jb->kernel();
+
+      // the job may be freed as soon as its counter is done, so take what we need first
+      job_counter *counter = jb->counter;
+      dynarray<job*> released;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        jb->state = job::state_done;
+        for (unsigned i = 0; i != jb->dependents.size(); ++i) {
+          job *dependent = jb->dependents[i];
+          if (--dependent->dependencies == 0 && dependent->state == job::state_waiting) {
+            dependent->state = job::state_queued;
+            released.push_back(dependent);
+          }
+        }
+        jb->dependents.reset();
+      }
+
+      for (unsigned i = 0; i != released.size(); ++i) {
+        push(released[i]);
+      }
+
+      if (counter && --counter->count == 0) {
+        wake_all();
+      }
+      return true;
     }
+
+    void worker_loop(unsigned self) {
+      this_worker().scheduler = this;
+      this_worker().index = (int)self;
+      for (;;) {
+        job *jb = serial ? 0 : pop((int)self);
+        if (jb) {
+          if (!run(jb)) std::this_thread::yield();
+          continue;
+        }
+
+        std::unique_lock<std::mutex> guard(lock);
+        if (quitting) return;
+        num_sleeping++;
+        wake.wait(guard, [&]{ return quitting || (!serial && num_queued != 0); });
+        num_sleeping--;
+      }
+    }
+
+    void start(unsigned num_workers) {
+      quitting = false;
+      num_deques = std::max(num_workers, 1u);
+      deques = new job_deque[num_deques];
+      threads.reserve(num_workers);
+      for (unsigned i = 0; i != num_workers; ++i) {
+        threads.push_back(std::thread(&job_scheduler::worker_loop, this, i));
+      }
+    }
+
+    void stop() {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        quitting = true;
+      }
+      wake.notify_all();
+      for (size_t i = 0; i != threads.size(); ++i) {
+        threads[i].join();
+      }
+      threads.clear();
+      assert(num_queued == 0 && "job_scheduler stopped with jobs still queued");
+      delete [] deques;
+      deques = 0;
+    }
+
+    job_scheduler(const job_scheduler &);
+    void operator=(const job_scheduler &);
+
   public:
-    job() {
-      scheduler *sch = get_scheduler();
-      sch->add_to_waiting(this);
+    /// start a pool of num_workers threads. the threads that wait on counters help as well,
+    /// so 0 runs every job on the waiting threads.
+    job_scheduler(unsigned num_workers) : num_queued(0), num_sleeping(0), next_deque(0), serial(false) {
+      #ifdef OCTET_SERIAL_JOBS
+        serial = true;
+      #endif
+      deques = 0;
+      start(num_workers);
     }
 
-    virtual ~job() {
+    ~job_scheduler() {
+      stop();
     }
 
-    virtual void kernel() = 0;
-    virtual bool is_ready() = 0;
+    /// a scheduler for everyone to share, with a worker for every core but the calling thread's.
+    static job_scheduler *get_shared() {
+      static job_scheduler shared(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+      return &shared;
+    }
 
-    state_t get_state() {
-      return state;
+    /// worker threads, not counting the threads that wait
+    unsigned get_num_workers() const {
+      return (unsigned)threads.size();
+    }
+
+    /// stop the workers and start num_workers new ones. only when no jobs are queued.
+    void resize(unsigned num_workers) {
+      stop();
+      start(num_workers);
+    }
+
+    /// run every job on the waiting thread, one at a time in the order they became ready.
+    /// only change this when no jobs are queued.
+    void set_serial(bool value) {
+      assert(num_queued == 0);
+      serial = value;
+    }
+
+    bool get_serial() const {
+      return serial;
+    }
+
+    /// jb won't run until on has finished. call before submitting jb.
+    void add_dependency(job *jb, job *on) {
+      std::lock_guard<std::mutex> guard(lock);
+      assert(jb->state == job::state_new);
+      if (on->state != job::state_done) {
+        on->dependents.push_back(jb);
+        jb->dependencies++;
+      }
+    }
+
+    /// queue a job, to run once the jobs it depends on have finished. counter, if any, counts it until it has run.
+    void submit(job *jb, job_counter *counter = 0) {
+      assert(jb->state == job::state_new);
+      jb->counter = counter;
+      if (counter) counter->count++;
+
+      bool ready;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        ready = jb->dependencies == 0;
+        jb->state = ready ? job::state_queued : job::state_waiting;
+      }
+      if (ready) push(jb);
+    }
+
+    /// run queued jobs on this thread until every job submitted with counter has finished.
+    void wait(job_counter &counter) {
+      int self = get_worker_index();
+      while (counter.count != 0) {
+        job *jb = pop(self);
+        if (jb) {
+          if (!run(jb)) std::this_thread::yield();
+          continue;
+        }
+
+        std::unique_lock<std::mutex> guard(lock);
+        num_sleeping++;
+        wake.wait(guard, [&]{ return counter.count == 0 || num_queued != 0; });
+        num_sleeping--;
+      }
+    }
+
+    /// call fn(i) for i = 0 .. num_tasks-1, a grain of tasks at a time, on the workers and this thread.
+    /// returns when every call has returned.
+    template <class fn_t> void parallel_for(unsigned num_tasks, fn_t &fn, unsigned grain = 1) {
+      if (num_tasks == 0) return;
+      grain = std::max(grain, 1u);
+      unsigned num_grains = (num_tasks + grain - 1) / grain;
+
+      if (serial || threads.empty() || num_grains == 1) {
+        for (unsigned i = 0; i != num_tasks; ++i) {
+          fn(i);
+        }
+        return;
+      }
+
+      // one helper for each worker that can have a grain, and this thread takes grains as well
+      std::atomic<unsigned> next(0);
+      unsigned num_helpers = std::min(get_num_workers(), num_grains - 1);
+      range_job<fn_t> *helpers = new range_job<fn_t>[num_helpers + 1];
+      job_counter counter;
+      for (unsigned i = 0; i != num_helpers + 1; ++i) {
+        helpers[i].init(&next, num_tasks, grain, &fn);
+      }
+      for (unsigned i = 0; i != num_helpers; ++i) {
+        submit(&helpers[i], &counter);
+      }
+      helpers[num_helpers].kernel();
+      wait(counter);
+      delete [] helpers;
     }
   };
 } }
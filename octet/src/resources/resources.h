@@ -19,6 +19,7 @@
   // resources
   #include "../resources/file_map.h"
   #include "../resources/zip_file.h"
+  #include "../resources/url_view.h"
   #include "../resources/app_utils.h"
   #include "../resources/visitor.h"
   #include "../resources/binary_writer.h"
@@ -26,6 +27,7 @@
   #include "../resources/xml_writer.h"
   #include "../resources/http_writer.h"
   #include "../resources/resource.h"
+  #include "../resources/job.h"
   #include "../resources/resource_dict.h"
   #include "../resources/gl_resource.h"
   #include "../resources/bitmap_font.h"
@@ -0,0 +1,91 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012-2014
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// read-only bytes of a url
+//
+
+namespace octet { namespace resources {
+  /// Read-only bytes of a url, filled in by app_utils::get_url(url_view &, url).
+  /// A plain file is mapped rather than read, so no copy is made and pages are only read as they are touched.
+  /// Anything else (zip://, or a file that can't be mapped) is copied.
+  /// Either way there is a zero byte after the last one, so text can be parsed in place.
+  class url_view {
+    file_map *map;
+    dynarray<uint8_t> copy;
+    const uint8_t *bytes;
+    size_t num_bytes;
+
+    // not copyable: owns the mapping
+    url_view(const url_view &);
+    void operator=(const url_view &);
+
+  public:
+    url_view() {
+      map = 0;
+      bytes = 0;
+      num_bytes = 0;
+    }
+
+    ~url_view() {
+      reset();
+    }
+
+    /// let go of the mapping or the copy
+    void reset() {
+      delete map;
+      map = 0;
+      copy.reset();
+      bytes = 0;
+      num_bytes = 0;
+    }
+
+    /// view a mapping, which this then owns.
+    /// if it can't be viewed in place (failed, or no zero after it) it is deleted and false is returned.
+    bool set_map(file_map *value) {
+      reset();
+      if (!value->get_data() || !value->is_zero_terminated() || value->get_size() >= (size_t)~0) {
+        delete value;
+        return false;
+      }
+      map = value;
+      bytes = map->get_data();
+      num_bytes = (size_t)map->get_size();
+      return true;
+    }
+
+    /// get a buffer to copy the bytes into, then call end_copy()
+    dynarray<uint8_t> &begin_copy() {
+      reset();
+      return copy;
+    }
+
+    /// view the bytes copied into begin_copy()
+    void end_copy() {
+      num_bytes = copy.size();
+      copy.push_back(0);
+      bytes = copy.data();
+    }
+
+    /// the first byte. data()[size()] is always zero
+    const uint8_t *data() const {
+      return bytes;
+    }
+
+    size_t size() const {
+      return num_bytes;
+    }
+
+    const uint8_t &operator[](size_t i) const {
+      return bytes[i];
+    }
+
+    /// true if the bytes are in place in a mapping of the file
+    bool is_mapped() const {
+      return map != 0;
+    }
+  };
+} }
+
@@ -218,7 +218,7 @@ namespace octet { namespace resources {
     }
 
     /// Call this in your "visit" method for dynarrays of references
-    template <class type> void visit(dynarray<ref<type> > &value, atom_t sid) {
+    template <class type, unsigned inline_capacity> void visit(dynarray<ref<type>, allocator, true, inline_capacity> &value, atom_t sid) {
       if (error) return;
       int size = value.size();
       if (begin_refs(sid, size, false)) {
@@ -316,7 +316,7 @@ namespace octet { namespace resources {
     }
 
     /// Call this in your "visit" method for dynarrays of POD types (except references)
-    template <class type> void visit(dynarray<type> &value, atom_t sid) {
+    template <class type, unsigned inline_capacity> void visit(dynarray<type, allocator, true, inline_capacity> &value, atom_t sid) {
       if (error) return;
       if (is_reader()) {
         unsigned size = begin_read_dynarray(sizeof(value[0]), sid);
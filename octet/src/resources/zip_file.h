@@ -11,7 +11,7 @@ namespace octet { namespace resources {
   /// They make updates easier and work will over the internet.
   class zip_file {
     int ref_cnt;
-    FILE *the_file;
+    file_map map;
 
     struct dir_entry {
       uint32_t offset;
@@ -42,29 +42,25 @@ namespace octet { namespace resources {
     }
 
   public:
-    /// Open a zip file for reading
-    zip_file(const char *filename) {
+    /// Open a zip file for reading. The archive is mapped, not read, so only the files taken out of it are paged in.
+    zip_file(const char *filename) : map(filename, file_map::access_random) {
       ref_cnt = 0;
-      the_file = fopen(filename, "rb");
-      if (!the_file) {
+      if (map.get_error()) {
         printf("file %s not found\n", filename);
       } else {
-        uint8_t tmp[256];
-        unsigned tmp_size = (unsigned)sizeof(tmp);
-        fseek(the_file, 0, SEEK_END);
-        long file_size = ftell(the_file);
-        long search_offset = file_size - (long)tmp_size;
-        search_offset = search_offset < 0 ? 0 : search_offset;
-        fseek(the_file, search_offset, SEEK_SET);
-        fread(&tmp, 1, tmp_size, the_file);
-        for( unsigned i = 0; i != tmp_size; ++i) {
+        // the end of central directory record is in the last few bytes
+        const uint8_t *begin = map.get_data();
+        size_t file_size = (size_t)map.get_size();
+        const uint8_t *tmp = begin + (file_size < 256 ? 0 : file_size - 256);
+        unsigned tmp_size = (unsigned)(begin + file_size - tmp);
+        for( unsigned i = 0; i + 20 <= tmp_size; ++i) {
           if (u4(tmp + i) == 0x06054b50) {
-            dynarray<uint8_t> dir;
-            dir.resize(u4(tmp + i + 12));
-            fseek(the_file, (long)u4(tmp + i + 16), SEEK_SET);
-            fread(&dir[0], 1, dir.size(), the_file);
-            for (unsigned i = 0; i + 4 < dir.size();) {
-              uint8_t *p = &dir[i];
+            size_t dir_size = u4(tmp + i + 12);
+            size_t dir_offset = u4(tmp + i + 16);
+            if (dir_offset > file_size || dir_size > file_size - dir_offset) break;
+            const uint8_t *dir = begin + dir_offset;
+            for (unsigned i = 0; i + 46 <= dir_size;) {
+              const uint8_t *p = &dir[i];
               if (u4(p) != 0x02014b50) break;
               struct dir_entry d;
               d.compression = u2(p + 10);
@@ -72,9 +68,11 @@ namespace octet { namespace resources {
               d.usize = u4(p + 24);
               unsigned file_name_len = u2(p + 28);
               unsigned extra_len = u2(p + 30);
+              unsigned comment_len = u2(p + 32);
+              if (i + 46 + file_name_len > dir_size) break;
               string file;
               file.set((const char*)(p + 46), file_name_len);
-              i += 46 + file_name_len + extra_len;
+              i += 46 + file_name_len + extra_len + comment_len;
               d.offset = u4(p + 42);// + (46 + file_name_len + extra_len);
               for (unsigned i = 0; file[i]; ++i) {
                 if (file[i] == '\\') file[i] = '/';
@@ -88,11 +86,6 @@ namespace octet { namespace resources {
       }
     }
 
-    /// close the zip file
-    ~zip_file() {
-      if (the_file) fclose(the_file);
-    }
-
     /// allow ref<zip_file>
     void add_ref() {
       ref_cnt++;
@@ -109,10 +102,10 @@ namespace octet { namespace resources {
     void get_file(dynarray<uint8_t> &buffer, const char *file) {
       int index = directory.get_index(file);
       if (index < 0) return;
-      if (!the_file) return;
+      if (!map.get_data()) return;
       const dir_entry &d = directory.get_value(index);
-      buffer.resize(d.usize);
-      fseek(the_file, d.offset, SEEK_SET);
+      const uint8_t *begin = map.get_data();
+      uint64_t file_size = map.get_size();
       /*local file header signature     4 bytes  (0x04034b50) 0
       version needed to extract       2 bytes 4
       general purpose bit flag        2 bytes 6
@@ -125,17 +118,28 @@ namespace octet { namespace resources {
       file name length                2 bytes 26
       extra field length              2 bytes 28 / 30*/
 
-      uint8_t tmp[30];
-      fread(tmp, 1, sizeof(tmp), the_file);
+      if ((uint64_t)d.offset + 30 > file_size) return;
+      const uint8_t *tmp = begin + d.offset;
       if (u4(tmp) != 0x04034b50) return;
       unsigned extra = u2(tmp + 26) + u2(tmp + 28);
-      fseek(the_file, d.offset + 30 + extra, SEEK_SET);
+      uint64_t data_offset = (uint64_t)d.offset + 30 + extra;
+      if (data_offset + d.csize > file_size) return;
+      const uint8_t *src = begin + data_offset;
       if (d.compression == 0) {
-        fread(buffer.data(), 1, d.usize, the_file);
+        if (d.csize < d.usize) return;
+        buffer.resize(d.usize);
+        memcpy(buffer.data(), src, d.usize);
       } else if (d.compression == 8) {
-        dynarray<uint8_t> uncomp(d.csize + 4); // note: + 4 bytes prevents decode() overflowing
-        fread(uncomp.data(), 1, d.csize, the_file);
-        decoder.decode(buffer.data(), buffer.data() + d.usize, uncomp.data(), uncomp.data() + d.csize);
+        buffer.resize(d.usize);
+        if (data_offset + d.csize + 4 <= file_size) {
+          // inflate straight from the mapping. the central directory follows,
+          // so the 4 bytes decode() may read past the end are always there
+          decoder.decode(buffer.data(), buffer.data() + d.usize, src, src + d.csize);
+        } else {
+          dynarray<uint8_t> uncomp(d.csize + 4); // note: + 4 bytes prevents decode() overflowing
+          memcpy(uncomp.data(), src, d.csize);
+          decoder.decode(buffer.data(), buffer.data() + d.usize, uncomp.data(), uncomp.data() + d.csize);
+        }
       }
     }
   };
@@ -335,9 +335,9 @@ namespace octet { namespace scene {
     }
 
     void load_part(const char *_url) {
-      dynarray<uint8_t> buffer;
+      url_view buffer;
       app_utils::get_url(buffer, _url);
-      const unsigned char *src = &buffer[0];
+      const unsigned char *src = buffer.data();
       const unsigned char *src_max = src + buffer.size();
       if (buffer.size() >= 6 && !memcmp(&buffer[0], "GIF89a", 6)) {
         gif_decoder dec;
@@ -86,7 +86,7 @@ namespace octet { namespace scene {
     };
 
     // add a new edge to a hash map. (index, index) -> (triangle+1, triangle+1)
-    static void add_edge(dynarray<edge> &edges, unsigned tri_idx, unsigned i0, unsigned i1) {
+    template <class allocator_t> static void add_edge(dynarray<edge, allocator_t> &edges, unsigned tri_idx, unsigned i0, unsigned i1) {
       edge e = { std::min(i0, i1), std::max(i0, i1), tri_idx, ~0 };
       edges.push_back(e);
     }
@@ -637,7 +637,7 @@ namespace octet { namespace scene {
     }
 
     /// assign a vector to the vertex buffer and set params
-    template <class elem_t> void set_vertices(const dynarray<elem_t> &rhs) {
+    template <class elem_t, class allocator_t> void set_vertices(const dynarray<elem_t, allocator_t> &rhs) {
       if (!vertices || vertices->get_size() != rhs.size() * sizeof(elem_t)) {
         vertices = new gl_resource();
         vertices->allocate(GL_ARRAY_BUFFER, rhs.size() * sizeof(elem_t));
@@ -653,7 +653,7 @@ namespace octet { namespace scene {
     }
 
     /// assign a vector to the index buffer and set params
-    template <class elem_t> void set_indices(const dynarray<elem_t> &rhs) {
+    template <class elem_t, class allocator_t> void set_indices(const dynarray<elem_t, allocator_t> &rhs) {
       if (!indices || indices->get_size() != rhs.size() * sizeof(elem_t)) {
         indices = new gl_resource();
         indices->allocate(GL_ELEMENT_ARRAY_BUFFER, rhs.size() * sizeof(elem_t));
@@ -666,7 +666,8 @@ namespace octet { namespace scene {
 
     /// Get all the edges in a hash map to avoid duplicates.
     /// record the triangle indices that they came from.
-    void get_edges(dynarray<edge> &edges) {
+    /// edges can use the frame_allocator if they are only needed for this frame.
+    template <class allocator_t> void get_edges(dynarray<edge, allocator_t> &edges) {
       if (get_index_type() != GL_UNSIGNED_INT) return;
 
       gl_resource::rolock idx_lock(get_indices());
@@ -711,7 +712,7 @@ namespace octet { namespace scene {
     ///
     ///   There is only one triangle that uses the edge.
     ///   One triangle can be seen from the viewpoint, the other can't.
-    void get_silhouette_edges(const vec3 &viewpoint, bool is_directional, dynarray<edge> &edges) {
+    template <class allocator_t> void get_silhouette_edges(const vec3 &viewpoint, bool is_directional, dynarray<edge, allocator_t> &edges) {
       unsigned pos_slot = get_slot(attribute_pos);
       if (get_index_type() != GL_UNSIGNED_INT) return;
       if (get_size(pos_slot) < 3) return;
@@ -752,14 +753,21 @@ namespace octet { namespace scene {
       const uint32_t *ip = idx_lock.u32();
       const uint8_t *vp = vtx_lock.u8();
       unsigned stride = get_stride();
+
+      // gather the positions and transform them all at once
+      dynarray<vec3p> pos_in(get_num_indices());
+      dynarray<vec4> pos_out(get_num_indices());
       for (unsigned i = 0; i != get_num_indices(); ++i) {
-        vec4 pos_in = vec4((vec3)*(const vec3p*)(vp + ip[i] * stride + pos_offset), 1.0f );
-        vec4 pos_out = pos_in * modelToProjection;
-        vec3 res = pos_out.perspectiveDivide();
+        pos_in[i] = *(const vec3p*)(vp + ip[i] * stride + pos_offset);
+      }
+      batch::transform_points(pos_out.data(), pos_in.data(), modelToProjection, get_num_indices());
+
+      for (unsigned i = 0; i != get_num_indices(); ++i) {
+        vec3 res = pos_out[i].perspectiveDivide();
         //vec3 ares = abs(res);
         bool err = any(abs(res) > vec3(1));
         char tmp[2][256];
-        log("%5d %s -> %s %s\n", i, pos_in.toString(tmp[0], sizeof(tmp[0])), res.toString(tmp[1], sizeof(tmp[1])), err ? "FAIL" : "");
+        log("%5d %s -> %s %s\n", i, vec4((vec3)pos_in[i], 1.0f).toString(tmp[0], sizeof(tmp[0])), res.toString(tmp[1], sizeof(tmp[1])), err ? "FAIL" : "");
       }
     }
 
@@ -959,8 +967,10 @@ namespace octet { namespace scene {
 
     template <class vertex_t> struct sink {
       mesh *mesh_;
-      dynarray<vertex_t> vertices;
-      dynarray<uint32_t> indices;
+
+      // copied to the mesh's buffers in the destructor, so the frame arena will do
+      dynarray<vertex_t, frame_allocator> vertices;
+      dynarray<uint32_t, frame_allocator> indices;
       mat4t transform;
 
       sink(mesh *mesh_, mat4t_in transform) :
@@ -15,8 +15,8 @@ namespace octet { namespace scene {
     // todo: support DAGs with multiple node parents
     ref<scene_node> parent;
 
-    // child nodes
-    dynarray<ref<scene_node> > children;
+    // child nodes. most nodes have one or two, so keep them in the node
+    small_dynarray<ref<scene_node>, 2> children;
 
     // this node's transform relative to parent
     mat4t nodeToParent;
@@ -20,6 +20,7 @@ namespace octet { namespace scene {
     // cached skin components
     dynarray<mat4t> result;  /// uniforms to shader
     dynarray<int> indices;   /// map skeleton to skin indices
+    dynarray<mat4t> jointToNode; /// boneToNode for each skin joint
   public:
     RESOURCE_META(skeleton)
 
@@ -90,15 +91,21 @@ namespace octet { namespace scene {
       }
 
       // premultiply by skin matrices
+      // skin -> bind space -> skeleton -> parent -> parent -> world -> camera
+      if (jointToNode.size() < num_joints) {
+        jointToNode.resize(num_joints);
+      }
       for (int i = 0; i != num_joints; ++i) {
-        // skin -> bind space -> skeleton -> parent -> parent -> world -> camera
         int index = indices[i];
-        if (index != -1) {
-          result[i] = skn->get_modelToBind() * skn->get_bindToModel(i) * boneToNode[index];
-        } else {
+        jointToNode[i] = index != -1 ? boneToNode[index] : worldToCamera;
+      }
+      batch::mul(&result[0], skn->get_modelToBind(), &skn->get_bindToModel(0), num_joints);
+      batch::mul(&result[0], &result[0], &jointToNode[0], num_joints);
+      for (int i = 0; i != num_joints; ++i) {
+        if (indices[i] == -1) {
           result[i] = worldToCamera;
         }
-        //if (first_frame) log("%d %d [%s]\n", i, index, result[i].toString());
+        //if (first_frame) log("%d %d [%s]\n", i, indices[i], result[i].toString());
       }
 
       return &result[0];
@@ -59,39 +59,52 @@ namespace octet { namespace scene {
       void set_world_gravity(btVector3 gravity){
         world->setGravity(gravity);
       }
+
+      /// the physics world, for anything that adds its own forces each step
+      btDiscreteDynamicsWorld *get_dynamics_world() {
+        return world;
+      }
       private:
     #else
       typedef void collison_shape_t;
     #endif
 
-    void draw_aabb(const aabb &bb) {
-      vec3 pos[8];
-      vec3 center = bb.get_center();
-      vec3 half = bb.get_half_extent();
-      for (int i = 0; i != 8; ++i) {
-        pos[i] = center + half * vec3(
-          (i & 1 ? 1.0f : -1.0f),
-          (i & 2 ? 1.0f : -1.0f),
-          (i & 4 ? 1.0f : -1.0f)
-        );
-      }
-
-      static const uint16_t indices[] = {
+    // add the twelve edges of a box to a line list
+    static void get_aabb_lines(vec3p *lines, const aabb &bb) {
+      static const uint8_t indices[] = {
         0, 1, 2, 3, 4, 5, 6, 7,
         0, 2, 1, 3, 4, 6, 5, 7,
         0, 4, 1, 5, 2, 6, 3, 7
       };
 
+      vec3 center = bb.get_center();
+      vec3 half = bb.get_half_extent();
+      for (int i = 0; i != 24; ++i) {
+        unsigned corner = indices[i];
+        lines[i] = center + half * vec3(
+          (corner & 1 ? 1.0f : -1.0f),
+          (corner & 2 ? 1.0f : -1.0f),
+          (corner & 4 ? 1.0f : -1.0f)
+        );
+      }
+    }
+
+    void draw_lines(const vec3p *pos, unsigned num_vertices) {
       /// render immediate data (this is inefficient!)
       glBindBuffer(GL_ARRAY_BUFFER, 0);
-      glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, 0, (void*)pos );
+      glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, sizeof(vec3p), (void*)pos );
       glEnableVertexAttribArray(attribute_pos);
     
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-      glDrawElements(GL_LINES, 24, GL_UNSIGNED_SHORT, indices);
+      glDrawArrays(GL_LINES, 0, num_vertices);
       glDisableVertexAttribArray(attribute_pos);
     }
 
+    void draw_aabb(const aabb &bb) {
+      vec3p lines[24];
+      get_aabb_lines(lines, bb);
+      draw_lines(lines, 24);
+    }
+
     void calc_lighting(const mat4t &worldToCamera) {
       vec4 &ambient = light_uniforms[0];
       ambient = vec4(0, 0, 0, 1);
@@ -117,12 +130,22 @@ namespace octet { namespace scene {
     }
 
     void render_mesh_aabbs() {
-      for (unsigned mesh_index = 0; mesh_index != mesh_instances.size(); ++mesh_index) {
+      // this is rebuilt every frame, so use the frame arena
+      unsigned num_boxes = mesh_instances.size();
+      dynarray<aabb, frame_allocator> boxes(num_boxes);
+      dynarray<mat4t, frame_allocator> modelToWorld(num_boxes);
+      for (unsigned mesh_index = 0; mesh_index != num_boxes; ++mesh_index) {
         mesh_instance *mi = mesh_instances[mesh_index];
-        aabb bb = mi->get_mesh()->get_aabb();
-        bb = bb.get_transform(mi->get_node()->calcModelToWorld());
-        draw_aabb(bb);
+        boxes[mesh_index] = mi->get_mesh()->get_aabb();
+        modelToWorld[mesh_index] = mi->get_node()->calcModelToWorld();
       }
+      batch::transform_aabbs(boxes.data(), boxes.data(), modelToWorld.data(), num_boxes);
+
+      dynarray<vec3p, frame_allocator> lines(num_boxes * 24);
+      for (unsigned i = 0; i != num_boxes; ++i) {
+        get_aabb_lines(&lines[i * 24], boxes[i]);
+      }
+      draw_lines(lines.data(), lines.size());
     }
 
     void render_debug_line_buffer() {
@@ -609,22 +632,24 @@ namespace octet { namespace scene {
 
     /// get the approximate size of the scene, not including lights or cameras
     aabb get_world_aabb() {
-      aabb world_aabb;
-      bool first = true;
+      // gather the boxes and their matrices and transform them all at once
+      dynarray<aabb, frame_allocator> boxes;
+      dynarray<mat4t, frame_allocator> nodeToWorld;
+      boxes.reserve(mesh_instances.size());
+      nodeToWorld.reserve(mesh_instances.size());
       for (int i = 0; i != mesh_instances.size(); ++i) {
         mesh_instance *mi = mesh_instances[i];
         if (mi && mi->get_node()) {
-          mat4t nodeToWorld = mi->get_node()->calcModelToWorld();
-          aabb bb = mi->get_mesh()->get_aabb();
-          bb = bb.get_transform(nodeToWorld);
-          if (first) {
-            world_aabb = bb;
-            first = false;
-          } else {
-            world_aabb = world_aabb.get_union(bb);
-          }
+          nodeToWorld.push_back(mi->get_node()->calcModelToWorld());
+          boxes.push_back(mi->get_mesh()->get_aabb());
         }
       }
+      batch::transform_aabbs(boxes.data(), boxes.data(), nodeToWorld.data(), boxes.size());
+
+      aabb world_aabb;
+      for (int i = 0; i != boxes.size(); ++i) {
+        world_aabb = i == 0 ? boxes[i] : world_aabb.get_union(boxes[i]);
+      }
       return world_aabb;
     }
 